@@ -73,11 +73,13 @@ void RGBpixmap::RGBerror(const string& msg, bool fatal) const
 // this down.
 //----------------------------------------------------------------------
 void RGBpixmap::freeIt() { // deallocate everything
-    delete [] pixel;
+    trackedDeleteArray(pixel);
+    pixel = NULL;
     nRows = nCols = 0;
     if (bmpIn != NULL) {
         bmpIn->close();
         delete bmpIn;
+        bmpIn = NULL;
     }
 }
 
@@ -195,7 +197,8 @@ bool RGBpixmap::readBMPFile(const string& fname, bool glPad, bool verbose)
         }
     }
 
-    pixel = new RGBpixel[nRows * nCols]; // allocate array
+    trackedDeleteArray(pixel); // drop any earlier image
+    pixel = trackedNewArray<RGBpixel>(MEMORY_TEXTURES, nRows * nCols); // allocate array
     if (!pixel) { // cannot allocate
         RGBerror("Cannot allocate storage for image array", true);
         return false;
@@ -217,6 +220,8 @@ bool RGBpixmap::readBMPFile(const string& fname, bool glPad, bool verbose)
         }
     }
     bmpIn->close(); // close the file
+    delete bmpIn;
+    bmpIn = NULL;
     return true; // return good status
 }
 
@@ -310,6 +315,8 @@ bool RGBpixmap::writeBMPFile(const string& fname) {
         }
     }
     bmpOut->close(); // close the file
+    delete bmpOut;
+    bmpOut = NULL;
     return true; // return good status
 }
 
@@ -19,6 +19,7 @@
 #include <fstream> // C++ file I/O
 #include <iostream> // C++ I/O
 #include <string> // STL strings
+#include "memtrack.h" // tagged allocation
 #ifdef OGL // for OpenGL use only
  #include <GL/glut.h> // glut/OpenGL includes
 #endif
@@ -81,7 +82,7 @@ public:
     RGBpixmap(int rows, int cols) // constructor
     {
         nRows = rows; nCols = cols;
-        pixel = new RGBpixel[rows*cols];
+        pixel = trackedNewArray<RGBpixel>(MEMORY_TEXTURES, rows*cols);
         bmpIn = NULL; bmpOut = NULL;
     }
 
@@ -1,14 +1,49 @@
 #include "a3.h"
 #include "mesh.h"
 #include "balloon.h"
+#include "terrain.h"
+#include "raycast.h"
+#include "game.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "allocstats.h"
+#include "profiler.h"
+#include "memtrack.h"
+#include "latency.h"
+#include "lighting.h"
+#include "jobs.h"
+#include "lod.h"
+
+#if defined(FREEGLUT)
+  #include <gl/freeglut_ext.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 
 // Program constants (can be modified to adjust a few default properties)
 #define PI 3.14159265358979323846 // Math Constant PI 
 
 #define CAMERA_RADIUS 64.0f                 // The default camera distance from origin 
 #define CAMERA_LOOKAT 0.0f,0.0f,0.0f        // The default camera look-at point
+#define CAMERA_FOV 70.0                     // Vertical field of view in degrees
 
 #define NUM_TARGETS 10     // The number of targets to shoot
+#define FRAME_MS 16        // Time between redraw checks (at most about 60 frames per second)
+
+#define HUD_FRAMES 120     // Frames shown in the frame time graph
+#define HUD_SCALE_MS 50.0f // Frame time at the top of the graph
+
+#define MARKER_SIZE 0.6f   // Half the width of the ground markers
+
+// Levels of detail: the smallest projected size (pixels) of each mesh level;
+// smaller bombs and targets are drawn as points
+#define BOMB_LOD_FULL 16.0f
+#define BOMB_LOD_COARSE 4.0f
+#define TARGET_LOD_CUBE 3.0f
+#define TARGET_CULLED 255 // level of a target hidden by the terrain this frame
 
 
 // Basic Function Definitions
@@ -17,16 +52,25 @@ void reshape(int w, int h);
 
 // Display Functions
 void display();
-void drawBomb();
-void drawTargets();
-
-// Target Functions
-void moveTargets(int);
-void findNearbyTargets();
-void checkCollisions();
+void drawBombs(const GameSnapshot & s);
+void drawTargets(const GameSnapshot & s);
+void drawMarker(const VECTOR3D & p);
+void initLod();
+float projectedSize(const VECTOR3D & p, float size);
+bool isOccluded(const VECTOR3D & centre, float halfSize);
+void redrawTimer(int);
+void printFrameStats();
+void drawHud();
+
+// Simulation Functions
+void simulationLoop();
+void simulationTick();
+void stopSimulation();
+void quitGame();
+void queueEvent(unsigned char kind, int code);
 
 // Event Handlers Function Definitions
-//void mouseButtonHandler(int button, int state, int x, int y);
+void mouseButtonHandler(int button, int state, int x, int y);
 //void mouseMotionHandler(int x, int y);
 void keyboardHandler(unsigned char key, int x, int y);
 void specialKeyHandler(int key, int x, int y);
@@ -39,24 +83,84 @@ GLfloat light_diffuse[]   = {1.0, 1.0, 1.0, 1.0};
 GLfloat light_specular[]  = {0.0, 0.0, 0.0, 1.0};
 
 // Global Variables
+Terrain terrain;
+HeightPyramid pyramid; // for ray casts against the terrain
+TerrainLighting terrainLighting;
 Mesh mesh;
 Balloon balloon;
-Target *targets;
-
-int targetsLeft;
+Game game; // owned by the simulation thread once it has started
+
+// Simulation Thread
+std::thread simThread;
+std::atomic<bool> simRunning(false);
+SnapshotBuffer snapshots; // finished ticks, handed to the render thread
+
+std::mutex inputLock;
+std::vector<InputEvent> queuedEvents;  // game key presses since the last tick (guarded by inputLock)
+std::vector<InputEvent> pendingEvents; // the events applied in the current tick
+std::vector<LatencyStamp> queuedStamps;  // when each queued event was pressed (guarded by inputLock)
+std::vector<LatencyStamp> pendingStamps; // the same for the current tick
+LatencyTracker latency;
+
+// Frame Statistics
+int framesDrawn = 0;
+int framesRepeated = 0;   // frames that found no new tick to draw
+int framesSkipped = 0;    // redraw checks that found nothing visible had changed
+int snapshotChecks = 0;   // snapshots taken by the redraw timer
+double stallTotalUs = 0.0; // time spent getting a snapshot
+double stallMaxUs = 0.0;
+std::atomic<long long> simTicks(0);
+std::atomic<long long> simTotalUs(0); // time spent in simulationTick
+
+long long frameAllocations = 0;          // heap allocations made while drawing
+int framesAllocating = 0;                // frames that made any
+std::atomic<long long> simAllocations(0); // heap allocations made by ticks
+std::atomic<int> ticksAllocating(0);      // ticks that made any
+
+const GameSnapshot *lastSnapshot = NULL; // the newest snapshot taken (drawn or skipped)
+bool snapshotFresh = false;              // a new tick was taken since the last frame
+
+// Redraw Control
+int frameMs = FRAME_MS;  // time between redraw checks (--max-fps)
+bool viewDirty = true;   // the camera or an overlay changed since the last frame
+uint32_t drawnScene = 0; // sceneHash of the snapshot last drawn
+
+// Recording and Replay
+unsigned int sessionSeed;
+int numTargets = NUM_TARGETS;
+int maxBombs = 1;            // --bombs
+bool respawnTargets = false; // --respawn
+bool craters = false;        // only from a replay: the mesh does not show them
+InputRecorder recorder;
+InputReplay replay;
+std::atomic<bool> replaying(false);
 
 // Constants
-const float target_size = 1.0f;
 const float bomb_radius = 0.5f;
 
 // Texture Mapping
 RGBpixmap pix1[10];
 GLuint textureId;
 
-// Bomb Properties
-VECTOR3D bombPosition;
-bool activeBomb;
-std::vector<int> nearbyTargets;
+// Picking
+GLdouble viewModel[16];      // the viewing transformation of the last frame
+GLdouble viewProjection[16];
+GLint viewport[4];
+bool picked = false;
+VECTOR3D pickedPoint;
+
+// Levels of Detail
+LodChain bombLod;
+LodChain targetLod;
+std::vector<unsigned char> bombLodLevel;   // per bomb, the level drawn last frame
+std::vector<unsigned char> targetLodLevel; // per target, the level drawn last frame
+VECTOR3D eyePosition;                      // the eye of the current frame
+float lodScale;                            // pixels across for one unit at distance one
+
+// Occlusion Culling
+bool occlusionCulling = true; // 'O' toggles
+int targetsDrawn = 0;         // visible targets drawn in the last frame
+int targetsCulled = 0;        // and those the terrain hid
 
 // Camera Properties
 VECTOR3D cameraPos;
@@ -64,16 +168,95 @@ float cameraRadius;
 int cameraInclination;
 int cameraAzimuth;
 
+// Terrain Generators
+NoiseGenerator noiseTerrain(0);
+bool useNoiseTerrain = false;
+bool useCompactTerrain = false;
+
+// Baked Terrain Lighting
+bool bakeLighting = false;  // --bake
+bool bakeOcclusion = false; // --bake-ao
+bool useBakedLighting;      // draw with the baked colours (F7 toggles)
+
 // Flags
 bool wireframe;
 bool texture;
-bool viewTargets;
 bool balloonCamera;
+bool showHud;
+
+// Frame Time Graph (profiler builds only)
+float frameTimesMs[HUD_FRAMES];
+int frameTimeNext = 0;
+std::chrono::steady_clock::time_point lastFrame;
 
 
 int main(int argc, char **argv)
 {
     glutInit(&argc,argv); 
+
+    // Command line options (GLUT has already removed its own)
+    const char *recordPath = NULL;
+    const char *replayPath = NULL;
+
+    sessionSeed = (unsigned int) time(NULL);
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--noise") == 0)
+            useNoiseTerrain = true;
+        else if(strcmp(argv[i], "--compact") == 0)
+            useCompactTerrain = true;
+        else if(strcmp(argv[i], "--bombs") == 0 && i+1 < argc)
+            maxBombs = min(max(atoi(argv[++i]), 1), MAX_BOMBS);
+        else if(strcmp(argv[i], "--respawn") == 0)
+            respawnTargets = true;
+        else if(strcmp(argv[i], "--seed") == 0 && i+1 < argc)
+            sessionSeed = (unsigned int) strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--record") == 0 && i+1 < argc)
+            recordPath = argv[++i];
+        else if(strcmp(argv[i], "--replay") == 0 && i+1 < argc)
+            replayPath = argv[++i];
+        else if(strcmp(argv[i], "--bake") == 0)
+            bakeLighting = true;
+        else if(strcmp(argv[i], "--bake-ao") == 0)
+            bakeLighting = bakeOcclusion = true;
+        else if(strcmp(argv[i], "--max-fps") == 0 && i+1 < argc)
+            frameMs = max(1, 1000 / max(1, atoi(argv[++i])));
+        else if(strcmp(argv[i], "--budget") == 0 && i+1 < argc)
+        {
+            if(!parseMemoryBudget(argv[++i]))
+                cout << "Ignoring bad budget " << argv[i] << "\n";
+        }
+    }
+
+    // A replay brings its own world
+    if(replayPath != NULL)
+    {
+        if(!replay.open(replayPath))
+            return 1;
+
+        replaying = true;
+        sessionSeed = replay.getHeader().seed;
+        numTargets = replay.getHeader().numTargets;
+        useNoiseTerrain = (replay.getHeader().flags & REPLAY_FLAG_NOISE) != 0;
+        useCompactTerrain = (replay.getHeader().flags & REPLAY_FLAG_COMPACT) != 0;
+        respawnTargets = (replay.getHeader().flags & REPLAY_FLAG_RESPAWN) != 0;
+        craters = (replay.getHeader().flags & REPLAY_FLAG_CRATERS) != 0;
+        maxBombs = replay.getHeader().maxBombs;
+    }
+
+    if(recordPath != NULL)
+    {
+        ReplayHeader header = { sessionSeed, (unsigned int) numTargets,
+                                (unsigned char)((useNoiseTerrain ? REPLAY_FLAG_NOISE : 0) |
+                                                (useCompactTerrain ? REPLAY_FLAG_COMPACT : 0) |
+                                                (respawnTargets ? REPLAY_FLAG_RESPAWN : 0)),
+                                (unsigned char) maxBombs };
+
+        if(!recorder.open(recordPath, header))
+            return 1;
+    }
+
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH); 
 
     GLint gsw = glutGet(GLUT_SCREEN_WIDTH);
@@ -85,12 +268,23 @@ int main(int argc, char **argv)
     glutCreateWindow ("CPS511 A3: Hot-Air Balloon Bomber"); 
 
     glutDisplayFunc(display);
-    //glutMouseFunc(mouseButtonHandler);
+    glutReshapeFunc(reshape);
+    glutMouseFunc(mouseButtonHandler);
     //glutMotionFunc(mouseMotionHandler);
     glutKeyboardFunc(keyboardHandler);
     glutSpecialFunc(specialKeyHandler);
 
+#if defined(FREEGLUT)
+    // Closing the window ends the loop instead of calling exit() from inside it
+    glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
+#endif
+
     init(windowSize, windowSize); // Calls the init function
+
+    // The simulation thread is running now; however the program ends, it
+    // must be joined before the globals it uses are destroyed
+    atexit(quitGame);
+
     glutMainLoop(); // Enters the GLUT event processing loop.
 
     return 0;
@@ -107,7 +301,7 @@ void init(int w, int h)
     glViewport(0, 0, (GLsizei) w, (GLsizei) h);
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(70.0,1.0,0.1,1000.0);
+    gluPerspective(CAMERA_FOV,1.0,0.1,1000.0);
 
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
@@ -140,33 +334,64 @@ void init(int w, int h)
     wireframe = false;
     texture = true;
     balloonCamera = false;
-    activeBomb = false;
+    showHud = false;
 
-    // Initialize Objects
-    mesh.initMesh();
-    balloon.initBalloon(mesh.getMaxHeight());
+#if defined(ENABLE_PROFILER)
+    profilerSetThreadName("render");
+    lastFrame = std::chrono::steady_clock::now();
+#endif
 
-    // Initialize targets
-    srand( time(NULL) );
+    // Initialize Objects (every random choice derives from the session seed)
+    if(useNoiseTerrain)
+    {
+        noiseTerrain.seed = deriveSeed(sessionSeed, RNG_STREAM_NOISE);
+        terrain.setGenerator(&noiseTerrain);
+    }
 
-    targets = new Target[NUM_TARGETS];
-    targetsLeft = NUM_TARGETS;
+    terrain.setSeed(sessionSeed);
+    terrain.setCompact(useCompactTerrain);
+    terrain.initTerrain(MESH_RESOLUTION, MESH_RESOLUTION);
+    mesh.initMesh(&terrain);
+    pyramid.build(&terrain);
 
-    for(int i = 0; i < NUM_TARGETS; ++i)
+    // Light the static terrain once, on every core, instead of every frame
+    if(bakeLighting)
     {
-        Target t;
-        t.position = mesh.getRandomVertex();
-        t.size = target_size;
-        t.meshHeight = t.position.y - t.size*2;
-        t.moving = false;
-        t.hit = false;
-        t.ticksBeforeMoving = rand() % 120 +1;
-
-        targets[i] = t;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        JobSystem bakeJobs;
+        bakeJobs.start(0);
+        terrainLighting.bake(&terrain, VECTOR3D(light_position0), bakeOcclusion, &bakeJobs);
+
+        cout << "Baked the terrain lighting" << (bakeOcclusion ? " with occlusion" : "") << " in "
+             << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+             << " ms on " << bakeJobs.getNumThreads() << " threads\n";
+
+        bakeJobs.stop();
+        mesh.setLighting(&terrainLighting);
     }
 
-    cout << "There are " << NUM_TARGETS << " targets. Shoot them down!" << "\n";
-    glutTimerFunc(25, moveTargets, 0);
+    useBakedLighting = bakeLighting;
+    balloon.initBalloon(terrain.getMaxHeight());
+
+    // Initialize the game (places the targets)
+    game.setRules(maxBombs, respawnTargets, craters);
+    game.initGame(&terrain, numTargets, sessionSeed);
+    initLod();
+
+    cout << "Seed " << sessionSeed << (replay.isOpen() ? " (replay)" : "") << "\n";
+    cout << "There are " << numTargets << " targets. Shoot them down!" << "\n";
+
+    // Publish tick 0, then hand the game over to the simulation thread
+    snapshots.getBack().capture(game);
+    snapshots.publish();
+
+    lastSnapshot = &snapshots.acquire(&snapshotFresh);
+
+    simRunning = true;
+    simThread = std::thread(simulationLoop);
+
+    glutTimerFunc(frameMs, redrawTimer, 0);
 } 
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -178,10 +403,12 @@ void reshape(int w, int h)
 
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(70.0,1.0,0.1,1000.0);
+    gluPerspective(CAMERA_FOV,1.0,0.1,1000.0);
 
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
+
+    viewDirty = true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -189,14 +416,35 @@ void reshape(int w, int h)
 
 void display(void)
 {
+    PROFILE_ZONE("display");
+
+    long long allocationsBefore = heapAllocationsThisThread();
+
+    // Draw the snapshot the redraw timer took and judged; the simulation
+    // keeps running meanwhile
+    LatencyStamp start = std::chrono::steady_clock::now();
+    const GameSnapshot & s = *lastSnapshot;
+    framesDrawn++;
+
+    if(!snapshotFresh)
+        framesRepeated++;
+
+    snapshotFresh = false;
+    drawnScene = s.sceneHash;
+    viewDirty = false;
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
 
+    // The balloon is drawn where the simulation put it
+    balloon.position = s.balloonPosition;
+
     // Set up the Viewing Transformation (V matrix)
     if(balloonCamera)
     {
         gluLookAt(balloon.position.x, balloon.getBaseHeight(), balloon.position.z, 
                   balloon.position.x, -1000.0f, balloon.position.z-0.000001f, 0.0,1.0,0.0);
+        eyePosition = VECTOR3D(balloon.position.x, balloon.getBaseHeight(), balloon.position.z);
     }
     else
     {
@@ -205,7 +453,15 @@ void display(void)
         cameraPos.SetZ(cameraRadius * sin(cameraInclination*PI/180) * sin(cameraAzimuth*PI/180));
         
         gluLookAt(cameraPos.GetX(),cameraPos.GetY(),cameraPos.GetZ(), CAMERA_LOOKAT, 0.0,1.0,0.0);
+        eyePosition = cameraPos;
     }
+
+    // Kept for unprojecting mouse clicks
+    glGetDoublev(GL_MODELVIEW_MATRIX, viewModel);
+    glGetDoublev(GL_PROJECTION_MATRIX, viewProjection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    lodScale = viewport[3] / (2.0f * tanf(CAMERA_FOV * 0.5f * PI / 180.0f));
   
     // Set polygon rasterization mode (wireframe or fill)
     if(wireframe)
@@ -215,192 +471,501 @@ void display(void)
 
     // Call draw functions/methods
     mesh.drawMesh();
-    balloon.drawBalloon();
+    balloon.drawBalloon(projectedSize(balloon.position, BALLOON_SIZE));
+
+    drawBombs(s);
+    drawTargets(s);
+
+    // Where a bomb dropped now would land, and the last picked point
+    RayHit impact;
+
+    if(pyramid.castRay(VECTOR3D(balloon.position.x, balloon.getBaseHeight(), balloon.position.z),
+                       VECTOR3D(0.0f, -1.0f, 0.0f), &impact))
+    {
+        glColor3f(1.0, 1.0, 0.0);
+        drawMarker(impact.point);
+    }
+
+    if(picked)
+    {
+        glColor3f(0.0, 1.0, 1.0);
+        drawMarker(pickedPoint);
+    }
 
-    drawBomb();
-    drawTargets();
+#if defined(ENABLE_PROFILER)
+    // Time since the previous frame, for the graph
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    frameTimesMs[frameTimeNext] = std::chrono::duration<float, std::milli>(now - lastFrame).count();
+    frameTimeNext = (frameTimeNext + 1) % HUD_FRAMES;
+    lastFrame = now;
+
+    if(showHud)
+        drawHud();
+#endif
 
     glutSwapBuffers();
+    latency.frameShown(s.tick, start);
+
+    long long allocations = heapAllocationsThisThread() - allocationsBefore;
+    frameAllocations += allocations;
+
+    if(allocations > 0)
+        framesAllocating++;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-//       drawBomb - draws the falling bomb
+//       drawBombs - draws the falling bombs
 
-void drawBomb()
+void drawBombs(const GameSnapshot & s)
 {
-    if(activeBomb)
+    PROFILE_ZONE("drawBombs");
+
+    // Set the color of the bombs
+    glColor3f(0.1, 0.1, 0.1);
+
+    for(int b = 0; b < s.numBombs; ++b)
     {
-        // Set the color of the bomb
-        glColor3f(0.1, 0.1, 0.1);
-        
-        // Draw the bomb
-        glPushMatrix();
-        glTranslatef(bombPosition.x, bombPosition.y, bombPosition.z);
-        glutSolidSphere(bomb_radius,8,8);
-        glPopMatrix();
+        const VECTOR3D & p = s.bombPosition[b];
+        unsigned char & level = bombLodLevel[s.bombId[b]];
 
-        // Change bomb height
-        if(bombPosition.y <= 0.0f)
+        if(isOccluded(p, bomb_radius))
+            continue;
+
+        level = (unsigned char) bombLod.select(projectedSize(p, 2.0f * bomb_radius), level);
+
+        if(level < bombLod.getNumLevels())
         {
-            activeBomb = false;
-            nearbyTargets.clear();
+            // Draw the bomb
+            glPushMatrix();
+            glTranslatef(p.x, p.y, p.z);
+            bombLod.draw(level);
+            glPopMatrix();
         }
         else
         {
-            bombPosition.y -= 0.1f;
+            glPushAttrib(GL_ENABLE_BIT);
+            glDisable(GL_LIGHTING);
+            glDisable(GL_TEXTURE_2D);
 
-            // if there are nearby targets, check for collisions
-            if(!nearbyTargets.empty())
-                checkCollisions();
-        }
+            glBegin(GL_POINTS);
+              glVertex3f(p.x, p.y, p.z);
+            glEnd();
 
-        glutPostRedisplay();
+            glPopAttrib();
+        }
     }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-//       drawTargets - draws the moving targets
+//       drawTargets - draws the visible targets that the terrain does not hide:
+//                     cubes where they are big enough on screen, then the
+//                     rest as points in one batch
 
-void drawTargets()
+void drawTargets(const GameSnapshot & s)
 {
+    PROFILE_ZONE("drawTargets");
+
     glColor3f(1.0, 0.1, 0.1);
 
-    for(int i = 0; i < NUM_TARGETS; ++i)
+    // The cube is a unit cube scaled to each target
+    glPushAttrib(GL_ENABLE_BIT);
+    glEnable(GL_NORMALIZE);
+
+    int numPoints = 0;
+    targetsDrawn = targetsCulled = 0;
+
+    for(int i = 0; i < s.numTargets; ++i)
     {
-        Target t = targets[i];
+        unsigned char & level = targetLodLevel[s.targetId[i]];
+        VECTOR3D centre(s.targetX[i], s.targetY[i], s.targetZ[i]);
 
-        if((t.moving) || (viewTargets && !t.hit))
+        // Hidden by the terrain: no mesh and no point
+        if(isOccluded(centre, s.targetSize[i] * 0.5f))
         {
-            glPushMatrix();
-            glTranslatef(t.position.x, t.position.y, t.position.z);
-            glutSolidCube(target_size);
-            glPopMatrix();
+            level = TARGET_CULLED;
+            targetsCulled++;
+            continue;
         }
+
+        targetsDrawn++;
+        level = (unsigned char) targetLod.select(projectedSize(centre, s.targetSize[i]), level == TARGET_CULLED ? 0 : level);
+
+        if(level == targetLod.getNumLevels())
+        {
+            numPoints++;
+            continue;
+        }
+
+        glPushMatrix();
+        glTranslatef(s.targetX[i], s.targetY[i], s.targetZ[i]);
+        glScalef(s.targetSize[i], s.targetSize[i], s.targetSize[i]);
+        targetLod.draw(level);
+        glPopMatrix();
     }
+
+    if(numPoints > 0)
+    {
+        glDisable(GL_LIGHTING);
+        glDisable(GL_TEXTURE_2D);
+
+        glBegin(GL_POINTS);
+
+        for(int i = 0; i < s.numTargets; ++i)
+        {
+            if(targetLodLevel[s.targetId[i]] == targetLod.getNumLevels())
+                glVertex3f(s.targetX[i], s.targetY[i], s.targetZ[i]);
+        }
+
+        glEnd();
+    }
+
+    glPopAttrib();
 }
 
-/**************************************************************************************
- **     Target Functions
- **
- **************************************************************************************/
+/////////////////////////////////////////////////////////////////////////////////////
+//       isOccluded - whether the terrain hides a box from the eye. The sight
+//                    lines to the corners of its top face are tested; a line to
+//                    any lower point of the box runs below one of them, so if
+//                    all four meet the ground the sides are hidden too. (Only
+//                    a ridge narrower than the box could show the middle of the
+//                    top face.)
+
+bool isOccluded(const VECTOR3D & centre, float halfSize)
+{
+    if(!occlusionCulling)
+        return false;
+
+    float top = centre.y + halfSize;
+
+    for(int corner = 0; corner < 4; ++corner)
+    {
+        VECTOR3D p(centre.x + ((corner & 1) ? halfSize : -halfSize), top,
+                   centre.z + ((corner & 2) ? halfSize : -halfSize));
+
+        if(!pyramid.isHidden(eyePosition, p))
+            return false;
+    }
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//       initLod - compiles the levels of detail of the bomb and the targets
+
+void initLod()
+{
+    GLuint list = glGenLists(3);
+
+    glNewList(list, GL_COMPILE);
+    glutSolidSphere(bomb_radius,8,8);
+    glEndList();
+    bombLod.addLevel(list, BOMB_LOD_FULL);
+
+    glNewList(list+1, GL_COMPILE);
+    glutSolidSphere(bomb_radius,5,4);
+    glEndList();
+    bombLod.addLevel(list+1, BOMB_LOD_COARSE);
+
+    glNewList(list+2, GL_COMPILE);
+    glutSolidCube(1.0);
+    glEndList();
+    targetLod.addLevel(list+2, TARGET_LOD_CUBE);
+
+    bombLodLevel.assign(MAX_BOMBS, 0);
+    targetLodLevel.assign(game.targets.getCapacity(), 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//       projectedSize - the height in pixels of an object size units across at p,
+//                       seen from the eye of the current frame
+
+float projectedSize(const VECTOR3D & p, float size)
+{
+    return size * lodScale / max((p - eyePosition).GetLength(), 0.001f);
+}
 
 /////////////////////////////////////////////////////////////////////////////////////
-//       moveTargets - animates the targets
+//       drawMarker - draws a cross lying on the ground at p, in the current colour
+
+void drawMarker(const VECTOR3D & p)
+{
+    glPushAttrib(GL_ENABLE_BIT | GL_LINE_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glLineWidth(2.0f);
+
+    glBegin(GL_LINES);
+      glVertex3f(p.x - MARKER_SIZE, p.y + 0.05f, p.z);
+      glVertex3f(p.x + MARKER_SIZE, p.y + 0.05f, p.z);
+      glVertex3f(p.x, p.y + 0.05f, p.z - MARKER_SIZE);
+      glVertex3f(p.x, p.y + 0.05f, p.z + MARKER_SIZE);
+    glEnd();
+
+    glPopAttrib();
+}
 
-void moveTargets(int)
+/////////////////////////////////////////////////////////////////////////////////////
+//       redrawTimer - takes the newest finished tick and redraws the scene
+//                     when something visible changed: the simulation
+//                     published a different scene, or the view changed. A
+//                     tick that applied key presses is always drawn, so
+//                     their latency ends at a frame. While the frame time
+//                     graph is shown every check draws, so the graph keeps
+//                     measuring. display() draws the snapshot taken here.
+
+void redrawTimer(int)
 {
-    for(int i = 0; i < NUM_TARGETS; ++i)
+    glutTimerFunc(frameMs, redrawTimer, 0);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    bool fresh;
+    lastSnapshot = &snapshots.acquire(&fresh);
+
+    double stallUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    stallTotalUs += stallUs;
+    stallMaxUs = max(stallMaxUs, stallUs);
+    snapshotChecks++;
+
+    snapshotFresh = snapshotFresh || fresh;
+
+    if(viewDirty || lastSnapshot->sceneHash != drawnScene || showHud || latency.isWaiting(lastSnapshot->tick))
+        glutPostRedisplay();
+    else
+        framesSkipped++;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//       printFrameStats - prints how long the render thread waited for game state
+
+void printFrameStats()
+{
+    long long ticks = simTicks.load();
+
+    cout << "Frames: " << framesDrawn << ", " << framesRepeated << " without a new tick, "
+         << framesSkipped << " skipped (nothing changed)\n";
+    cout << "Stall per snapshot: " << (snapshotChecks > 0 ? stallTotalUs / snapshotChecks : 0.0)
+         << " us average, " << stallMaxUs << " us max\n";
+    cout << "Simulation: " << ticks << " ticks, "
+         << (ticks > 0 ? (double) simTotalUs.load() / ticks : 0.0) << " us per tick (off the render thread)\n";
+    cout << "Targets in the last frame: " << targetsDrawn << " drawn, " << targetsCulled
+         << " hidden by the terrain" << (occlusionCulling ? "" : " (culling off)") << "\n";
+    cout << "Heap allocations: " << frameAllocations << " while drawing (" << framesAllocating << " frames), "
+         << simAllocations.load() << " in ticks (" << ticksAllocating.load() << " ticks)\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//       drawHud - draws the frame times of the last HUD_FRAMES frames as a
+//                 graph in the corner of the screen (newest on the right).
+//                 The grey line marks 60 frames per second.
+
+void drawHud()
+{
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_POLYGON_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_DEPTH_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0.0, 1.0, 0.0, 1.0);
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    // The graph covers the bottom left corner
+    glTranslatef(0.02f, 0.02f, 0.0f);
+    glScalef(0.4f, 0.2f, 1.0f);
+
+    glColor3f(0.0, 0.0, 0.0);
+    glBegin(GL_QUADS);
+      glVertex2f(0.0, 0.0);
+      glVertex2f(1.0, 0.0);
+      glVertex2f(1.0, 1.0);
+      glVertex2f(0.0, 1.0);
+    glEnd();
+
+    glColor3f(0.5, 0.5, 0.5);
+    glBegin(GL_LINES);
+      glVertex2f(0.0, 16.7f / HUD_SCALE_MS);
+      glVertex2f(1.0, 16.7f / HUD_SCALE_MS);
+    glEnd();
+
+    glColor3f(0.2, 1.0, 0.2);
+    glBegin(GL_LINE_STRIP);
+
+    for(int i = 0; i < HUD_FRAMES; ++i)
     {
-        Target *t = &targets[i];
-        
-        if(!t->hit && !viewTargets)
-        {
-            // If currently moving
-            if(t->moving)
-            {
-                // Moving Up
-                if(t->delta > 0.0 && t->position.y < (t->meshHeight + t->maxHeight))
-                {
-                    t->position.y += t->delta;
-                }
-                // Max Height Reached
-                else if(t->delta > 0.0)
-                {
-                    t->delta *= -1.0;
-                }
-                // Moving Down
-                else if(t->position.y > (t->meshHeight-(t->size*2)))
-                {
-                    t->position.y += t->delta;
-                }
-                // Done moving
-                else
-                {
-                    t->moving = false;
-                    t->ticksBeforeMoving = rand() % 400 +1;
-                }
-            }
-            // if currently waiting to move
-            else
-            {
-                t->ticksBeforeMoving--;
-
-                if(t->ticksBeforeMoving == 0)
-                {
-                    t->moving = true;
-                    t->position.y = t->meshHeight - t->size;
-                    t->maxHeight = rand() % 10 +1.0;
-                    t->delta = 0.05f;
-                }
-            }
-        }
+        float ms = frameTimesMs[(frameTimeNext + i) % HUD_FRAMES];
+        glVertex2f(i / (float)(HUD_FRAMES-1), min(ms / HUD_SCALE_MS, 1.0f));
     }
 
-    glutTimerFunc(25, moveTargets, 0);
-    glutPostRedisplay();
+    glEnd();
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    glPopAttrib();
 }
 
+/**************************************************************************************
+ **     Simulation Functions
+ **
+ **************************************************************************************/
+
 /////////////////////////////////////////////////////////////////////////////////////
-//       findNearbyTargets - finds all the targets that might be hit by the falling bomb
+//       simulationLoop - the simulation thread: one tick every SIM_TICK_MS,
+//                        independent of the frame rate
 
-void findNearbyTargets()
+void simulationLoop()
 {
-    for(int i = 0; i < NUM_TARGETS; ++i)
+#if defined(ENABLE_PROFILER)
+    profilerSetThreadName("simulation");
+#endif
+
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+    while(simRunning)
     {
-        Target t = targets[i];
+        next += std::chrono::milliseconds(SIM_TICK_MS);
 
-        if(!t.hit)
-        {
-            // Compute distance vector between target and bomb
-            VECTOR3D v = t.position-bombPosition;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        long long allocationsBefore = heapAllocationsThisThread();
 
-            // Check if the target might be hit by bomb
-            if(abs(v.x) < 1.0f && abs(v.z) < 1.0f)
-            {
-                nearbyTargets.push_back(i);
-            }
-        }
+        simulationTick();
+
+        long long allocations = heapAllocationsThisThread() - allocationsBefore;
+        simAllocations += allocations;
+
+        if(allocations > 0)
+            ticksAllocating++;
+
+        simTotalUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        simTicks++;
+
+        std::this_thread::sleep_until(next);
     }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
-//       targetHit - checks for collisions between the bomb and nearby targets
+//       simulationTick - advances the game by one step with the input collected
+//                        since the previous tick, then publishes a snapshot
 
-void checkCollisions()
+void simulationTick()
 {
-    bool collision = false;
-
-    for(int i = 0; i < nearbyTargets.size(); ++i)
-    {
-        Target *t = &targets[ nearbyTargets[i] ];
-        VECTOR3D v = (*t).position-bombPosition;
+    PROFILE_ZONE("simulationTick");
 
-        bool isAboveGround = ( (t->position.y) > (t->meshHeight-(t->size/2)) );
+    uint32_t expectedHash = 0;
 
-        // If target is above ground and the bomb is touching it, record collision
-        if(isAboveGround && abs(v.x) < 1.0f && abs(v.y) < 1.0f && abs(v.z) < 1.0f)
+    // A replay supplies the events instead of the keyboard
+    if(replay.isOpen())
+    {
+        if(!replay.readTick(pendingEvents, &expectedHash))
         {
-            t->hit = true;
-            t->moving = false;
-
-            collision = true;
-            targetsLeft -= 1;
-            cout << "Target Hit! " << targetsLeft << " left.\n";
+            cout << "Replay finished after " << game.tick << " ticks.\n";
+            replay.close();
+            replaying = false;
         }
     }
+    else
+    {
+        std::lock_guard<std::mutex> guard(inputLock);
+        pendingEvents.swap(queuedEvents);
+        pendingStamps.swap(queuedStamps);
+    }
+
+    LatencyStamp tickStart = std::chrono::steady_clock::now();
+
+    SimInput input;
+    clearInput(&input);
+
+    for(size_t i = 0; i < pendingEvents.size(); ++i)
+        applyInputEvent(&input, pendingEvents[i]);
 
-    // Clear the nearby targets array if collision was detected
-    if(collision)
+    game.step(input);
+
+    if(recorder.isOpen())
+        recorder.recordTick(pendingEvents, game.stateHash());
+
+    if(replay.isOpen() && game.stateHash() != expectedHash)
     {
-        nearbyTargets.clear();
-        bombPosition.y = 0.0f;     
+        cout << "Replay diverged at tick " << game.tick-1 << "!\n";
+        replay.close();
+        replaying = false;
     }
 
+    pendingEvents.clear();
+
+    for(int k = game.hitsThisTick-1; k >= 0; --k)
+        cout << "Target Hit! " << game.targetsLeft + k << " left.\n";
+
     // Check if there are targets left
-    if(targetsLeft == 0)
-    {
+    if(game.hitsThisTick > 0 && game.targetsLeft == 0)
         cout << "All the targets are down! You win!\n";
+
+    // Hand the finished tick to the render thread
+    snapshots.getBack().capture(game);
+
+    latency.recordTick(game.tick, pendingStamps.empty() ? NULL : &pendingStamps[0], (int) pendingStamps.size(), tickStart);
+    pendingStamps.clear();
+
+    snapshots.publish();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//       stopSimulation - stops and joins the simulation thread
+
+void stopSimulation()
+{
+    if(simRunning)
+    {
+        simRunning = false;
+        simThread.join();
     }
+
+    recorder.close();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//       quitGame - runs once on the way out (Esc, closing the window, or any
+//                  other exit): stops the simulation, finishes the recording
+//                  and prints the latency report
+
+void quitGame()
+{
+    static bool done = false;
+
+    if(done)
+        return;
+
+    done = true;
+
+    stopSimulation();
+    latency.print(stdout);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//       queueEvent - hands a game key press to the next simulation tick, stamped
+//                    for the latency report. Live game keys are ignored
+//                    while a replay is running.
+
+void queueEvent(unsigned char kind, int code)
+{
+    LatencyStamp pressed = std::chrono::steady_clock::now();
+
+    if(replaying)
+        return;
+
+    InputEvent e = { kind, (unsigned char) code };
+
+    std::lock_guard<std::mutex> guard(inputLock);
+    queuedEvents.push_back(e);
+    queuedStamps.push_back(pressed);
 }
 
 
@@ -410,9 +975,48 @@ void checkCollisions()
  **************************************************************************************/
 
 
+////////////////////////////////////////////////////////////////////////////////////////
+//   mouse callback function: a left click picks the terrain point under the cursor
+
+void mouseButtonHandler(int button, int state, int x, int y)
+{
+    if(button != GLUT_LEFT_BUTTON || state != GLUT_DOWN)
+        return;
+
+    // The click on the near and the far plane of the last frame's view
+    GLdouble nearX, nearY, nearZ, farX, farY, farZ;
+    GLdouble winY = viewport[3] - y;
+
+    gluUnProject(x, winY, 0.0, viewModel, viewProjection, viewport, &nearX, &nearY, &nearZ);
+    gluUnProject(x, winY, 1.0, viewModel, viewProjection, viewport, &farX, &farY, &farZ);
+
+    VECTOR3D origin((float) nearX, (float) nearY, (float) nearZ);
+    VECTOR3D direction((float)(farX - nearX), (float)(farY - nearY), (float)(farZ - nearZ));
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    RayHit hit;
+    picked = pyramid.castRay(origin, direction, &hit);
+
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    if(picked)
+    {
+        pickedPoint = hit.point;
+        cout << "Picked cell (" << hit.row << ", " << hit.col << ") at (" << hit.point.x << ", "
+             << hit.point.y << ", " << hit.point.z << ") in " << us << " us\n";
+    }
+    else
+        cout << "Missed the terrain\n";
+
+    viewDirty = true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////
 //   keyboard callback function: this function is called by OpenGL when the user 
-//                               presses a key on the keyboard
+//                               presses a key on the keyboard. Game keys reach the
+//                               screen through the next snapshot; only view keys
+//                               ask for a new frame.
 
 void keyboardHandler(unsigned char key, int a, int b)
 {
@@ -420,18 +1024,12 @@ void keyboardHandler(unsigned char key, int a, int b)
     {
         // Quit Program: 'Esc'
         case 27:  
-            exit(0);
+            exit(0); // quitGame() runs on the way out
             break;
 
         // Drop Bomb
         case ' ':
-            if(!activeBomb)
-            {
-                activeBomb = true;
-                bombPosition = balloon.position;
-                bombPosition.y = balloon.getBaseHeight();
-                findNearbyTargets();
-            }
+            queueEvent(INPUT_KEY, key);
             break;
 
         // Camera Move Up 
@@ -439,6 +1037,7 @@ void keyboardHandler(unsigned char key, int a, int b)
         case 'W':
             if(cameraInclination > 5)
                 cameraInclination = (cameraInclination - 5);
+            viewDirty = true;
             break;
 
         // Camera Move Down
@@ -446,40 +1045,93 @@ void keyboardHandler(unsigned char key, int a, int b)
         case 'S':
             if(cameraInclination < 175)
                 cameraInclination = (cameraInclination + 5);
+            viewDirty = true;
             break;
 
         // Camera Move Clockwise
         case 'a':
         case 'A':
             cameraAzimuth = (cameraAzimuth + 5) %360;
+            viewDirty = true;
             break;
 
         // Camera Move Anti-Clockwise
         case 'd':
         case 'D':
             cameraAzimuth = (cameraAzimuth - 5) %360;
+            viewDirty = true;
             break;
 
         // Camera Zoom Out
         case 'q':
         case 'Q':
             cameraRadius += 0.5f;
+            viewDirty = true;
             break;
 
         // Camera Zoom In
         case 'e':
         case 'E':
             cameraRadius -= 0.5f;
+            viewDirty = true;
             break;
 
         // Print the properties of all existing blobs
         case 'b':
         case 'B':
-            mesh.printBlobs();
+            terrain.printBlobs();
+            break;
+
+        // Print how many targets are moving and how many are parked
+        case 't':
+        case 'T':
+            cout << "Targets: " << lastSnapshot->activeTargets << " active, "
+                 << lastSnapshot->parkedTargets << " parked\n";
+            break;
+
+        // Print the frame and stall times
+        case 'f':
+        case 'F':
+            printFrameStats();
+            break;
+
+        // Print the memory held by each subsystem
+        case 'm':
+        case 'M':
+            printMemoryReport(stdout);
+            break;
+
+        // Toggle occlusion culling of targets and the bomb
+        case 'o':
+        case 'O':
+            occlusionCulling = !occlusionCulling;
+            viewDirty = true;
+            break;
+
+        // Print the input latency histogram
+        case 'l':
+        case 'L':
+            latency.print(stdout);
             break;
-    }
 
-    glutPostRedisplay();
+#if defined(ENABLE_PROFILER)
+        // Write the recorded zones as a Chrome trace
+        case 'p':
+        case 'P':
+            if(profilerExport("profile.json"))
+                cout << "Profile written to profile.json\n";
+            else
+                cout << "Cannot write profile.json\n";
+            break;
+
+        // Toggle the frame time graph
+        case 'h':
+        case 'H':
+            showHud = !showHud;
+            viewDirty = true;
+            break;
+#endif
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -490,41 +1142,39 @@ void specialKeyHandler(int key, int x, int y)
 {
     switch(key)
     {
-        // Move balloon in the negative z direction
+        // Move balloon (x and z directions)
         case GLUT_KEY_UP:
-            balloon.position.z -= 0.125f;
-            break;
-
-        // Move balloon in the positive z direction
         case GLUT_KEY_DOWN:
-            balloon.position.z += 0.125f;
-            break;
-
-        // Move balloon in the negative x direction
         case GLUT_KEY_LEFT:
-            balloon.position.x -= 0.125f;
-            break;
-
-        // Move balloon in the positive x direction
         case GLUT_KEY_RIGHT:
-            balloon.position.x += 0.125f;
+            queueEvent(INPUT_SPECIAL, key);
             break;
 
         // Toggle camera mode
         case GLUT_KEY_F1:
             balloonCamera = !balloonCamera;
+            viewDirty = true;
             break;
 
         // Toggle rendering mode
         case GLUT_KEY_F5:
             wireframe = !wireframe;
+            viewDirty = true;
+            break;
+
+        // Toggle baked terrain lighting (with --bake)
+        case GLUT_KEY_F7:
+            if(terrainLighting.isBaked())
+            {
+                useBakedLighting = !useBakedLighting;
+                mesh.setLighting(useBakedLighting ? &terrainLighting : NULL);
+                viewDirty = true;
+            }
             break;
 
         // Toggle view targets mode
         case GLUT_KEY_F6:
-            viewTargets = !viewTargets;
+            queueEvent(INPUT_SPECIAL, key);
             break;
 	}
-
-    glutPostRedisplay();
 }
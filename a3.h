@@ -19,18 +19,4 @@
 
 using namespace std;
 
-typedef struct Target
-{
-    VECTOR3D position;
-    float meshHeight;
-
-    bool hit;
-    bool moving;
-
-    int ticksBeforeMoving;
-    float maxHeight;
-    float size;
-    float delta;
-} Target;
-
 #endif
\ No newline at end of file
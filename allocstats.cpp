@@ -0,0 +1,79 @@
+#include "allocstats.h"
+#include "memtrack.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<long long> totalAllocations(0);
+static thread_local long long threadAllocations = 0;
+
+
+static void countAllocation()
+{
+    totalAllocations.fetch_add(1, std::memory_order_relaxed);
+    threadAllocations++;
+}
+
+// trackedAlloc mallocs its blocks itself; count them from before main()
+static struct TrackedAllocationCounter {
+    TrackedAllocationCounter() { setAllocationHook(countAllocation); }
+} trackedAllocationCounter;
+
+///////////////////////////////////////////////////////////////////////////////
+//  countedAlloc - malloc, counted. Zero-byte requests still get a unique
+//                 pointer, as operator new requires.
+
+static void *countedAlloc(size_t size)
+{
+    countAllocation();
+    return malloc(size ? size : 1);
+}
+
+long long heapAllocations()
+{
+    return totalAllocations.load(std::memory_order_relaxed);
+}
+
+long long heapAllocationsThisThread()
+{
+    return threadAllocations;
+}
+
+
+/**************************************************************************************
+ **     Global Allocation Operators
+ **
+ **************************************************************************************/
+
+void *operator new(size_t size)
+{
+    void *p = countedAlloc(size);
+
+    if(p == NULL)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void *p) noexcept                             { free(p); }
+void operator delete[](void *p) noexcept                           { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept     { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept   { free(p); }
+void operator delete(void *p, size_t) noexcept                     { free(p); }
+void operator delete[](void *p, size_t) noexcept                   { free(p); }
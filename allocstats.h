@@ -0,0 +1,14 @@
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+///////////////////////////////////////////////////////////////////////////////
+//  Heap allocation counters. allocstats.cpp replaces the global operator
+//  new and delete to count every allocation made through them, and hooks
+//  trackedAlloc (memtrack.h) to count the tracked blocks too; link it in
+//  to enable the counters (without it, these functions are missing).
+
+long long heapAllocations();           // all threads, since the start of the program
+long long heapAllocationsThisThread(); // the calling thread only
+
+
+#endif
@@ -0,0 +1,68 @@
+#include "arena.h"
+
+#include <stdlib.h>
+
+
+/**************************************************************************************
+ **     Public Frame Arena Functions
+ **
+ **************************************************************************************/
+
+FrameArena::FrameArena(size_t size, MemoryTag memoryTag) : current(0), offset(0), blockSize(size), tag(memoryTag), used(0), capacity(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    for(size_t i = 0; i < blocks.size(); ++i)
+        trackedFree(blocks[i].data);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  allocate - Bump the current block. When it is full, move on to the next
+//             kept block that is large enough, or add a new one.
+
+void *FrameArena::allocate(size_t bytes)
+{
+    bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if(current < blocks.size() && offset + bytes <= blocks[current].size)
+    {
+        void *p = blocks[current].data + offset;
+        offset += bytes;
+        used += bytes;
+        return p;
+    }
+
+    // Skip ahead to a kept block with room for the request
+    size_t next = blocks.empty() ? 0 : current + 1;
+
+    while(next < blocks.size() && blocks[next].size < bytes)
+        next++;
+
+    if(next == blocks.size())
+    {
+        Block b;
+        b.size = (bytes > blockSize) ? bytes : blockSize;
+        b.data = (char*) trackedAlloc(tag, b.size); // 16-byte aligned
+
+        blocks.push_back(b);
+        capacity += b.size;
+    }
+
+    current = next;
+    offset = bytes;
+    used += bytes;
+
+    return blocks[current].data;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  reset - Release everything at once. The blocks are kept for reuse.
+
+void FrameArena::reset()
+{
+    current = 0;
+    offset = 0;
+    used = 0;
+}
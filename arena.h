@@ -0,0 +1,60 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "memtrack.h"
+
+#define ARENA_BLOCK_SIZE (64*1024) // default size of an arena block
+#define ARENA_ALIGN 16             // alignment of every allocation
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  FrameArena - Bump allocator for data that only lives for one tick or one
+//               frame (candidate lists, per-chunk results, draw lists).
+//
+//      allocate() moves a pointer forward; reset() moves it back to the
+//      start and keeps every block. After the first few frames the blocks
+//      are big enough and no more heap memory is requested. Nothing is
+//      constructed or destroyed: use it for plain data only.
+
+class FrameArena
+{
+    public:
+
+        FrameArena(size_t blockSize = ARENA_BLOCK_SIZE, MemoryTag tag = MEMORY_TRANSIENT);
+        ~FrameArena();
+
+        void *allocate(size_t bytes); // ARENA_ALIGN aligned, valid until reset()
+        void reset();
+
+        template<typename T> T *allocArray(size_t n) { return (T*) allocate(n * sizeof(T)); }
+
+        size_t getUsed() const { return used; }          // bytes handed out since reset()
+        size_t getCapacity() const { return capacity; }  // bytes held in blocks
+
+    protected:
+
+        typedef struct Block {
+            char *data;
+            size_t size;
+        } Block;
+
+        std::vector<Block> blocks;
+        size_t current; // block being bumped
+        size_t offset;  // next free byte in the current block
+
+        size_t blockSize;
+        MemoryTag tag; // charged for the blocks
+        size_t used;
+        size_t capacity;
+
+    private:
+
+        FrameArena(const FrameArena &);            // not copyable
+        FrameArena & operator=(const FrameArena &);
+};
+
+
+#endif
@@ -1,4 +1,5 @@
 #include "balloon.h"
+#include "profiler.h"
 
 // Lighting Properties
 GLfloat balloon_ambient[]    = {0.53, 0.54, 0.53, 1.0};
@@ -10,12 +11,18 @@ GLfloat balloon_shininess[]  = {0.0};
 RGBpixmap balloon_pix[3];
 GLuint balloon_tex[3];
 
+// Levels of Detail (smallest projected size in pixels for each)
+#define BALLOON_LOD_FULL 150.0f
+#define BALLOON_LOD_MEDIUM 40.0f
+
 
 ///////////////////////////////////////////////////////////////////////////////
 //  initBalloon - Initialize the balloon.
 
 void Balloon::initBalloon(float terrainHeight)
 {
+    PROFILE_ZONE("Balloon::initBalloon");
+
     position = VECTOR3D(0.0f, terrainHeight+10.0, 0.0f);
 
     GLfloat planes[] = {0.0, 0.0, 0.3, 0.0};
@@ -42,7 +49,15 @@ void Balloon::initBalloon(float terrainHeight)
         glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_OBJECT_LINEAR);
         glTexGenfv(GL_T, GL_OBJECT_PLANE, planet);
         glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, balloon_pix[i].nCols, balloon_pix[i].nRows, 0, GL_RGB, GL_UNSIGNED_BYTE, balloon_pix[i].pixel);
+
+        // OpenGL keeps its own copy of the pixels
+        balloon_pix[i].freeIt();
     }
+
+    // Levels of detail: the full tessellation up close, then coarser
+    lod.addLevel(compileBalloon(20, 32, 10, true), BALLOON_LOD_FULL);
+    lod.addLevel(compileBalloon(12, 12, 2, true), BALLOON_LOD_MEDIUM);
+    lod.addLevel(compileBalloon(6, 6, 1, false), 0.0f);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -54,10 +69,12 @@ float Balloon::getBaseHeight()
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-//  drawBalloon - draws the balloon.
+//  drawBalloon - draws the balloon at the level of detail for its size.
 
-void Balloon::drawBalloon()
+void Balloon::drawBalloon(float pixels)
 {
+    PROFILE_ZONE("Balloon::drawBalloon");
+
     // Specify material parameters for the balloon
     glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, balloon_ambient);
     glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, balloon_specular);
@@ -67,25 +84,44 @@ void Balloon::drawBalloon()
     glEnable(GL_TEXTURE_GEN_S);
     glEnable(GL_TEXTURE_GEN_T);
 
+    // Set the color of the balloon
+    //glColor3f(0.125, 0.80, 0.125);
+    glColor3f(0.8, 0.8, 0.8);
+
+    lodLevel = min(lod.select(pixels, lodLevel), lod.getNumLevels()-1);
+
+    glPushMatrix();
+    glTranslatef(position.x, position.y, position.z);
+    lod.draw(lodLevel);
+    glPopMatrix();
+
+    glDisable(GL_TEXTURE_GEN_S);
+    glDisable(GL_TEXTURE_GEN_T);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  compileBalloon - records the balloon's geometry (around its position) in
+//                   a display list: the envelope sphere with sphereSlices,
+//                   the cylinders with slices and stacks.
+
+GLuint Balloon::compileBalloon(int sphereSlices, int slices, int stacks, bool ropes)
+{
     // Set up a Quadratic Object
     GLUquadricObj *qobj = gluNewQuadric();
     gluQuadricDrawStyle(qobj,GLU_FILL);
     gluQuadricTexture(qobj, GL_TRUE);
     gluQuadricNormals(qobj,GLU_SMOOTH);
 
-    // Set the color of the balloon
-    //glColor3f(0.125, 0.80, 0.125);
-    glColor3f(0.8, 0.8, 0.8);
+    GLuint list = glGenLists(1);
+    glNewList(list, GL_COMPILE);
 
     // Draw the Balloon
     glBindTexture(GL_TEXTURE_2D, balloon_tex[0]);
 
-    glPushMatrix();
-    glTranslatef(position.x, position.y, position.z);
-    
     glPushMatrix();
     glScalef(0.9,1.0,0.9);
-    gluSphere(qobj, 3.0, 20, 20);
+    gluSphere(qobj, 3.0, sphereSlices, sphereSlices);
     glPopMatrix();
 
     glTranslatef(0.0,-4.0,0.0);
@@ -93,39 +129,42 @@ void Balloon::drawBalloon()
     // Draw bottom part of the Balloon
     glPushMatrix();
     glRotatef(-90.0,1.0,0.0,0.0);
-    gluCylinder(qobj,0.5,1.99,2.0,32,10);
-    glPopMatrix();
-
-    // Draw the Ropes
-    glBindTexture(GL_TEXTURE_2D, balloon_tex[1]);
-
-    glPushMatrix();
-    glTranslatef(0.35,0.0,0.35);
-    glRotatef(80.0,1.0,0.0,0.0);
-    glRotatef(10.0,0.0,1.0,0.0);
-    gluCylinder(qobj,0.05,0.05,1.3,32,10);
-    glPopMatrix();
-
-    glPushMatrix();
-    glTranslatef(-0.35,0.0,0.35);
-    glRotatef(80.0,1.0,0.0,0.0);
-    glRotatef(-10.0,0.0,1.0,0.0);
-    gluCylinder(qobj,0.05,0.05,1.3,32,10);
+    gluCylinder(qobj,0.5,1.99,2.0,slices,stacks);
     glPopMatrix();
 
-    glPushMatrix();
-    glTranslatef(-0.35,0.0,-0.35);
-    glRotatef(100.0,1.0,0.0,0.0);
-    glRotatef(-10.0,0.0,1.0,0.0);
-    gluCylinder(qobj,0.05,0.05,1.3,32,10);
-    glPopMatrix();
-
-    glPushMatrix();
-    glTranslatef(0.35,0.0,-0.35);
-    glRotatef(100.0,1.0,0.0,0.0);
-    glRotatef(10.0,0.0,1.0,0.0);
-    gluCylinder(qobj,0.05,0.05,1.3,32,10);
-    glPopMatrix();
+    // Draw the Ropes (too thin to see on a distant balloon)
+    if(ropes)
+    {
+        glBindTexture(GL_TEXTURE_2D, balloon_tex[1]);
+
+        glPushMatrix();
+        glTranslatef(0.35,0.0,0.35);
+        glRotatef(80.0,1.0,0.0,0.0);
+        glRotatef(10.0,0.0,1.0,0.0);
+        gluCylinder(qobj,0.05,0.05,1.3,slices,stacks);
+        glPopMatrix();
+
+        glPushMatrix();
+        glTranslatef(-0.35,0.0,0.35);
+        glRotatef(80.0,1.0,0.0,0.0);
+        glRotatef(-10.0,0.0,1.0,0.0);
+        gluCylinder(qobj,0.05,0.05,1.3,slices,stacks);
+        glPopMatrix();
+
+        glPushMatrix();
+        glTranslatef(-0.35,0.0,-0.35);
+        glRotatef(100.0,1.0,0.0,0.0);
+        glRotatef(-10.0,0.0,1.0,0.0);
+        gluCylinder(qobj,0.05,0.05,1.3,slices,stacks);
+        glPopMatrix();
+
+        glPushMatrix();
+        glTranslatef(0.35,0.0,-0.35);
+        glRotatef(100.0,1.0,0.0,0.0);
+        glRotatef(10.0,0.0,1.0,0.0);
+        gluCylinder(qobj,0.05,0.05,1.3,slices,stacks);
+        glPopMatrix();
+    }
 
     glTranslatef(0.0,-2.25,0.0);
 
@@ -133,13 +172,12 @@ void Balloon::drawBalloon()
     glBindTexture(GL_TEXTURE_2D, balloon_tex[2]);
     glPushMatrix();
     glRotatef(-90.0,1.0,0.0,0.0);
-    gluCylinder(qobj,0.6,0.85,1.0,32,10);
-    gluDisk(qobj, 0.0, 0.6, 32, 1);
+    gluCylinder(qobj,0.6,0.85,1.0,slices,stacks);
+    gluDisk(qobj, 0.0, 0.6, slices, 1);
     glPopMatrix();
 
-    glPopMatrix();
+    glEndList();
+    gluDeleteQuadric(qobj);
 
-    glDisable(GL_TEXTURE_GEN_S);
-    glDisable(GL_TEXTURE_GEN_T);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    return list;
 }
@@ -2,6 +2,9 @@
 #define BALLOON_H
 
 #include "a3.h"
+#include "lod.h"
+
+#define BALLOON_SIZE 10.0f // height from the basket to the top, for the projected size
 
 
 class Balloon
@@ -11,11 +14,18 @@ class Balloon
         VECTOR3D position;
         float baseHeight;
 
-        Balloon() { }
+        Balloon() : lodLevel(0) { }
 
         void initBalloon(float);
-        void drawBalloon();
+        void drawBalloon(float pixels); // pixels: projected size, to pick the level of detail
         float getBaseHeight();
+
+    protected:
+
+        LodChain lod;
+        int lodLevel; // level drawn last frame
+
+        GLuint compileBalloon(int sphereSlices, int slices, int stacks, bool ropes);
 };
 
 #endif
\ No newline at end of file
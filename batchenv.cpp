@@ -0,0 +1,249 @@
+#include "batchenv.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  defaultBatchConfig - 64 instances of the standard game, every thread.
+
+void defaultBatchConfig(BatchConfig *config)
+{
+    config->numInstances = 64;
+    config->numTargets = 10;
+    config->seed = 1;
+    config->maxTicks = 12000; // five minutes of game time
+    config->maxBombs = 1;
+    config->respawnTargets = false;
+    config->craters = false;
+    config->shareTerrain = false;
+    config->numThreads = 0;
+}
+
+
+/**************************************************************************************
+ **     Public Batch Environment Functions
+ **
+ **************************************************************************************/
+
+BatchEnv::BatchEnv() : numInstances(0), terrains(NULL), games(NULL), jobActions(NULL), episodes(0),
+                       episodeSeed(NULL), rewards(NULL), done(NULL), observations(NULL)
+{
+    defaultBatchConfig(&config);
+}
+
+BatchEnv::~BatchEnv()
+{
+    destroy();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  create - Generate the terrains (serially, from fixed seeds), start the
+//           job system and begin the first episode of every instance.
+
+void BatchEnv::create(const BatchConfig & c)
+{
+    PROFILE_ZONE("BatchEnv::create");
+
+    destroy();
+
+    config = c;
+    numInstances = max(c.numInstances, 1);
+
+    int numTerrains = c.shareTerrain ? 1 : numInstances;
+    terrains = trackedNewArray<Terrain>(MEMORY_TERRAIN, numTerrains);
+
+    for(int t = 0; t < numTerrains; ++t)
+    {
+        terrains[t].setSeed(c.seed + t);
+        terrains[t].initTerrain(MESH_RESOLUTION, MESH_RESOLUTION);
+    }
+
+    games = trackedNewArray<Game>(MEMORY_ENTITIES, numInstances);
+
+    episodeSeed  = (unsigned int*)  trackedCalloc(MEMORY_ENTITIES, numInstances, sizeof(unsigned int));
+    rewards      = (float*)         trackedCalloc(MEMORY_ENTITIES, numInstances, sizeof(float));
+    done         = (unsigned char*) trackedCalloc(MEMORY_ENTITIES, numInstances, 1);
+    observations = (float*)         trackedCalloc(MEMORY_ENTITIES, (size_t) numInstances * BATCH_OBS_SIZE, sizeof(float));
+
+    jobs.start(c.numThreads);
+
+    for(int i = 0; i < numInstances; ++i)
+    {
+        episodeSeed[i] = c.seed + i;
+        resetInstance(i);
+        observe(i);
+    }
+
+    episodes = 0;
+}
+
+void BatchEnv::destroy()
+{
+    if(games == NULL)
+        return;
+
+    jobs.stop();
+
+    trackedDeleteArray(games);
+    trackedDeleteArray(terrains);
+    trackedFree(episodeSeed);
+    trackedFree(rewards);
+    trackedFree(done);
+    trackedFree(observations);
+
+    games = NULL;
+    terrains = NULL;
+    episodeSeed = NULL;
+    rewards = NULL;
+    done = NULL;
+    observations = NULL;
+    numInstances = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  step - Advance every instance by one tick with its action.
+
+void BatchEnv::step(const int *actions)
+{
+    PROFILE_ZONE("BatchEnv::step");
+
+    jobActions = actions;
+
+    if(jobs.getNumThreads() > 1)
+        jobs.parallelFor(numInstances, jobs.chunkSizeFor(numInstances, BATCH_CHUNK_MIN, 1), stepJob, this);
+    else
+        stepJob(this, 0, numInstances);
+
+    for(int i = 0; i < numInstances; ++i)
+        episodes += done[i];
+}
+
+
+/**************************************************************************************
+ **     Private Batch Environment Functions
+ **
+ **************************************************************************************/
+
+void BatchEnv::stepJob(void *data, int begin, int end)
+{
+    BatchEnv *env = (BatchEnv*) data;
+
+    for(int i = begin; i < end; ++i)
+        env->stepInstance(i);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  stepInstance - One tick of instance i; everything it touches belongs to
+//                 the instance, so instances can run on any thread.
+
+void BatchEnv::stepInstance(int i)
+{
+    Game & game = games[i];
+
+    SimInput input;
+    clearInput(&input);
+
+    switch(jobActions[i])
+    {
+        case BATCH_ACTION_LEFT:  input.moveX = -1; break;
+        case BATCH_ACTION_RIGHT: input.moveX = 1; break;
+        case BATCH_ACTION_UP:    input.moveZ = -1; break;
+        case BATCH_ACTION_DOWN:  input.moveZ = 1; break;
+        case BATCH_ACTION_DROP:  input.dropBomb = true; break;
+    }
+
+    game.step(input);
+
+    rewards[i] = (float) game.hitsThisTick;
+    done[i] = game.targetsLeft == 0 || (config.maxTicks > 0 && game.tick >= config.maxTicks);
+
+    if(done[i])
+    {
+        episodeSeed[i] += numInstances;
+        resetInstance(i);
+    }
+
+    observe(i);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  resetInstance - Start a new episode of instance i from its seed.
+
+void BatchEnv::resetInstance(int i)
+{
+    Terrain *terrain = &terrains[config.shareTerrain ? 0 : i];
+
+    games[i].setRules(config.maxBombs, config.respawnTargets, config.craters);
+    games[i].initGame(terrain, config.numTargets, episodeSeed[i]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  observe - Write the observation row of instance i (see BATCH_OBS_SIZE).
+//            The nearest moving targets are kept sorted by insertion; the
+//            active set is visited in order, so ties always go the same way.
+
+void BatchEnv::observe(int i)
+{
+    const Game & game = games[i];
+    const TargetPool & targets = game.targets;
+    float *o = observations + (size_t) i * BATCH_OBS_SIZE;
+
+    float bx = game.balloonPosition.x;
+    float bz = game.balloonPosition.z;
+
+    o[0] = bx;
+    o[1] = game.getBalloonBaseHeight();
+    o[2] = bz;
+    o[3] = game.ground.getHeightAt(bx, bz);
+    o[4] = (float) game.bombs.size();
+    o[5] = (float) game.targetsLeft;
+
+    float nearestDist[BATCH_OBS_TARGETS];
+    int nearest[BATCH_OBS_TARGETS];
+    int numNearest = 0;
+
+    for(int k = 0; k < targets.getActiveCount(); ++k)
+    {
+        int t = targets.findId(targets.activeId[k]);
+        float dx = targets.x[t] - bx;
+        float dz = targets.z[t] - bz;
+        float d = dx*dx + dz*dz;
+
+        if(numNearest == BATCH_OBS_TARGETS && d >= nearestDist[numNearest-1])
+            continue;
+
+        int j = min(numNearest, BATCH_OBS_TARGETS-1);
+
+        for(; j > 0 && nearestDist[j-1] > d; --j)
+        {
+            nearestDist[j] = nearestDist[j-1];
+            nearest[j] = nearest[j-1];
+        }
+
+        nearestDist[j] = d;
+        nearest[j] = t;
+        numNearest = min(numNearest+1, BATCH_OBS_TARGETS);
+    }
+
+    float *row = o + 6;
+
+    for(int k = 0; k < BATCH_OBS_TARGETS; ++k, row += 4)
+    {
+        if(k < numNearest)
+        {
+            int t = nearest[k];
+
+            row[0] = 1.0f;
+            row[1] = targets.x[t] - bx;
+            row[2] = targets.z[t] - bz;
+            row[3] = targets.getY(t);
+        }
+        else
+        {
+            row[0] = row[1] = row[2] = row[3] = 0.0f;
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef BATCHENV_H
+#define BATCHENV_H
+
+#include <stdint.h>
+
+#include "game.h"
+#include "terrain.h"
+#include "jobs.h"
+#include "memtrack.h"
+
+// Actions, one per instance and step
+#define BATCH_ACTION_NONE  0
+#define BATCH_ACTION_LEFT  1
+#define BATCH_ACTION_RIGHT 2
+#define BATCH_ACTION_UP    3
+#define BATCH_ACTION_DOWN  4
+#define BATCH_ACTION_DROP  5
+#define BATCH_ACTIONS      6
+
+// Observation of one instance, in floats:
+//      balloon x, base height, z, ground height below the balloon,
+//      bombs in the air, targets left,
+//      then for each of the BATCH_OBS_TARGETS moving targets nearest to the
+//      balloon (in x and z): present (1 or 0), x and z relative to the
+//      balloon, height
+#define BATCH_OBS_TARGETS 4
+#define BATCH_OBS_SIZE (6 + 4*BATCH_OBS_TARGETS)
+
+#define BATCH_CHUNK_MIN 4 // fewest instances stepped by one job
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  BatchConfig - How to build the instances of a BatchEnv.
+
+typedef struct BatchConfig {
+    int numInstances;
+    int numTargets;        // per instance
+    unsigned int seed;     // instance i starts from seed + i
+    unsigned int maxTicks; // an episode ends after this many steps (0 = only when every target is hit)
+    int maxBombs;          // see Game::setRules
+    bool respawnTargets;
+    bool craters;
+    bool shareTerrain;     // one terrain (from seed) for every instance; each game keeps its craters
+    int numThreads;        // job system threads (0 = one per hardware thread)
+} BatchConfig;
+
+void defaultBatchConfig(BatchConfig *config);
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  BatchEnv - Many independent games in one process, for automated agents.
+//
+//      step() applies one action per instance and advances every instance
+//      by one tick; the instances are split into chunks on a job system,
+//      each stepped on one thread. The results come back in contiguous
+//      buffers: one column per value with an entry per instance (reward,
+//      done) and the observations packed as numInstances rows of
+//      BATCH_OBS_SIZE floats. Each game keeps its targets in its own
+//      TargetPool.
+//
+//      An instance whose episode ends is reset before the step returns
+//      (with the next seed of its own sequence); its done flag is set for
+//      that step and its observation is the first of the new episode. The
+//      results depend only on the seed and the actions, not on the number
+//      of threads. step() must be called from the thread that called
+//      create(), which is worker 0 of the job system.
+
+class BatchEnv
+{
+    public:
+
+        BatchEnv();
+        ~BatchEnv();
+
+        void create(const BatchConfig & config); // build the terrains and start every episode
+        void destroy();
+
+        void step(const int *actions); // numInstances actions (BATCH_ACTION_*)
+
+        int getNumInstances() const { return numInstances; }
+
+        // Results of the last step (or of create), one entry per instance
+        const float *getObservations() const { return observations; } // numInstances * BATCH_OBS_SIZE
+        const float *getRewards() const { return rewards; }           // targets hit in the step
+        const unsigned char *getDone() const { return done; }         // the episode ended in the step
+
+        const Game & getGame(int i) const { return games[i]; }
+        long long getEpisodes() const { return episodes; } // episodes finished since create
+
+    protected:
+
+        BatchConfig config;
+        int numInstances;
+
+        Terrain *terrains; // one per instance, or one shared
+        Game *games;
+        JobSystem jobs;
+
+        const int *jobActions; // the actions of the step being run
+        long long episodes;
+
+        // Per-instance columns
+        unsigned int *episodeSeed; // seed of the current episode
+        float *rewards;
+        unsigned char *done;
+        float *observations;       // BATCH_OBS_SIZE per instance
+
+        static void stepJob(void *data, int begin, int end);
+        void stepInstance(int i);
+        void resetInstance(int i);
+        void observe(int i);
+
+    private:
+
+        BatchEnv(const BatchEnv &);            // not copyable
+        BatchEnv & operator=(const BatchEnv &);
+};
+
+
+#endif
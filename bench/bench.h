@@ -0,0 +1,88 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+// Number of timed repetitions per benchmark (the median is reported)
+#define BENCH_REPETITIONS 15
+
+
+// Summary of the timed repetitions of one benchmark, in nanoseconds per call
+typedef struct BenchStats {
+    double median;
+    double mad;    // median absolute deviation from the median
+    double min;
+    int repetitions;
+} BenchStats;
+
+///////////////////////////////////////////////////////////////////////////////
+//  benchMedian - the middle value of samples (sorted in place).
+
+inline double benchMedian(std::vector<double> & samples)
+{
+    std::sort(samples.begin(), samples.end());
+
+    size_t n = samples.size();
+    return (n % 2) ? samples[n/2] : (samples[n/2 - 1] + samples[n/2]) / 2.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  benchMeasure - runs f() once to warm up, then times it repetitions times.
+//                 The median and the MAD are not thrown off by the odd slow
+//                 run the way the mean and the standard deviation are.
+
+template <class F>
+BenchStats benchMeasure(F f, int repetitions)
+{
+    std::vector<double> samples;
+
+    f(); // warm up caches and page in memory
+
+    for(int i = 0; i < repetitions; ++i)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+
+    BenchStats stats;
+    stats.repetitions = repetitions;
+    stats.median = benchMedian(samples);
+    stats.min = samples[0];
+
+    for(size_t i = 0; i < samples.size(); ++i)
+        samples[i] = fabs(samples[i] - stats.median);
+
+    stats.mad = benchMedian(samples);
+
+    return stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  benchMedianNs - runs f() BENCH_REPETITIONS times and returns the median
+//                  wall time of one call in nanoseconds.
+
+template <class F>
+double benchMedianNs(F f)
+{
+    return benchMeasure(f, BENCH_REPETITIONS).median;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  benchReport - prints one result line: total time and time per item.
+
+inline void benchReport(const char *name, double ns, long items)
+{
+    printf("%-32s %12.1f us %10.3f ns/item\n", name, ns / 1000.0, ns / items);
+}
+
+// Keeps the optimizer from discarding a computed value
+static volatile float benchSink;
+
+#endif
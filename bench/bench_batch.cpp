@@ -0,0 +1,82 @@
+//  bench_batch - steps per second of the batch environment: many game
+//                instances in one process, stepped with random actions on
+//                one thread and on every thread. The memory per instance
+//                is measured after the run, with the craters of the last
+//                case in it.
+//
+//  Build (from the repository root):
+//      g++ -O2 -mavx bench/bench_batch.cpp batchenv.cpp game.cpp overlay.cpp savestate.cpp terrain.cpp generator.cpp targets.cpp timerwheel.cpp vecbatch.cpp jobs.cpp arena.cpp memtrack.cpp heightfield.cpp -pthread -o bench_batch
+
+#include <thread>
+
+#include "bench.h"
+#include "../batchenv.h"
+#include "../rng.h"
+
+#define BENCH_SEED 511
+#define BENCH_STEPS 100 // steps per sample
+
+///////////////////////////////////////////////////////////////////////////////
+//  benchBatch - time BENCH_STEPS steps of n instances; a new action column
+//               is drawn before every step, as an agent would.
+
+static void benchBatch(int n, int threads, bool shareTerrain, bool craters)
+{
+    size_t terrainBefore = memoryCurrent(MEMORY_TERRAIN);
+    size_t entitiesBefore = memoryCurrent(MEMORY_ENTITIES);
+
+    BatchConfig config;
+    defaultBatchConfig(&config);
+    config.numInstances = n;
+    config.numTargets = 100;
+    config.seed = BENCH_SEED;
+    config.shareTerrain = shareTerrain;
+    config.craters = craters;
+    config.numThreads = threads;
+
+    BatchEnv env;
+    env.create(config);
+
+    Rng rng(BENCH_SEED, RNG_STREAM_INPUT);
+    std::vector<int> actions(n);
+
+    double ns = benchMedianNs([&]() {
+        for(int s = 0; s < BENCH_STEPS; ++s)
+        {
+            for(int i = 0; i < n; ++i)
+                actions[i] = rng.nextInt(BATCH_ACTIONS);
+
+            env.step(&actions[0]);
+        }
+
+        benchSink = env.getObservations()[0];
+    });
+
+    size_t bytes = (memoryCurrent(MEMORY_TERRAIN) - terrainBefore) + (memoryCurrent(MEMORY_ENTITIES) - entitiesBefore);
+
+    long steps = (long) n * BENCH_STEPS;
+    char name[64];
+    snprintf(name, sizeof(name), "batch/%d/%s%s%s", n, (threads == 1) ? "1-thread" : "all-threads",
+             shareTerrain ? "/shared" : "", craters ? "/craters" : "");
+
+    benchReport(name, ns, steps);
+    printf("%32s %12.0f steps/s %8.1f KB/instance\n", "", steps / (ns * 1e-9), bytes / 1024.0 / n);
+}
+
+int main()
+{
+    const int sizes[] = {1, 16, 256, 1024};
+
+    printf("%u hardware threads, %d steps per sample\n", std::thread::hardware_concurrency(), BENCH_STEPS);
+
+    for(int s = 0; s < 4; ++s)
+    {
+        benchBatch(sizes[s], 1, false, false);
+        benchBatch(sizes[s], 0, false, false);
+    }
+
+    benchBatch(1024, 0, true, false);
+    benchBatch(1024, 0, true, true);
+
+    return 0;
+}
@@ -0,0 +1,613 @@
+//  bench_engine - the engine's hot kernels (vector math, terrain generation,
+//                 lighting, ray casts, bitmap I/O, bomb scans and collisions,
+//                 target updates) at several problem sizes, with a regression
+//                 check against a saved baseline.
+//
+//  Build (from the repository root):
+//      g++ -O2 -mavx bench/bench_engine.cpp game.cpp overlay.cpp savestate.cpp terrain.cpp generator.cpp targets.cpp timerwheel.cpp vecbatch.cpp jobs.cpp arena.cpp memtrack.cpp heightfield.cpp raycast.cpp lighting.cpp RGBpixmap.cpp -pthread -o bench_engine
+//
+//  Usage:
+//      bench_engine [--filter TEXT] [--reps N] [--json FILE] [--compare FILE] [--threshold PCT]
+//
+//  Every input comes from a fixed seed, so two runs time the same work. Each
+//  benchmark reports the median time of --reps runs (default 15) and their
+//  median absolute deviation (MAD). --filter runs only the benchmarks whose
+//  name contains TEXT.
+//
+//  --json writes the results to FILE. --compare reads such a file and marks
+//  every benchmark whose median is more than PCT percent (default 5) slower
+//  than the baseline and further off than the noise of both runs (three
+//  MADs); if any are, the program exits with status 1.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "bench.h"
+#include "../game.h"
+#include "../terrain.h"
+#include "../raycast.h"
+#include "../lighting.h"
+#include "../RGBpixmap.h"
+
+#define BENCH_SEED 511
+#define BENCH_THRESHOLD 5.0 // percent slower than the baseline that counts as a regression
+#define BENCH_NOISE_MADS 3.0 // differences within this many MADs are noise
+
+#define BENCH_BITMAP "bench_engine.bmp" // scratch file for the bitmap benchmarks
+
+// One finished benchmark
+typedef struct BenchResult {
+    std::string name;
+    long items;       // work items per call (vectors, vertices, pixels, targets)
+    BenchStats stats;
+} BenchResult;
+
+// One benchmark read back from a --json file
+typedef struct BaselineEntry {
+    std::string name;
+    double median;
+    double mad;
+} BaselineEntry;
+
+static std::vector<BenchResult> results;
+static const char *filter = NULL;
+static int repetitions = BENCH_REPETITIONS;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  BenchTerrain - Terrain with its generation passes opened up for timing.
+
+class BenchTerrain : public Terrain
+{
+    public:
+
+        using Terrain::resetMesh;
+        using Terrain::updateMesh;
+        using Terrain::updateNormals;
+        using Terrain::updateMeshAnalytic;
+        using Terrain::computeVertexHeight;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//  BenchGame - Game with the bomb scan and the collision test opened up.
+//              The bomb is held high above the targets, so nothing is hit
+//              and every call does the same work.
+
+class BenchGame : public Game
+{
+    public:
+
+        void scan(float x, float z)
+        {
+            tickArena.reset();
+            bomb.position = VECTOR3D(x, 100.0f, z);
+            findNearbyTargets(bomb);
+        }
+
+        void collide()
+        {
+            tickArena.reset();
+            checkCollisions(bomb);
+        }
+
+        int getNumNearby() const { return (int) bomb.nearby.size(); }
+
+    protected:
+
+        Bomb bomb;
+};
+
+
+/**************************************************************************************
+ **     Running and Reporting
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  run - Time f() unless the filter excludes name, print the line and keep
+//        the result.
+
+template <class F>
+void run(const std::string & name, long items, F f)
+{
+    if(filter != NULL && name.find(filter) == std::string::npos)
+        return;
+
+    BenchResult r;
+    r.name = name;
+    r.items = items;
+    r.stats = benchMeasure(f, repetitions);
+
+    printf("%-36s %12.1f us  +- %8.1f us %10.3f ns/item\n", name.c_str(),
+           r.stats.median / 1000.0, r.stats.mad / 1000.0, r.stats.median / items);
+
+    results.push_back(r);
+}
+
+static std::string sized(const char *name, int size)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%s/%d", name, size);
+    return buffer;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  writeJson - One benchmark object per line; readBaseline depends on it.
+
+static bool writeJson(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if(f == NULL)
+        return false;
+
+    fprintf(f, "{\"seed\": %d, \"benchmarks\": [\n", BENCH_SEED);
+
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult & r = results[i];
+
+        fprintf(f, "  {\"name\": \"%s\", \"items\": %ld, \"median_ns\": %.1f, \"mad_ns\": %.1f, \"min_ns\": %.1f, \"repetitions\": %d}%s\n",
+                r.name.c_str(), r.items, r.stats.median, r.stats.mad, r.stats.min, r.stats.repetitions,
+                (i+1 < results.size()) ? "," : "");
+    }
+
+    fprintf(f, "]}\n");
+    fclose(f);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  readBaseline - Read the benchmarks of a file written by writeJson.
+
+static bool readBaseline(const char *path, std::vector<BaselineEntry> & baseline)
+{
+    FILE *f = fopen(path, "r");
+
+    if(f == NULL)
+        return false;
+
+    char line[512];
+
+    while(fgets(line, sizeof(line), f) != NULL)
+    {
+        const char *name = strstr(line, "\"name\": \"");
+        const char *median = strstr(line, "\"median_ns\": ");
+        const char *mad = strstr(line, "\"mad_ns\": ");
+
+        if(name == NULL || median == NULL || mad == NULL)
+            continue;
+
+        name += strlen("\"name\": \"");
+
+        BaselineEntry e;
+        e.name.assign(name, strcspn(name, "\""));
+        e.median = atof(median + strlen("\"median_ns\": "));
+        e.mad = atof(mad + strlen("\"mad_ns\": "));
+
+        baseline.push_back(e);
+    }
+
+    fclose(f);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  compare - Print every result against the baseline; returns the number of
+//            regressions.
+
+static int compare(const std::vector<BaselineEntry> & baseline, double threshold)
+{
+    int regressions = 0;
+
+    printf("\n%-36s %12s %12s %9s\n", "compared to baseline", "baseline us", "now us", "change");
+
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult & r = results[i];
+        const BaselineEntry *base = NULL;
+
+        for(size_t k = 0; k < baseline.size() && base == NULL; ++k)
+        {
+            if(baseline[k].name == r.name)
+                base = &baseline[k];
+        }
+
+        if(base == NULL)
+        {
+            printf("%-36s %12s %12.1f %9s\n", r.name.c_str(), "-", r.stats.median / 1000.0, "new");
+            continue;
+        }
+
+        double change = (r.stats.median - base->median) / base->median * 100.0;
+        double noise = BENCH_NOISE_MADS * std::max(r.stats.mad, base->mad);
+        bool regressed = change > threshold && r.stats.median - base->median > noise;
+
+        printf("%-36s %12.1f %12.1f %+8.1f%%%s\n", r.name.c_str(), base->median / 1000.0,
+               r.stats.median / 1000.0, change, regressed ? "  REGRESSION" : "");
+
+        if(regressed)
+            regressions++;
+    }
+
+    return regressions;
+}
+
+
+/**************************************************************************************
+ **     Benchmarks
+ **
+ **************************************************************************************/
+
+static void benchVectors()
+{
+    const int sizes[] = {1024, 65536};
+
+    for(int s = 0; s < 2; ++s)
+    {
+        int n = sizes[s];
+        std::vector<VECTOR3D> a(n), b(n), out(n);
+
+        for(int i = 0; i < n; ++i)
+        {
+            a[i] = VECTOR3D(rand() % 100 - 50.0f, rand() % 100 - 50.0f, rand() % 100 - 50.0f);
+            b[i] = VECTOR3D(rand() % 100 - 50.0f, rand() % 100 - 50.0f, rand() % 100 - 50.0f);
+        }
+
+        run(sized("vector3d/add", n), n, [&]() {
+            for(int i = 0; i < n; ++i)
+                out[i] = a[i] + b[i];
+            benchSink = out[n-1].x;
+        });
+
+        run(sized("vector3d/cross", n), n, [&]() {
+            for(int i = 0; i < n; ++i)
+                out[i] = a[i].CrossProduct(b[i]);
+            benchSink = out[n-1].x;
+        });
+
+        run(sized("vector3d/dot", n), n, [&]() {
+            float sum = 0.0f;
+            for(int i = 0; i < n; ++i)
+                sum += a[i].DotProduct(b[i]);
+            benchSink = sum;
+        });
+
+        run(sized("vector3d/normalize", n), n, [&]() {
+            for(int i = 0; i < n; ++i)
+            {
+                out[i] = a[i];
+                out[i].Normalize();
+            }
+            benchSink = out[n-1].x;
+        });
+    }
+}
+
+static void benchTerrain()
+{
+    const int sizes[] = {64, 256, 512};
+
+    for(int s = 0; s < 3; ++s)
+    {
+        int dim = sizes[s];
+        long verts = (long)(dim+1) * (dim+1);
+
+        BenchTerrain terrain;
+        terrain.setSeed(BENCH_SEED);
+        terrain.initTerrain(dim, dim);
+
+        run(sized("terrain/computeVertexHeight", dim), verts, [&]() {
+            for(int i = 0; i <= dim; ++i)
+                for(int k = 0; k <= dim; ++k)
+                    terrain.computeVertexHeight(&terrain.vertices[i][k]);
+            benchSink = terrain.vertices[dim][dim].y;
+        });
+
+        run(sized("terrain/updateMesh", dim), verts, [&]() {
+            terrain.resetMesh();
+            terrain.updateMesh();
+            benchSink = terrain.vertices[dim][dim].y;
+        });
+
+        run(sized("terrain/updateNormals", dim), verts, [&]() {
+            terrain.updateNormals();
+            benchSink = terrain.normals[dim/2][dim/2].y;
+        });
+
+        run(sized("terrain/updateMeshAnalytic", dim), verts, [&]() {
+            terrain.resetMesh();
+            terrain.updateMeshAnalytic();
+            benchSink = terrain.normals[dim/2][dim/2].y;
+        });
+
+        // The same terrain stored compactly: generation and decoding
+        Terrain compact;
+        compact.setSeed(BENCH_SEED);
+        compact.setCompact(true);
+
+        run(sized("terrain/compact/initTerrain", dim), verts, [&]() {
+            compact.initTerrain(dim, dim);
+            benchSink = compact.getMaxHeight();
+        });
+
+        run(sized("terrain/compact/getVertex", dim), verts, [&]() {
+            float sum = 0.0f;
+            for(int i = 0; i <= dim; ++i)
+                for(int k = 0; k <= dim; ++k)
+                    sum += compact.getVertex(i, k).y;
+            benchSink = sum;
+        });
+
+        run(sized("terrain/compact/getNormal", dim), verts, [&]() {
+            float sum = 0.0f;
+            for(int i = 0; i <= dim; ++i)
+                for(int k = 0; k <= dim; ++k)
+                    sum += compact.getNormal(i, k).y;
+            benchSink = sum;
+        });
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  benchLighting - Baking the terrain lighting on one thread, with and
+//                  without ambient occlusion.
+
+static void benchLighting()
+{
+    const int sizes[] = {256, 1024};
+
+    for(int s = 0; s < 2; ++s)
+    {
+        int dim = sizes[s];
+        long verts = (long)(dim+1) * (dim+1);
+
+        Terrain terrain;
+        terrain.setSeed(BENCH_SEED);
+        terrain.initTerrain(dim, dim);
+
+        TerrainLighting lighting;
+        VECTOR3D light(50.0f, 20.0f, 20.0f);
+
+        run(sized("lighting/bake", dim), verts, [&]() {
+            lighting.bake(&terrain, light, false, NULL);
+            benchSink = lighting.getColor(dim/2, dim/2)[0];
+        });
+
+        run(sized("lighting/bake-ao", dim), verts, [&]() {
+            lighting.bake(&terrain, light, true, NULL);
+            benchSink = lighting.getColor(dim/2, dim/2)[0];
+        });
+    }
+}
+
+static void benchQueries()
+{
+    const int sizes[] = {1024, 65536};
+
+    Terrain terrain;
+    terrain.setSeed(BENCH_SEED);
+    terrain.initTerrain(MESH_RESOLUTION, MESH_RESOLUTION);
+
+    for(int s = 0; s < 2; ++s)
+    {
+        int n = sizes[s];
+        std::vector<float> xs(n), zs(n), heights(n);
+        Rng rng(BENCH_SEED);
+
+        for(int i = 0; i < n; ++i)
+            terrain.getRandomPoint(rng, &xs[i], &zs[i]);
+
+        run(sized("terrain/getHeightAt", n), n, [&]() {
+            for(int i = 0; i < n; ++i)
+                heights[i] = terrain.getHeightAt(xs[i], zs[i]);
+            benchSink = heights[n-1];
+        });
+
+        run(sized("terrain/getHeightsAt", n), n, [&]() {
+            terrain.getHeightsAt(&xs[0], &zs[0], n, &heights[0]);
+            benchSink = heights[n-1];
+        });
+
+        run(sized("terrain/getNormalAt", n), n, [&]() {
+            float sum = 0.0f;
+            for(int i = 0; i < n; ++i)
+                sum += terrain.getNormalAt(xs[i], zs[i]).y;
+            benchSink = sum;
+        });
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  benchRaycast - Picking rays from a camera above one edge of the terrain
+//                 to random ground points, through the height pyramid and by
+//                 testing every cell. Compact terrains keep 4096 in memory.
+
+static void benchRaycast()
+{
+    const int sizes[] = {256, 1024, 4096};
+    const int numRays = 4096;
+    const int numBruteRays = 4;
+
+    for(int s = 0; s < 3; ++s)
+    {
+        int dim = sizes[s];
+
+        Terrain terrain;
+        terrain.setSeed(BENCH_SEED);
+        terrain.setCompact(true);
+        terrain.initTerrain(dim, dim);
+
+        HeightPyramid pyramid;
+
+        run(sized("raycast/build", dim), (long)(dim+1) * (dim+1), [&]() {
+            pyramid.build(&terrain);
+        });
+
+        VECTOR3D eye(0.0f, terrain.getMaxHeight() + dim * 0.25f, -0.6f * dim);
+        std::vector<VECTOR3D> directions(numRays);
+        Rng rng(BENCH_SEED);
+
+        for(int i = 0; i < numRays; ++i)
+        {
+            float x, z;
+            terrain.getRandomPoint(rng, &x, &z);
+            directions[i] = VECTOR3D(x, terrain.getHeightAt(x, z), z) - eye;
+        }
+
+        RayHit hit;
+
+        run(sized("raycast/pyramid", dim), numRays, [&]() {
+            float sum = 0.0f;
+            for(int i = 0; i < numRays; ++i)
+                if(pyramid.castRay(eye, directions[i], &hit))
+                    sum += hit.t;
+            benchSink = sum;
+        });
+
+        run(sized("raycast/bruteforce", dim), numBruteRays, [&]() {
+            float sum = 0.0f;
+            for(int i = 0; i < numBruteRays; ++i)
+                if(pyramid.castRayBruteForce(eye, directions[i], &hit))
+                    sum += hit.t;
+            benchSink = sum;
+        });
+    }
+}
+
+static void benchBitmaps()
+{
+    const int sizes[] = {64, 256, 1024};
+
+    for(int s = 0; s < 3; ++s)
+    {
+        int dim = sizes[s];
+        long pixels = (long) dim * dim;
+
+        RGBpixmap image(dim, dim);
+
+        for(int row = 0; row < dim; ++row)
+            for(int col = 0; col < dim; ++col)
+                image.setPixel(col, row, RGBpixel(row & 255, col & 255, (row ^ col) & 255));
+
+        run(sized("pixmap/writeBMPFile", dim), pixels, [&]() {
+            image.writeBMPFile(BENCH_BITMAP);
+        });
+
+        RGBpixmap loaded;
+
+        run(sized("pixmap/readBMPFile", dim), pixels, [&]() {
+            loaded.readBMPFile(BENCH_BITMAP);
+            benchSink = loaded.pixel[pixels-1].r;
+        });
+
+        loaded.freeIt();
+        image.freeIt();
+    }
+
+    remove(BENCH_BITMAP);
+}
+
+static void benchGame()
+{
+    const int sizes[] = {1000, 100000, 1000000};
+
+    BenchTerrain terrain;
+    terrain.setSeed(BENCH_SEED);
+    terrain.initTerrain(MESH_RESOLUTION, MESH_RESOLUTION);
+
+    for(int s = 0; s < 3; ++s)
+    {
+        int n = sizes[s];
+
+        BenchGame game;
+        game.initGame(&terrain, n, BENCH_SEED);
+
+        // Aim at the first target, so the scan finds the targets sharing its vertex
+        float x = game.targets.x[0];
+        float z = game.targets.z[0];
+
+        run(sized("game/findNearbyTargets", n), n, [&]() {
+            game.scan(x, z);
+            benchSink = (float) game.getNumNearby();
+        });
+
+        game.scan(x, z);
+        int nearby = game.getNumNearby();
+
+        run(sized("game/checkCollisions", n), std::max(nearby, 1), [&]() {
+            game.collide();
+        });
+
+        // Let some targets wake up first, so the update sees a mix of states
+        for(int t = 0; t < 100; ++t)
+            game.targets.update();
+
+        run(sized("targets/update", n), n, [&]() {
+            game.targets.update();
+            benchSink = game.targets.y[0];
+        });
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *jsonPath = NULL;
+    const char *baselinePath = NULL;
+    double threshold = BENCH_THRESHOLD;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--filter") == 0 && i+1 < argc)
+            filter = argv[++i];
+        else if(strcmp(argv[i], "--reps") == 0 && i+1 < argc)
+            repetitions = std::max(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "--json") == 0 && i+1 < argc)
+            jsonPath = argv[++i];
+        else if(strcmp(argv[i], "--compare") == 0 && i+1 < argc)
+            baselinePath = argv[++i];
+        else if(strcmp(argv[i], "--threshold") == 0 && i+1 < argc)
+            threshold = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--filter TEXT] [--reps N] [--json FILE] [--compare FILE] [--threshold PCT]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Read the baseline first, so a bad path fails before the long run
+    std::vector<BaselineEntry> baseline;
+
+    if(baselinePath != NULL && !readBaseline(baselinePath, baseline))
+    {
+        fprintf(stderr, "bench_engine: cannot read %s\n", baselinePath);
+        return 1;
+    }
+
+    printf("%-36s %12s  %11s %18s\n", "benchmark", "median", "MAD", "per item");
+
+    srand(BENCH_SEED);
+    benchVectors();
+    benchTerrain();
+    benchLighting();
+    benchQueries();
+    benchRaycast();
+    benchBitmaps();
+    benchGame();
+
+    if(jsonPath != NULL && !writeJson(jsonPath))
+    {
+        fprintf(stderr, "bench_engine: cannot write %s\n", jsonPath);
+        return 1;
+    }
+
+    if(baselinePath != NULL && compare(baseline, threshold) > 0)
+        return 1;
+
+    return 0;
+}
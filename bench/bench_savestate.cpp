@@ -0,0 +1,129 @@
+//  bench_savestate - saves and loads a game with 1M targets in the middle of
+//                    a run (targets moving and parked, bombs in the air,
+//                    craters), and compares that with reaching the same
+//                    tick by stepping from the start. Both copies of the
+//                    game are then stepped on and must stay identical.
+//
+//  Build (from the repository root):
+//      g++ -O2 -mavx bench/bench_savestate.cpp game.cpp overlay.cpp savestate.cpp terrain.cpp generator.cpp targets.cpp timerwheel.cpp vecbatch.cpp jobs.cpp arena.cpp memtrack.cpp heightfield.cpp -pthread -o bench_savestate
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "../game.h"
+
+#define BENCH_SEED 511
+#define BENCH_TARGETS 1000000
+#define BENCH_BOMBS 8
+#define BENCH_TICKS 2000    // ticks played before saving
+#define CHECK_TICKS 500     // ticks both copies are stepped after loading
+#define BENCH_FILE "bench_savestate.bbss"
+
+///////////////////////////////////////////////////////////////////////////////
+//  randomInput - flying around, dropping a bomb every few ticks.
+
+static void randomInput(Rng & rng, SimInput *input)
+{
+    clearInput(input);
+
+    int r = rng.nextInt(16);
+
+    if(r < 8)
+        input->moveX = (r & 1) ? 1 : -1;
+    else if(r < 14)
+        input->moveZ = (r & 1) ? 1 : -1;
+    else
+        input->dropBomb = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  playFromStart - a new game, stepped BENCH_TICKS times.
+
+static void playFromStart(Game & game, const Terrain & terrain)
+{
+    Rng rng(BENCH_SEED, RNG_STREAM_INPUT);
+    SimInput input;
+
+    game.setRules(BENCH_BOMBS, true, true);
+    game.initGame(&terrain, BENCH_TARGETS, BENCH_SEED);
+
+    for(int t = 0; t < BENCH_TICKS; ++t)
+    {
+        randomInput(rng, &input);
+        game.step(input);
+    }
+}
+
+int main()
+{
+    Terrain terrain;
+    terrain.setSeed(BENCH_SEED);
+    terrain.initTerrain(MESH_RESOLUTION, MESH_RESOLUTION);
+
+    Game game;
+    playFromStart(game, terrain);
+
+    printf("%d targets (%d moving, %d parked), %d bombs in the air, %d crater tiles at tick %u\n",
+           game.targets.count, game.targets.getActiveCount(), game.targets.getParkedCount(),
+           game.bombs.size(), game.ground.getNumTiles(), game.tick);
+
+    double playNs = benchMeasure([&]() { Game g; playFromStart(g, terrain); }, 3).median;
+    benchReport("savestate/play-from-start", playNs, BENCH_TARGETS);
+
+    bool saved = true;
+
+    double saveNs = benchMedianNs([&]() {
+        saved = saved && game.saveState(BENCH_FILE);
+    });
+
+    if(!saved)
+    {
+        fprintf(stderr, "bench_savestate: cannot write %s\n", BENCH_FILE);
+        return 1;
+    }
+
+    benchReport("savestate/save", saveNs, BENCH_TARGETS);
+
+    Game copy;
+    bool loaded = true;
+
+    double loadNs = benchMedianNs([&]() {
+        loaded = loaded && copy.loadState(&terrain, BENCH_FILE);
+    });
+
+    if(!loaded)
+    {
+        remove(BENCH_FILE);
+        return 1;
+    }
+
+    benchReport("savestate/load", loadNs, BENCH_TARGETS);
+
+    FILE *f = fopen(BENCH_FILE, "rb");
+    fseek(f, 0, SEEK_END);
+    printf("%32s %12.1f MB file, load %.0fx faster than playing to tick %u\n", "",
+           ftell(f) / (1024.0 * 1024.0), playNs / loadNs, game.tick);
+    fclose(f);
+    remove(BENCH_FILE);
+
+    // The loaded copy must go on exactly as the original
+    Rng rng(BENCH_SEED + 1, RNG_STREAM_INPUT);
+    SimInput input;
+
+    for(int t = 0; t < CHECK_TICKS; ++t)
+    {
+        randomInput(rng, &input);
+        game.step(input);
+        copy.step(input);
+
+        if(game.stateHash() != copy.stateHash())
+        {
+            printf("loaded game diverged %d ticks after loading\n", t+1);
+            return 1;
+        }
+    }
+
+    printf("loaded game matched the original for %d ticks (%d targets hit)\n", CHECK_TICKS, copy.getTargetsHit());
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+//  bench_targets - ticks 1M targets with the original array-of-structs state
+//                  machine and with the structure-of-arrays TargetPool.
+//
+//  Build (from the repository root):
+//      g++ -O2 -mavx bench/bench_targets.cpp targets.cpp timerwheel.cpp jobs.cpp memtrack.cpp savestate.cpp -pthread -o bench_targets
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../targets.h"
+
+#define BENCH_SEED 511
+#define BENCH_TARGETS 1000000
+#define BENCH_TICKS 10
+
+// The target record as it was stored before TargetPool
+typedef struct LegacyTarget
+{
+    VECTOR3D position;
+    float meshHeight;
+
+    bool hit;
+    bool moving;
+
+    int ticksBeforeMoving;
+    float maxHeight;
+    float size;
+    float delta;
+} LegacyTarget;
+
+///////////////////////////////////////////////////////////////////////////////
+//  legacyMoveTargets - the original per-target state machine
+
+static void legacyMoveTargets(LegacyTarget *targets, int n)
+{
+    for(int i = 0; i < n; ++i)
+    {
+        LegacyTarget *t = &targets[i];
+
+        if(!t->hit)
+        {
+            if(t->moving)
+            {
+                if(t->delta > 0.0 && t->position.y < (t->meshHeight + t->maxHeight))
+                    t->position.y += t->delta;
+                else if(t->delta > 0.0)
+                    t->delta *= -1.0;
+                else if(t->position.y > (t->meshHeight-(t->size*2)))
+                    t->position.y += t->delta;
+                else
+                {
+                    t->moving = false;
+                    t->ticksBeforeMoving = rand() % 400 +1;
+                }
+            }
+            else
+            {
+                t->ticksBeforeMoving--;
+
+                if(t->ticksBeforeMoving == 0)
+                {
+                    t->moving = true;
+                    t->position.y = t->meshHeight - t->size;
+                    t->maxHeight = rand() % 10 +1.0;
+                    t->delta = 0.05f;
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    std::vector<LegacyTarget> legacy(BENCH_TARGETS);
+    TargetPool pool;
+
+    srand(BENCH_SEED);
+    pool.allocate(BENCH_TARGETS);
+
+    for(int i = 0; i < BENCH_TARGETS; ++i)
+    {
+        VECTOR3D position(rand() % 64 - 32.0f, rand() % 10, rand() % 64 - 32.0f);
+        int ticks = rand() % 120 +1;
+
+        LegacyTarget &t = legacy[i];
+        t.position = position;
+        t.size = 1.0f;
+        t.meshHeight = position.y - 2.0f;
+        t.moving = false;
+        t.hit = false;
+        t.ticksBeforeMoving = ticks;
+
+        pool.spawn(position, 1.0f, ticks);
+    }
+
+    // Run both past the first wake-ups so a mix of states is measured
+    for(int i = 0; i < 100; ++i)
+    {
+        legacyMoveTargets(&legacy[0], BENCH_TARGETS);
+        pool.update();
+    }
+
+    printf("%d targets, %d ticks per sample\n", BENCH_TARGETS, BENCH_TICKS);
+    printf("TargetPool: %d active, %d parked\n", pool.getActiveCount(), pool.getParkedCount());
+
+    double ns = benchMedianNs([&]() {
+        for(int t = 0; t < BENCH_TICKS; ++t)
+            legacyMoveTargets(&legacy[0], BENCH_TARGETS);
+        benchSink = legacy[0].position.y;
+    });
+    benchReport("array of structs", ns / BENCH_TICKS, BENCH_TARGETS);
+
+    ns = benchMedianNs([&]() {
+        for(int t = 0; t < BENCH_TICKS; ++t)
+            pool.update();
+        benchSink = pool.y[0];
+    });
+    benchReport("TargetPool", ns / BENCH_TICKS, BENCH_TARGETS);
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+//  bench_terrain - vertices per second of each terrain generator.
+//
+//  Build (from the repository root):
+//      g++ -O2 -mavx bench/bench_terrain.cpp generator.cpp memtrack.cpp -o bench_terrain
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../generator.h"
+
+#define BENCH_SEED 511
+
+///////////////////////////////////////////////////////////////////////////////
+//  fillGrid - generate a dim x dim grid with heights and gradients
+
+static void fillGrid(TerrainGenerator *g, int dim, std::vector<float> & xs,
+                     std::vector<float> & h, std::vector<float> & dx, std::vector<float> & dz)
+{
+    for(int row = 0; row < dim; ++row)
+        g->generateRow(&xs[0], row - dim/2.0f, dim, &h[0], &dx[0], &dz[0]);
+
+    benchSink = h[dim-1];
+}
+
+int main()
+{
+    const int sizes[] = {128, 512};
+    const int blobCounts[] = {20, 100};
+
+    srand(BENCH_SEED);
+
+    for(int s = 0; s < 2; ++s)
+    {
+        int dim = sizes[s];
+        long verts = (long) dim * dim;
+        std::vector<float> xs(dim), h(dim), dx(dim), dz(dim);
+
+        for(int i = 0; i < dim; ++i)
+            xs[i] = i - dim/2.0f;
+
+        printf("\n-- %d x %d grid --\n", dim, dim);
+
+        for(int b = 0; b < 2; ++b)
+        {
+            BlobGenerator blobs;
+
+            for(int i = 0; i < blobCounts[b]; ++i)
+            {
+                Blob blob;
+                blob.position = VECTOR3D(rand() % dim - dim/2.0f, 0.0f, rand() % dim - dim/2.0f);
+                blob.height = rand() % 8 + 2.0f;
+                blob.width = ((rand()%20)/100.0f + 0.001f) / (blob.height/3.0f);
+                blobs.addBlob(blob);
+            }
+
+            double ns = benchMedianNs([&]() { fillGrid(&blobs, dim, xs, h, dx, dz); });
+            printf("blobs (%3d)    %10.2f Mverts/s\n", blobCounts[b], verts / ns * 1000.0);
+        }
+
+        NoiseGenerator noise(BENCH_SEED);
+        double ns = benchMedianNs([&]() { fillGrid(&noise, dim, xs, h, dx, dz); });
+        printf("noise (%d oct)  %10.2f Mverts/s\n", noise.octaves, verts / ns * 1000.0);
+    }
+
+    return 0;
+}
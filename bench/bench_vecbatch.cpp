@@ -0,0 +1,89 @@
+//  bench_vecbatch - compares the scalar VECTOR3D operations against the
+//                   batch kernels in vecbatch.h.
+//
+//  Build (from the repository root):
+//      g++ -O2 -mavx bench/bench_vecbatch.cpp vecbatch.cpp -o bench_vecbatch
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../vecbatch.h"
+
+#define BENCH_SEED 511
+
+int main()
+{
+    const int sizes[] = {256, 4096, 65536};
+
+    srand(BENCH_SEED);
+    printf("vecbatch kernel path: %s\n", batchMathPath());
+
+    for(int s = 0; s < 3; ++s)
+    {
+        int n = sizes[s];
+        std::vector<VECTOR3D> a(n), b(n), out(n);
+
+        for(int i = 0; i < n; ++i)
+        {
+            a[i] = VECTOR3D(rand() % 100 - 50.0f, rand() % 100 - 50.0f, rand() % 100 - 50.0f);
+            b[i] = VECTOR3D(rand() % 100 - 50.0f, rand() % 100 - 50.0f, rand() % 100 - 50.0f);
+        }
+
+        Vec3Array sa, sb, sout(n);
+        sa.load(&a[0], n);
+        sb.load(&b[0], n);
+        std::vector<float> dots(n);
+
+        printf("\n-- %d vectors --\n", n);
+
+        // Cross products
+        benchReport("VECTOR3D::CrossProduct", benchMedianNs([&]() {
+            for(int i = 0; i < n; ++i)
+                out[i] = a[i].CrossProduct(b[i]);
+            benchSink = out[n-1].x;
+        }), n);
+
+        benchReport("batchCross", benchMedianNs([&]() {
+            batchCross(sa, sb, sout);
+            benchSink = sout.x[n-1];
+        }), n);
+
+        // Dot products
+        benchReport("VECTOR3D::DotProduct", benchMedianNs([&]() {
+            for(int i = 0; i < n; ++i)
+                dots[i] = a[i].DotProduct(b[i]);
+            benchSink = dots[n-1];
+        }), n);
+
+        benchReport("batchDot", benchMedianNs([&]() {
+            batchDot(sa, sb, &dots[0]);
+            benchSink = dots[n-1];
+        }), n);
+
+        // Normalize (re-normalizing unit vectors keeps the work identical each run)
+        benchReport("VECTOR3D::Normalize", benchMedianNs([&]() {
+            for(int i = 0; i < n; ++i)
+                out[i].Normalize();
+            benchSink = out[n-1].x;
+        }), n);
+
+        benchReport("batchNormalize", benchMedianNs([&]() {
+            batchNormalize(sout);
+            benchSink = sout.x[n-1];
+        }), n);
+
+        // axpy
+        benchReport("VECTOR3D out += s*a", benchMedianNs([&]() {
+            for(int i = 0; i < n; ++i)
+                out[i] += a[i] * 0.5f;
+            benchSink = out[n-1].x;
+        }), n);
+
+        benchReport("batchAxpy", benchMedianNs([&]() {
+            batchAxpy(0.5f, sa, sout);
+            benchSink = sout.x[n-1];
+        }), n);
+    }
+
+    return 0;
+}
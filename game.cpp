@@ -0,0 +1,676 @@
+#include "game.h"
+#include "profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  clearInput - Reset an input record to "nothing happened".
+
+void clearInput(SimInput *input)
+{
+    input->moveX = 0;
+    input->moveZ = 0;
+    input->dropBomb = false;
+    input->toggleViewTargets = false;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  applyInputEvent - Add one key press to the input record.
+
+void applyInputEvent(SimInput *input, const InputEvent & e)
+{
+    if(e.kind == INPUT_KEY)
+    {
+        // Drop Bomb
+        if(e.code == ' ')
+            input->dropBomb = true;
+
+        return;
+    }
+
+    switch(e.code)
+    {
+        case SIM_KEY_UP:    input->moveZ -= 1; break;
+        case SIM_KEY_DOWN:  input->moveZ += 1; break;
+        case SIM_KEY_LEFT:  input->moveX -= 1; break;
+        case SIM_KEY_RIGHT: input->moveX += 1; break;
+
+        // Toggle view targets mode
+        case SIM_KEY_F6:
+            input->toggleViewTargets = !input->toggleViewTargets;
+            break;
+    }
+}
+
+
+/**************************************************************************************
+ **     Public Game Functions
+ **
+ **************************************************************************************/
+
+Game::Game()
+{
+    terrain = NULL;
+    jobs = NULL;
+    jobBomb = NULL;
+    chunkSize = 0;
+    nearbyReserve = 0;
+    maxBombs = 1;
+    respawnTargets = false;
+    craters = false;
+    targetsHit = 0;
+    targetsLeft = 0;
+    viewTargets = false;
+    tick = 0;
+    hitsThisTick = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  setRules - Allow up to maxBombs bombs in the air at once, replace the
+//             targets that are hit if respawnTargets is set, and let bombs
+//             that land leave craters if withCraters is set.
+
+void Game::setRules(int bombLimit, bool respawn, bool withCraters)
+{
+    maxBombs = min(max(bombLimit, 1), MAX_BOMBS);
+    respawnTargets = respawn;
+    craters = withCraters;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  initGame - Place the balloon above the highest hill and the targets at
+//             random points on the ground. The terrain must be generated.
+//             The same seed and inputs always give the same game.
+
+void Game::initGame(const Terrain *t, int numTargets, unsigned int seed)
+{
+    terrain = t;
+    ground.attach(t);
+    balloonPosition = VECTOR3D(0.0f, terrain->getMaxHeight()+10.0, 0.0f);
+
+    viewTargets = false;
+    tick = 0;
+    hitsThisTick = 0;
+    targetsHit = 0;
+
+    rng.setSeed(seed, RNG_STREAM_GAME);
+
+    bombs.allocate(maxBombs);
+
+    // A target hit while parked keeps its id until its timer fires, so
+    // respawning needs room for as many again
+    targets.allocate(respawnTargets ? 2*numTargets : numTargets);
+    targets.setSeed(seed);
+    targetsLeft = numTargets;
+
+    reserveNearby(nearbyEstimate());
+
+    // Draw every position first, then look up the ground heights in one batch
+    tickArena.reset();
+
+    float *xs = tickArena.allocArray<float>(numTargets);
+    float *zs = tickArena.allocArray<float>(numTargets);
+    float *heights = tickArena.allocArray<float>(numTargets);
+    int *delays = tickArena.allocArray<int>(numTargets);
+
+    for(int i = 0; i < numTargets; ++i)
+    {
+        terrain->getRandomPoint(rng, &xs[i], &zs[i]);
+        delays[i] = rng.nextInt(120) +1;
+    }
+
+    ground.getHeightsAt(xs, zs, numTargets, heights);
+
+    for(int i = 0; i < numTargets; ++i)
+        targets.spawn(VECTOR3D(xs[i], heights[i], zs[i]), TARGET_SIZE, delays[i]);
+
+    tickArena.reset();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  setJobSystem - Run the per-tick work as jobs.
+
+void Game::setJobSystem(JobSystem *j)
+{
+    jobs = j;
+    targets.setJobSystem(j);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  step - Apply the input, then advance the targets and the bomb by one tick.
+
+void Game::step(const SimInput & input)
+{
+    PROFILE_ZONE("Game::step");
+
+    hitsThisTick = 0;
+    tickArena.reset();
+
+    // Player input
+    balloonPosition.x += input.moveX * BALLOON_STEP;
+    balloonPosition.z += input.moveZ * BALLOON_STEP;
+
+    if(input.toggleViewTargets)
+        viewTargets = !viewTargets;
+
+    if(input.dropBomb && canDropBomb())
+        dropBomb();
+
+    // Targets freeze while the view targets mode is on
+    if(!viewTargets)
+        targets.update();
+
+    moveBombs();
+    tick++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getBalloonBaseHeight - returns the height of the base of the balloon.
+
+float Game::getBalloonBaseHeight() const
+{
+    return balloonPosition.y - BALLOON_BASE_OFFSET;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  stateHash - FNV-1a hash of the game state (balloon, bombs, craters, score
+//              and every target's state and height), compared tick by tick
+//              on replay.
+
+uint32_t Game::stateHash() const
+{
+    uint32_t h = HASH_SEED;
+
+    h = hashBytes(h, &tick, sizeof(tick));
+    h = hashFloat(h, balloonPosition.x);
+    h = hashFloat(h, balloonPosition.y);
+    h = hashFloat(h, balloonPosition.z);
+
+    unsigned char flags = viewTargets ? 2 : 0;
+    h = hashBytes(h, &flags, 1);
+
+    int numBombs = bombs.size();
+    h = hashBytes(h, &numBombs, sizeof(numBombs));
+
+    for(int b = 0; b < numBombs; ++b)
+    {
+        h = hashFloat(h, bombs[b].position.x);
+        h = hashFloat(h, bombs[b].position.y);
+        h = hashFloat(h, bombs[b].position.z);
+    }
+
+    // The craters, tile by tile in key order (the map has no order of its own)
+    int numTiles = ground.getNumTiles();
+    h = hashBytes(h, &numTiles, sizeof(numTiles));
+
+    for(int key = 0; numTiles > 0 && key < ground.getNumTileKeys(); ++key)
+    {
+        const float *tile = ground.findTile(key);
+
+        if(tile != NULL)
+        {
+            h = hashBytes(h, &key, sizeof(key));
+            h = hashBytes(h, tile, OVERLAY_TILE * OVERLAY_TILE * sizeof(float));
+        }
+    }
+
+    h = hashBytes(h, &targetsLeft, sizeof(targetsLeft));
+    h = hashBytes(h, &targets.count, sizeof(targets.count));
+
+    for(int i = 0; i < targets.count; ++i)
+    {
+        h = hashBytes(h, &targets.state[i], sizeof(int));
+        h = hashFloat(h, targets.getY(i));
+    }
+
+    return h;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  respawnTarget - Put a new target at a random point on the ground.
+
+void Game::respawnTarget()
+{
+    float x, z;
+    terrain->getRandomPoint(rng, &x, &z);
+    int delay = rng.nextInt(120) +1;
+
+    SlotHandle h = targets.spawn(VECTOR3D(x, ground.getHeightAt(x, z), z), TARGET_SIZE, delay);
+
+    if(!isNullHandle(h))
+        targetsLeft += 1;
+}
+
+
+/**************************************************************************************
+ **     Save State Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  GameState - The game's own scalars, part 0 of its save state section.
+
+typedef struct GameState {
+    Rng rng;
+    float balloonX, balloonY, balloonZ;
+    unsigned int tick;
+    int hitsThisTick;
+    int targetsLeft;
+    int targetsHit;
+    int maxBombs;
+    int terrainResolution;
+    uint32_t terrainHash; // of the base heights, so a game is only loaded on its own terrain
+    unsigned char viewTargets;
+    unsigned char respawnTargets;
+    unsigned char craters;
+} GameState;
+
+static uint32_t terrainHash(const Terrain *t)
+{
+    uint32_t h = HASH_SEED;
+    int n = t->getResolution();
+
+    for(int row = 0; row <= n; ++row)
+    {
+        for(int col = 0; col <= n; ++col)
+            h = hashFloat(h, t->getVertexHeight(row, col));
+    }
+
+    return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  saveState - Write the game, the craters, the target pool and the bombs.
+//              The bombs are few, so their positions, the lengths of their
+//              nearby lists and the lists themselves are three sections.
+
+bool Game::saveState(const char *path) const
+{
+    PROFILE_ZONE("Game::saveState");
+
+    StateWriter w;
+
+    if(!w.open(path))
+        return false;
+
+    GameState s;
+    memset((void*) &s, 0, sizeof(s)); // no stray bytes in the padding
+
+    s.rng = rng;
+    s.balloonX = balloonPosition.x;
+    s.balloonY = balloonPosition.y;
+    s.balloonZ = balloonPosition.z;
+    s.tick = tick;
+    s.hitsThisTick = hitsThisTick;
+    s.targetsLeft = targetsLeft;
+    s.targetsHit = targetsHit;
+    s.maxBombs = maxBombs;
+    s.terrainResolution = terrain->getResolution();
+    s.terrainHash = terrainHash(terrain);
+    s.viewTargets = viewTargets;
+    s.respawnTargets = respawnTargets;
+    s.craters = craters;
+
+    w.writeSection(STATE_GAME, 0, &s, 1);
+
+    ground.saveState(w);
+    targets.saveState(w);
+    bombs.saveTable(w, STATE_BOMB_IDS);
+
+    w.beginSection(STATE_BOMBS, 0);
+
+    for(int b = 0; b < bombs.size(); ++b)
+    {
+        float p[3] = { bombs[b].position.x, bombs[b].position.y, bombs[b].position.z };
+        w.write(p, sizeof(p));
+    }
+
+    w.beginSection(STATE_BOMBS, 1);
+
+    for(int b = 0; b < bombs.size(); ++b)
+    {
+        int n = (int) bombs[b].nearby.size();
+        w.write(&n, sizeof(n));
+    }
+
+    w.beginSection(STATE_BOMBS, 2);
+
+    for(int b = 0; b < bombs.size(); ++b)
+        w.write(bombs[b].nearby.data(), bombs[b].nearby.size() * sizeof(SlotHandle));
+
+    return w.close();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  loadBombs - The bombs' values, once their slot table is loaded.
+
+static bool loadBombs(const StateReader & r, SlotMap<Bomb, MEMORY_ENTITIES> & bombs)
+{
+    int n = bombs.size();
+    size_t positionBytes, countBytes, handleBytes;
+
+    const float *positions = (const float*) r.find(STATE_BOMBS, 0, &positionBytes);
+    const int *counts = (const int*) r.find(STATE_BOMBS, 1, &countBytes);
+    const SlotHandle *handles = (const SlotHandle*) r.find(STATE_BOMBS, 2, &handleBytes);
+
+    if(positionBytes != (size_t) n * 3 * sizeof(float) || countBytes != (size_t) n * sizeof(int))
+        return false;
+
+    size_t numHandles = 0;
+
+    for(int b = 0; b < n; ++b)
+    {
+        if(counts[b] < 0)
+            return false;
+
+        numHandles += (size_t) counts[b];
+    }
+
+    if(handleBytes != numHandles * sizeof(SlotHandle))
+        return false;
+
+    // The handles are only ever looked up, and stale ones are expected
+    for(int b = 0; b < n; ++b)
+    {
+        bombs[b].position = VECTOR3D(positions[3*b], positions[3*b+1], positions[3*b+2]);
+        bombs[b].nearby.assign(handles, handles + counts[b]);
+        handles += counts[b];
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  loadState - Map the file and load every part into a new overlay, target
+//              pool and bomb map, each of which checks what it reads. Only
+//              when all of them are sound are they swapped in, so a file
+//              that does not load leaves the game as it was. The target
+//              columns and the timer wheel are allocated at their saved
+//              size and filled with one copy per array.
+
+bool Game::loadState(const Terrain *t, const char *path)
+{
+    PROFILE_ZONE("Game::loadState");
+
+    StateReader r;
+    GameState s;
+
+    if(!r.open(path))
+        return false;
+
+    if(!r.readSection(STATE_GAME, 0, &s, 1))
+    {
+        cerr << path << " holds no game\n";
+        return false;
+    }
+
+    if(s.terrainResolution != t->getResolution() || s.terrainHash != terrainHash(t))
+    {
+        cerr << path << " was saved on another terrain\n";
+        return false;
+    }
+
+    TerrainOverlay loadedGround;
+    TargetPool loadedTargets;
+    SlotMap<Bomb, MEMORY_ENTITIES> loadedBombs;
+
+    loadedGround.attach(t);
+    loadedBombs.allocate(min(max(s.maxBombs, 1), MAX_BOMBS));
+
+    bool valid = loadedGround.loadState(r) && loadedTargets.loadState(r)
+              && loadedBombs.loadTable(r, STATE_BOMB_IDS) && loadBombs(r, loadedBombs);
+
+    if(!valid)
+    {
+        cerr << path << " is damaged\n";
+        return false;
+    }
+
+    terrain = t;
+    ground.swap(loadedGround);
+    targets.swap(loadedTargets);
+    bombs.swap(loadedBombs);
+
+    setRules(s.maxBombs, s.respawnTargets != 0, s.craters != 0);
+    reserveNearby(nearbyEstimate());
+
+    rng = s.rng;
+    balloonPosition = VECTOR3D(s.balloonX, s.balloonY, s.balloonZ);
+    tick = s.tick;
+    hitsThisTick = s.hitsThisTick;
+    targetsLeft = s.targetsLeft;
+    targetsHit = s.targetsHit;
+    viewTargets = s.viewTargets != 0;
+
+    tickArena.reset();
+    return true;
+}
+
+
+/**************************************************************************************
+ **     Bomb Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  nearbyEstimate - A bomb looks for targets in a 2 x 2 square; start every
+//                   slot with room for a few times as many as stand on one
+//                   on average.
+
+size_t Game::nearbyEstimate() const
+{
+    float side = terrain->getCellSize() * terrain->getResolution();
+    float expected = targets.getCapacity() * 4.0f / (side*side);
+
+    return (size_t)(4.0f * expected) + NEARBY_RESERVE_MIN;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  reserveNearby - Make room for n nearby targets in every bomb slot, the
+//                  spare ones included, so no list grows while it is used.
+
+void Game::reserveNearby(size_t n)
+{
+    nearbyReserve = max(nearbyReserve, n);
+
+    for(int b = 0; b < bombs.getCapacity(); ++b)
+        bombs[b].nearby.reserve(nearbyReserve);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  dropBomb - releases a bomb from the base of the balloon
+
+void Game::dropBomb()
+{
+    Bomb bomb;
+    bomb.position = balloonPosition;
+    bomb.position.y = getBalloonBaseHeight();
+
+    SlotHandle h = bombs.insert(bomb);
+
+    if(!isNullHandle(h))
+        findNearbyTargets(*bombs.get(h));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  moveBombs - lets the bombs fall by one tick and checks for hits; a bomb
+//              is gone once it reaches the ground, where it may leave a
+//              crater. The bombs are visited
+//              from the last down, so a removal never moves one that is
+//              still to be visited.
+
+void Game::moveBombs()
+{
+    for(int b = bombs.size()-1; b >= 0; --b)
+    {
+        Bomb & bomb = bombs[b];
+
+        // Change bomb height
+        if(bomb.position.y <= ground.getHeightAt(bomb.position.x, bomb.position.z))
+        {
+            if(craters)
+                ground.deform(bomb.position.x, bomb.position.z, CRATER_RADIUS, CRATER_DEPTH);
+
+            bombs.remove(bombs.handleAt(b));
+        }
+        else
+        {
+            bomb.position.y -= BOMB_SPEED;
+
+            // if there are nearby targets, check for collisions
+            if(!bomb.nearby.empty())
+                checkCollisions(bomb);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  findNearbyTargets - finds all the targets that might be hit by the falling
+//                      bomb. Each chunk of targets fills its own list; the
+//                      lists are joined in chunk order and kept as handles,
+//                      since targets move in the pool as others despawn.
+
+void Game::findNearbyTargets(Bomb & bomb)
+{
+    PROFILE_ZONE("Game::findNearbyTargets");
+
+    int n = targets.count;
+    int threads = (jobs != NULL) ? jobs->getNumThreads() : 1;
+
+    bomb.nearby.clear();
+
+    if(n == 0)
+        return;
+
+    jobBomb = &bomb;
+    chunkSize = (threads > 1) ? jobs->chunkSizeFor(n, SCAN_CHUNK_MIN, 1) : max(n, 1);
+    int chunks = (n + chunkSize - 1) / chunkSize;
+
+    chunkFound = tickArena.allocArray<int>(n);
+    chunkCount = tickArena.allocArray<int>(chunks);
+
+    if(threads > 1)
+        jobs->parallelFor(n, chunkSize, findNearbyJob, this);
+    else
+        findNearbyJob(this, 0, n);
+
+    int numNearby = 0;
+
+    for(int c = 0; c < chunks; ++c)
+        numNearby += chunkCount[c];
+
+    // The bombs take turns in the slots, so every slot gets room for the
+    // longest list so far (doubled); after a few drops none of them grows
+    if((size_t) numNearby > bomb.nearby.capacity())
+        reserveNearby(max(nearbyReserve*2, (size_t) numNearby));
+
+    bomb.nearby.resize(numNearby);
+
+    int k = 0;
+
+    for(int c = 0; c < chunks; ++c)
+    {
+        for(int j = 0; j < chunkCount[c]; ++j)
+            bomb.nearby[k++] = targets.getHandle(chunkFound[c*chunkSize + j]);
+    }
+}
+
+void Game::findNearbyJob(void *data, int begin, int end)
+{
+    Game *game = (Game*) data;
+    const TargetPool & targets = game->targets;
+    int *found = game->chunkFound + begin;
+    int numFound = 0;
+
+    float bx = game->jobBomb->position.x;
+    float bz = game->jobBomb->position.z;
+
+    for(int i = begin; i < end; ++i)
+    {
+        // Check if the target might be hit by bomb
+        if(fabs(targets.x[i] - bx) < 1.0f && fabs(targets.z[i] - bz) < 1.0f)
+        {
+            found[numFound++] = i;
+        }
+    }
+
+    game->chunkCount[begin / game->chunkSize] = numFound;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  checkCollisions - checks for collisions between the bomb and nearby
+//                    targets. The tests run in batches; the hits are then
+//                    applied in target order. A target that is already
+//                    gone (hit by another bomb) has a stale handle.
+
+void Game::checkCollisions(Bomb & bomb)
+{
+    PROFILE_ZONE("Game::checkCollisions");
+
+    int n = (int) bomb.nearby.size();
+    hitFlags = tickArena.allocArray<char>(n);
+    jobBomb = &bomb;
+
+    if(jobs != NULL && n > COLLISION_CHUNK_MIN)
+        jobs->parallelFor(n, jobs->chunkSizeFor(n, COLLISION_CHUNK_MIN, 1), collisionJob, this);
+    else
+        collisionJob(this, 0, n);
+
+    bool collision = false;
+
+    for(int i = 0; i < n; ++i)
+    {
+        if(hitFlags[i] && targets.despawn(bomb.nearby[i]))
+        {
+            collision = true;
+            targetsLeft -= 1;
+            targetsHit += 1;
+            hitsThisTick += 1;
+
+            if(respawnTargets)
+                respawnTarget();
+        }
+    }
+
+    // Clear the nearby targets if collision was detected; the bomb drops to
+    // the ground and disappears on the next tick
+    if(collision)
+    {
+        bomb.nearby.clear();
+        bomb.position.y = ground.getHeightAt(bomb.position.x, bomb.position.z);
+    }
+}
+
+void Game::collisionJob(void *data, int begin, int end)
+{
+    Game *game = (Game*) data;
+    const TargetPool & targets = game->targets;
+    const Bomb & bomb = *game->jobBomb;
+
+    for(int i = begin; i < end; ++i)
+    {
+        int t = targets.find(bomb.nearby[i]);
+
+        if(t < 0)
+        {
+            game->hitFlags[i] = false;
+            continue;
+        }
+
+        VECTOR3D v = targets.getPosition(t) - bomb.position;
+
+        bool isAboveGround = ( targets.getY(t) > (targets.meshHeight[t]-(targets.size[t]/2)) );
+
+        // If target is above ground and the bomb is touching it, record collision
+        game->hitFlags[i] = isAboveGround && fabs(v.x) < 1.0f && fabs(v.y) < 1.0f && fabs(v.z) < 1.0f;
+    }
+}
@@ -0,0 +1,209 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <cmath>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "VECTOR3D.h"
+#include "terrain.h"
+#include "overlay.h"
+#include "targets.h"
+#include "rng.h"
+#include "jobs.h"
+#include "arena.h"
+#include "slotmap.h"
+#include "savestate.h"
+
+#define SIM_TICK_MS 25              // Simulated milliseconds per step
+#define BALLOON_STEP 0.125f         // Balloon movement per arrow key press
+#define BALLOON_BASE_OFFSET 6.25f   // Distance from the balloon centre down to its basket
+#define BOMB_SPEED 0.15f            // Bomb fall per step
+#define TARGET_SIZE 1.0f            // Side length of a target cube
+#define MAX_BOMBS 64                // Most bombs the rules may allow in the air at once
+#define CRATER_RADIUS 1.5f          // Ground lowered around a bomb that lands (with craters on)
+#define CRATER_DEPTH 0.4f           // and how far at the centre
+
+#define SCAN_CHUNK_MIN 16384        // smallest slice of the targets scanned by one job
+#define COLLISION_CHUNK_MIN 1024    // smallest batch of nearby targets tested by one job
+#define NEARBY_RESERVE_MIN 16       // nearby targets every bomb slot has room for from the start
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  hashBytes / hashFloat - FNV-1a, one step at a time: start from HASH_SEED
+//                          and feed every value in. Floats are hashed by
+//                          their bits, so equal hashes mean equal states.
+
+#define HASH_SEED 2166136261u
+
+inline uint32_t hashBytes(uint32_t h, const void *data, size_t n)
+{
+    const unsigned char *p = (const unsigned char*) data;
+
+    for(size_t i = 0; i < n; ++i)
+        h = (h ^ p[i]) * 16777619u;
+
+    return h;
+}
+
+inline uint32_t hashFloat(uint32_t h, float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return hashBytes(h, &bits, sizeof(bits));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  SimInput - Everything the player did since the previous step.
+
+typedef struct SimInput {
+    int moveX;              // balloon steps along x (negative = left)
+    int moveZ;              // balloon steps along z (negative = up)
+    bool dropBomb;
+    bool toggleViewTargets;
+} SimInput;
+
+void clearInput(SimInput *input);
+
+
+// Input event kinds
+#define INPUT_KEY     0 // character key (GLUT keyboard callback)
+#define INPUT_SPECIAL 1 // special key (GLUT special key callback)
+
+// Special keys the game reacts to (same values as GLUT_KEY_*)
+#define SIM_KEY_F6    6
+#define SIM_KEY_LEFT  100
+#define SIM_KEY_UP    101
+#define SIM_KEY_RIGHT 102
+#define SIM_KEY_DOWN  103
+
+///////////////////////////////////////////////////////////////////////////////
+//  InputEvent - One key press, as recorded and replayed.
+
+typedef struct InputEvent {
+    unsigned char kind; // INPUT_KEY or INPUT_SPECIAL
+    unsigned char code; // character, or special key code
+} InputEvent;
+
+void applyInputEvent(SimInput *input, const InputEvent & e); // add a key press to the input record
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  Bomb - A falling bomb and the targets that were below it when it was
+//         dropped. The handles go stale when another bomb gets there first.
+
+typedef struct Bomb {
+    VECTOR3D position;
+    std::vector<SlotHandle, TrackedAllocator<SlotHandle, MEMORY_ENTITIES> > nearby;
+} Bomb;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  Game - The game state and rules, without any OpenGL or GLUT calls. The
+//         window version calls step() from a GLUT timer; the headless
+//         runner calls it in a loop.
+//
+//         With a job system, the target update, the scan for targets below
+//         a new bomb and the collision tests are split into jobs. Their
+//         results are merged in target order, so the score is the same as
+//         a serial run.
+//
+//         Three rules can be changed before initGame(): how many bombs may
+//         fall at once (one by default), whether every target that is hit
+//         is replaced by a new one somewhere else, for a game without an
+//         end, and whether bombs leave craters.
+//
+//         The terrain is only read, so several games may share one. Each
+//         game sees it through its own overlay, which keeps the craters.
+//
+//         A game can be saved at any tick and loaded back into another
+//         Game, which then steps exactly as the original would have (see
+//         savestate.h for the file).
+
+class Game
+{
+    public:
+
+        const Terrain *terrain; // the shared base
+        TerrainOverlay ground;  // the terrain with this game's craters
+
+        // Balloon
+        VECTOR3D balloonPosition;
+
+        // Targets
+        TargetPool targets;
+        int targetsLeft;
+
+        // Bombs in the air
+        SlotMap<Bomb, MEMORY_ENTITIES> bombs;
+
+        // Flags
+        bool viewTargets;   // show all targets and freeze them
+
+        unsigned int tick;  // number of steps taken
+        int hitsThisTick;   // targets destroyed by the last step
+
+        Game();
+
+        void setRules(int maxBombs, bool respawnTargets, bool craters); // maxBombs from 1 to MAX_BOMBS
+        void initGame(const Terrain *t, int numTargets, unsigned int seed);
+        void setJobSystem(JobSystem *j); // NULL (the default) runs each tick on the calling thread
+        void step(const SimInput & input);
+
+        float getBalloonBaseHeight() const;
+        bool canDropBomb() const { return bombs.size() < maxBombs; }
+        int getTargetsHit() const { return targetsHit; }
+        uint32_t stateHash() const; // hash of everything step() can change
+
+        // Write everything step() reads or changes to a save state file, or
+        // continue the game saved in one. Loading replaces initGame(): the
+        // terrain must be generated as it was for the saved game (this is
+        // checked). If false is returned, the game is left as it was.
+        bool saveState(const char *path) const;
+        bool loadState(const Terrain *t, const char *path);
+
+
+    protected:
+
+        Rng rng;
+
+        int maxBombs;
+        bool respawnTargets;
+        bool craters;
+        int targetsHit;
+
+        // Transient lists live in an arena instead of the heap; it is reset
+        // at the start of every step
+        FrameArena tickArena;
+
+        JobSystem *jobs;
+        size_t nearbyReserve; // room kept in every bomb slot's nearby list
+        Bomb *jobBomb;   // the bomb the jobs work for
+        int chunkSize;
+        int *chunkFound; // scan results, chunk k writes from k*chunkSize on (tickArena)
+        int *chunkCount; // number of targets found by each scan chunk (tickArena)
+        char *hitFlags;  // collision test result per nearby target (tickArena)
+
+        static void findNearbyJob(void *data, int begin, int end);
+        static void collisionJob(void *data, int begin, int end);
+
+        void respawnTarget();
+
+        // Bomb Functions
+        size_t nearbyEstimate() const; // room for the nearby targets of one bomb, from the target density
+        void reserveNearby(size_t n);
+        void dropBomb();
+        void moveBombs();
+        void findNearbyTargets(Bomb & bomb);
+        void checkCollisions(Bomb & bomb);
+
+    private:
+
+        Game(const Game &);            // not copyable
+        Game & operator=(const Game &);
+};
+
+
+#endif
@@ -0,0 +1,294 @@
+#include "generator.h"
+#include "vecsimd.h"
+
+#include <iostream>
+
+using namespace std;
+
+// Unit gradient directions picked by the lattice hash
+static const float gradX[8] = { 1.0f, 0.70710678f, 0.0f, -0.70710678f, -1.0f, -0.70710678f,  0.0f,  0.70710678f };
+static const float gradZ[8] = { 0.0f, 0.70710678f, 1.0f,  0.70710678f,  0.0f, -0.70710678f, -1.0f, -0.70710678f };
+
+// 2d gradient noise lies in about [-0.7, 0.7]; this maps the fBm sum into [0, 1]
+#define NOISE_RANGE 0.7f
+
+
+/**************************************************************************************
+ **     Blob Generator
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  addBlob - Adds a new blob to the terrain
+
+void BlobGenerator::addBlob(Blob b)
+{
+    blobs.push_back(b);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  clearBlobs - Removes all blobs
+
+void BlobGenerator::clearBlobs()
+{
+    blobs.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getNumBlobs - returns the number of blobs
+
+int BlobGenerator::getNumBlobs() const
+{
+    return (int) blobs.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  generateRow - Sum the Gaussian of every blob over the row. The terrain is
+//      h = H*exp(-w*d^2) per blob, so dh/dx = -2*w*(x-bx)*h (likewise for z).
+
+void BlobGenerator::generateRow(const float *x, float z, int count,
+                                float *height, float *dhdx, float *dhdz)
+{
+    for(int i = 0; i < count; ++i)
+        height[i] = 0.0f;
+
+    if(dhdx != NULL)
+    {
+        for(int i = 0; i < count; ++i)
+            dhdx[i] = dhdz[i] = 0.0f;
+    }
+
+    for(size_t b = 0; b < blobs.size(); ++b)
+    {
+        const Blob &blob = blobs[b];
+        float dz = z - blob.position.z;
+
+        for(int i = 0; i < count; ++i)
+        {
+            float dx = x[i] - blob.position.x;
+            float h = blob.height * exp((-blob.width)*(dx*dx + dz*dz));
+
+            height[i] += h;
+
+            if(dhdx != NULL)
+            {
+                dhdx[i] += -2.0f * blob.width * dx * h;
+                dhdz[i] += -2.0f * blob.width * dz * h;
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  print - Prints properties of all blobs to the command prompt.
+
+void BlobGenerator::print() const
+{
+    for(size_t i = 0; i < blobs.size(); ++i)
+    {
+        const Blob &blob = blobs[i];
+        cout << "x=" << blob.position.x
+             << "\t y=" << blob.position.y
+             << "\t z=" << blob.position.z
+             << "\t h=" << blob.height
+             << "\t w=" << blob.width
+             << "\n";
+    }
+}
+
+
+/**************************************************************************************
+ **     Noise Generator
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  latticeHash - hashes a lattice point to one of the 8 gradient directions
+
+static inline int latticeHash(int ix, int iz, unsigned int seed)
+{
+    unsigned int h = (unsigned int) ix * 374761393u + (unsigned int) iz * 668265263u + seed * 2246822519u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    h ^= h >> 16;
+    return (int)(h & 7);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  NoiseGenerator - Default parameters give a few broad hills over a 64
+//                   unit map with smaller detail on top.
+
+NoiseGenerator::NoiseGenerator(unsigned int s)
+{
+    seed = s;
+    octaves = 5;
+    frequency = 1.0f / 16.0f;
+    amplitude = 12.0f;
+    lacunarity = 2.0f;
+    gain = 0.5f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  generateRow - Sum the octaves, then map the result into [0, amplitude].
+
+void NoiseGenerator::generateRow(const float *x, float z, int count,
+                                 float *height, float *dhdx, float *dhdz)
+{
+    if((int) sum.size() < count)
+    {
+        fx.resize(count);
+        g00x.resize(count); g00z.resize(count); g10x.resize(count); g10z.resize(count);
+        g01x.resize(count); g01z.resize(count); g11x.resize(count); g11z.resize(count);
+        sum.resize(count); sumDx.resize(count); sumDz.resize(count);
+    }
+
+    for(int i = 0; i < count; ++i)
+        sum[i] = sumDx[i] = sumDz[i] = 0.0f;
+
+    float freq = frequency;
+    float amp = 1.0f;
+    float ampSum = 0.0f;
+
+    for(int o = 0; o < octaves; ++o)
+    {
+        addOctave(x, z, count, freq, amp, seed + o*1013u);
+        ampSum += amp;
+        freq *= lacunarity;
+        amp *= gain;
+    }
+
+    float scale = amplitude * 0.5f / (NOISE_RANGE * ampSum);
+
+    for(int i = 0; i < count; ++i)
+    {
+        height[i] = amplitude * 0.5f + sum[i] * scale;
+
+        if(dhdx != NULL)
+        {
+            dhdx[i] = sumDx[i] * scale;
+            dhdz[i] = sumDz[i] * scale;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  addOctave - Accumulate one octave of gradient noise and its derivatives.
+//      The lattice lookups are scalar; the interpolation runs on whole SIMD
+//      registers. With corner values a,b,c,d and quintic fades u(fx), v(fz):
+//          n = a + u(b-a) + v(c-a) + uv(a-b-c+d)
+//      Since z is constant along a row, v and dv/dz are scalars.
+
+void NoiseGenerator::addOctave(const float *x, float z, int count, float freq, float amp, unsigned int octaveSeed)
+{
+    // Row values (constant z)
+    float pz = z * freq;
+    float fzFloor = floor(pz);
+    int iz = (int) fzFloor;
+    float fz = pz - fzFloor;
+    float v  = fz*fz*fz*(fz*(fz*6.0f - 15.0f) + 10.0f);
+    float dv = 30.0f*fz*fz*(fz - 1.0f)*(fz - 1.0f);
+
+    // Lattice pass: cell fraction and corner gradients for every point
+    for(int i = 0; i < count; ++i)
+    {
+        float px = x[i] * freq;
+        float pxFloor = floor(px);
+        int ix = (int) pxFloor;
+        fx[i] = px - pxFloor;
+
+        int h00 = latticeHash(ix,   iz,   octaveSeed);
+        int h10 = latticeHash(ix+1, iz,   octaveSeed);
+        int h01 = latticeHash(ix,   iz+1, octaveSeed);
+        int h11 = latticeHash(ix+1, iz+1, octaveSeed);
+
+        g00x[i] = gradX[h00]; g00z[i] = gradZ[h00];
+        g10x[i] = gradX[h10]; g10z[i] = gradZ[h10];
+        g01x[i] = gradX[h01]; g01z[i] = gradZ[h01];
+        g11x[i] = gradX[h11]; g11z[i] = gradZ[h11];
+    }
+
+    float ampFreq = amp * freq; // d/dx of octave(freq*x) scales by freq
+    int i = 0;
+
+#if VECSIMD_WIDTH > 1
+    const vfloat one = vset1(1.0f);
+    const vfloat vFz = vset1(fz), vFz1 = vset1(fz - 1.0f);
+    const vfloat vV = vset1(v), vDv = vset1(dv);
+    const vfloat vAmp = vset1(amp), vAmpFreq = vset1(ampFreq);
+
+    for(; i + VECSIMD_WIDTH <= count; i += VECSIMD_WIDTH)
+    {
+        vfloat tx = vload(&fx[i]);
+        vfloat tx1 = vsub(tx, one);
+        vfloat ax = vload(&g00x[i]), az = vload(&g00z[i]);
+        vfloat bx = vload(&g10x[i]), bz = vload(&g10z[i]);
+        vfloat cx = vload(&g01x[i]), cz = vload(&g01z[i]);
+        vfloat dx = vload(&g11x[i]), dz = vload(&g11z[i]);
+
+        // Corner contributions
+        vfloat a = vadd(vmul(ax, tx),  vmul(az, vFz));
+        vfloat b = vadd(vmul(bx, tx1), vmul(bz, vFz));
+        vfloat c = vadd(vmul(cx, tx),  vmul(cz, vFz1));
+        vfloat d = vadd(vmul(dx, tx1), vmul(dz, vFz1));
+
+        // Quintic fade and its derivative
+        vfloat tx2 = vmul(tx, tx);
+        vfloat u  = vmul(vmul(tx2, tx), vadd(vmul(tx, vsub(vmul(tx, vset1(6.0f)), vset1(15.0f))), vset1(10.0f)));
+        vfloat du = vmul(vmul(vset1(30.0f), tx2), vmul(tx1, tx1));
+        vfloat uv = vmul(u, vV);
+
+        vfloat ba = vsub(b, a);
+        vfloat ca = vsub(c, a);
+        vfloat k  = vsub(vsub(a, b), vsub(c, d));
+
+        vfloat n = vadd(vadd(a, vmul(u, ba)), vadd(vmul(vV, ca), vmul(uv, k)));
+
+        vfloat nx = vadd(vadd(ax, vmul(u, vsub(bx, ax))), vadd(vmul(vV, vsub(cx, ax)), vmul(uv, vsub(vsub(ax, bx), vsub(cx, dx)))));
+        nx = vadd(nx, vmul(du, vadd(ba, vmul(vV, k))));
+
+        vfloat nz = vadd(vadd(az, vmul(u, vsub(bz, az))), vadd(vmul(vV, vsub(cz, az)), vmul(uv, vsub(vsub(az, bz), vsub(cz, dz)))));
+        nz = vadd(nz, vmul(vDv, vadd(ca, vmul(u, k))));
+
+        vstore(&sum[i],   vadd(vload(&sum[i]),   vmul(vAmp, n)));
+        vstore(&sumDx[i], vadd(vload(&sumDx[i]), vmul(vAmpFreq, nx)));
+        vstore(&sumDz[i], vadd(vload(&sumDz[i]), vmul(vAmpFreq, nz)));
+    }
+#endif
+
+    // Scalar remainder
+    for(; i < count; ++i)
+    {
+        float tx = fx[i];
+        float tx1 = tx - 1.0f;
+
+        float a = g00x[i]*tx  + g00z[i]*fz;
+        float b = g10x[i]*tx1 + g10z[i]*fz;
+        float c = g01x[i]*tx  + g01z[i]*(fz - 1.0f);
+        float d = g11x[i]*tx1 + g11z[i]*(fz - 1.0f);
+
+        float u  = tx*tx*tx*(tx*(tx*6.0f - 15.0f) + 10.0f);
+        float du = 30.0f*tx*tx*tx1*tx1;
+        float k  = a - b - c + d;
+
+        float n  = a + u*(b - a) + v*(c - a) + u*v*k;
+        float nx = g00x[i] + u*(g10x[i] - g00x[i]) + v*(g01x[i] - g00x[i]) + u*v*(g00x[i] - g10x[i] - g01x[i] + g11x[i]) + du*((b - a) + v*k);
+        float nz = g00z[i] + u*(g10z[i] - g00z[i]) + v*(g01z[i] - g00z[i]) + u*v*(g00z[i] - g10z[i] - g01z[i] + g11z[i]) + dv*((c - a) + u*k);
+
+        sum[i]   += amp * n;
+        sumDx[i] += ampFreq * nx;
+        sumDz[i] += ampFreq * nz;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  print - Prints the noise parameters to the command prompt.
+
+void NoiseGenerator::print() const
+{
+    cout << "seed=" << seed
+         << "\t octaves=" << octaves
+         << "\t frequency=" << frequency
+         << "\t amplitude=" << amplitude
+         << "\t lacunarity=" << lacunarity
+         << "\t gain=" << gain
+         << "\n";
+}
@@ -0,0 +1,100 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <cmath>
+#include <vector>
+
+#include "VECTOR3D.h"
+#include "memtrack.h"
+
+
+typedef struct Blob {
+    VECTOR3D position;
+
+    float width;
+    float height;
+} Blob;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  TerrainGenerator - A source of terrain heights. The mesh is filled one
+//                     grid row (constant z) at a time; a generator returns
+//                     the height and, when asked for, its x/z gradient.
+
+class TerrainGenerator
+{
+    public:
+
+        virtual ~TerrainGenerator() {}
+
+        // Evaluate count points (x[i], z). dhdx/dhdz may be NULL when no
+        // normals are needed.
+        virtual void generateRow(const float *x, float z, int count,
+                                 float *height, float *dhdx, float *dhdz) = 0;
+
+        virtual const char *getName() const = 0;
+        virtual void print() const = 0; // print the generator's properties
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  BlobGenerator - The original terrain: a sum of Gaussian blobs.
+//                  Cost per vertex grows with the number of blobs.
+
+class BlobGenerator : public TerrainGenerator
+{
+    public:
+
+        void addBlob(Blob b);
+        void clearBlobs();
+        int getNumBlobs() const;
+
+        void generateRow(const float *x, float z, int count,
+                         float *height, float *dhdx, float *dhdz);
+
+        const char *getName() const { return "blobs"; }
+        void print() const;
+
+    protected:
+
+        std::vector<Blob, TrackedAllocator<Blob, MEMORY_TERRAIN> > blobs;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  NoiseGenerator - Fractal Brownian motion over 2d gradient noise, evaluated
+//                   a whole row at a time with the SIMD path of vecsimd.h.
+//                   Cost per vertex is fixed by the number of octaves.
+
+class NoiseGenerator : public TerrainGenerator
+{
+    public:
+
+        NoiseGenerator(unsigned int seed);
+
+        unsigned int seed;
+        int octaves;       // number of noise layers summed
+        float frequency;   // lattice cells per world unit of the first octave
+        float amplitude;   // height range of the terrain
+        float lacunarity;  // frequency multiplier per octave
+        float gain;        // amplitude multiplier per octave
+
+        void generateRow(const float *x, float z, int count,
+                         float *height, float *dhdx, float *dhdz);
+
+        const char *getName() const { return "noise"; }
+        void print() const;
+
+    protected:
+
+        typedef std::vector<float, TrackedAllocator<float, MEMORY_TERRAIN> > Row;
+
+        // Per-row scratch arrays: cell fraction and the corner gradients
+        Row fx, g00x, g00z, g10x, g10z, g01x, g01z, g11x, g11z;
+        Row sum, sumDx, sumDz;
+
+        void addOctave(const float *x, float z, int count, float freq, float amp, unsigned int octaveSeed);
+};
+
+
+#endif
@@ -0,0 +1,421 @@
+//  headless - runs the game simulation without a window, driven by a script
+//             or by random input, and reports the simulated ticks per second.
+//
+//  Build (from the repository root):
+//      g++ -O2 -mavx headless/headless.cpp game.cpp overlay.cpp savestate.cpp terrain.cpp generator.cpp targets.cpp timerwheel.cpp vecbatch.cpp replay.cpp jobs.cpp arena.cpp allocstats.cpp profiler.cpp memtrack.cpp heightfield.cpp -pthread -o headless_sim
+//
+//  Usage:
+//      headless_sim [--ticks N] [--targets N] [--seed S] [--noise] [--compact] [--threads N]
+//                   [--bombs N] [--respawn] [--craters] [--script FILE | --random] [--record FILE]
+//                   [--load FILE] [--save FILE] [--budget TAG=SIZE]...
+//      headless_sim --replay FILE [--ticks N] [--threads N]
+//
+//  A script has one "<tick> <action>" pair per line, where action is one of
+//  left, right, up, down, drop or view. Blank lines and lines starting with
+//  '#' are ignored. Lines must be sorted by tick.
+//
+//  --record writes the run as a replay file (see replay.h); --replay runs
+//  one, from the window version or from here, and checks the game state
+//  hash after every tick. A replay that diverges exits with status 2.
+//
+//  --compact generates the terrain as a CompactHeightfield (see terrain.h).
+//
+//  --bombs lets up to N bombs fall at once (1 by default); with --respawn
+//  every target that is hit is replaced by a new one, so the targets never
+//  run out, and with --craters the bombs that land dent the ground (see
+//  Game::setRules). All three are stored in a recording.
+//
+//  --save writes the game as it is after the run to a save state (see
+//  savestate.h), and --load starts from one instead of a new game, so a
+//  scenario can be forked from the middle of a long run. The terrain
+//  options (--seed, --noise, --compact) must be the ones it was saved
+//  with; the rules and targets come from the file. A loaded run cannot be
+//  recorded, since a replay starts from a new game.
+//
+//  --threads sets the number of job system threads (0 = one per hardware
+//  thread); the results are the same for any thread count.
+//
+//  After the run the memory held by each subsystem is printed (see
+//  memtrack.h); --budget terrain=64M, for example, warns when the terrain
+//  goes over 64 MB. It may be given once per tag.
+//
+//  Built with -DENABLE_PROFILER, --profile FILE writes the profiler zones
+//  of the run as a Chrome trace.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "../game.h"
+#include "../replay.h"
+#include "../allocstats.h"
+#include "../profiler.h"
+#include "../memtrack.h"
+
+#define DEFAULT_TICKS 100000
+#define DEFAULT_TARGETS 10
+#define WARMUP_TICKS 1000 // heap allocations are reported separately after these
+
+
+// One scripted input event
+typedef struct ScriptEvent {
+    unsigned int tick;
+    char action[16];
+} ScriptEvent;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  loadScript - Read the events from a script file. Returns false on error.
+
+static bool loadScript(const char *path, std::vector<ScriptEvent> & events)
+{
+    FILE *f = fopen(path, "r");
+
+    if(f == NULL)
+    {
+        fprintf(stderr, "headless: cannot open script %s\n", path);
+        return false;
+    }
+
+    char line[256];
+    int lineNumber = 0;
+
+    while(fgets(line, sizeof(line), f) != NULL)
+    {
+        lineNumber++;
+
+        if(line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+            continue;
+
+        ScriptEvent e;
+
+        if(sscanf(line, "%u %15s", &e.tick, e.action) != 2)
+        {
+            fprintf(stderr, "headless: %s:%d: expected \"<tick> <action>\"\n", path, lineNumber);
+            fclose(f);
+            return false;
+        }
+
+        events.push_back(e);
+    }
+
+    fclose(f);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  actionEvent - The key press for a named script action. Returns false for
+//                an unknown action.
+
+static bool actionEvent(const char *action, InputEvent *e)
+{
+    e->kind = INPUT_SPECIAL;
+
+    if(strcmp(action, "left") == 0)       e->code = SIM_KEY_LEFT;
+    else if(strcmp(action, "right") == 0) e->code = SIM_KEY_RIGHT;
+    else if(strcmp(action, "up") == 0)    e->code = SIM_KEY_UP;
+    else if(strcmp(action, "down") == 0)  e->code = SIM_KEY_DOWN;
+    else if(strcmp(action, "view") == 0)  e->code = SIM_KEY_F6;
+    else if(strcmp(action, "drop") == 0)
+    {
+        e->kind = INPUT_KEY;
+        e->code = ' ';
+    }
+    else return false;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  randomEvents - A player mashing keys: mostly flying around, dropping a
+//                 bomb now and then.
+
+static void randomEvents(Rng & rng, std::vector<InputEvent> & events)
+{
+    static const unsigned char moves[4] = { SIM_KEY_LEFT, SIM_KEY_RIGHT, SIM_KEY_UP, SIM_KEY_DOWN };
+
+    int r = rng.nextInt(64);
+    InputEvent e;
+
+    if(r < 32)
+    {
+        e.kind = INPUT_SPECIAL;
+        e.code = moves[r / 8];
+        events.push_back(e);
+    }
+    else if(r < 34)
+    {
+        e.kind = INPUT_KEY;
+        e.code = ' ';
+        events.push_back(e);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned int ticks = DEFAULT_TICKS;
+    bool ticksGiven = false;
+    int numTargets = DEFAULT_TARGETS;
+    unsigned int seed = 1;
+    const char *scriptPath = NULL;
+    const char *recordPath = NULL;
+    const char *replayPath = NULL;
+    const char *loadPath = NULL;
+    const char *savePath = NULL;
+    bool randomMode = false;
+    bool useNoise = false;
+    bool useCompact = false;
+    int maxBombs = 1;
+    bool respawn = false;
+    bool craters = false;
+    int numThreads = 1;
+    const char *profilePath = NULL;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--ticks") == 0 && i+1 < argc)
+        {
+            ticks = (unsigned int) strtoul(argv[++i], NULL, 10);
+            ticksGiven = true;
+        }
+        else if(strcmp(argv[i], "--targets") == 0 && i+1 < argc)
+            numTargets = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--seed") == 0 && i+1 < argc)
+            seed = (unsigned int) strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--script") == 0 && i+1 < argc)
+            scriptPath = argv[++i];
+        else if(strcmp(argv[i], "--record") == 0 && i+1 < argc)
+            recordPath = argv[++i];
+        else if(strcmp(argv[i], "--replay") == 0 && i+1 < argc)
+            replayPath = argv[++i];
+        else if(strcmp(argv[i], "--load") == 0 && i+1 < argc)
+            loadPath = argv[++i];
+        else if(strcmp(argv[i], "--save") == 0 && i+1 < argc)
+            savePath = argv[++i];
+        else if(strcmp(argv[i], "--threads") == 0 && i+1 < argc)
+            numThreads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--profile") == 0 && i+1 < argc)
+            profilePath = argv[++i];
+        else if(strcmp(argv[i], "--budget") == 0 && i+1 < argc)
+        {
+            if(!parseMemoryBudget(argv[++i]))
+            {
+                fprintf(stderr, "headless: bad budget %s (tags: terrain, textures, entities, transient)\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "--random") == 0)
+            randomMode = true;
+        else if(strcmp(argv[i], "--noise") == 0)
+            useNoise = true;
+        else if(strcmp(argv[i], "--compact") == 0)
+            useCompact = true;
+        else if(strcmp(argv[i], "--bombs") == 0 && i+1 < argc)
+            maxBombs = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--respawn") == 0)
+            respawn = true;
+        else if(strcmp(argv[i], "--craters") == 0)
+            craters = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--ticks N] [--targets N] [--seed S] [--noise] [--compact] [--threads N] [--bombs N] [--respawn] [--craters] [--script FILE | --random] [--record FILE] [--replay FILE] [--load FILE] [--save FILE] [--budget TAG=SIZE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(loadPath != NULL && (recordPath != NULL || replayPath != NULL))
+    {
+        fprintf(stderr, "headless: --load cannot be combined with --record or --replay\n");
+        return 1;
+    }
+
+    std::vector<ScriptEvent> script;
+
+    if(scriptPath != NULL && !loadScript(scriptPath, script))
+        return 1;
+
+    // A replay brings its own world and runs to its end
+    InputReplay replay;
+
+    if(replayPath != NULL)
+    {
+        if(!replay.open(replayPath))
+            return 1;
+
+        seed = replay.getHeader().seed;
+        numTargets = replay.getHeader().numTargets;
+        useNoise = (replay.getHeader().flags & REPLAY_FLAG_NOISE) != 0;
+        useCompact = (replay.getHeader().flags & REPLAY_FLAG_COMPACT) != 0;
+        respawn = (replay.getHeader().flags & REPLAY_FLAG_RESPAWN) != 0;
+        craters = (replay.getHeader().flags & REPLAY_FLAG_CRATERS) != 0;
+        maxBombs = replay.getHeader().maxBombs;
+
+        if(!ticksGiven)
+            ticks = 0xffffffffu;
+    }
+
+    InputRecorder recorder;
+
+    if(recordPath != NULL)
+    {
+        ReplayHeader header = { seed, (unsigned int) numTargets, (unsigned char)((useNoise ? REPLAY_FLAG_NOISE : 0) |
+                                                                          (useCompact ? REPLAY_FLAG_COMPACT : 0) |
+                                                                          (respawn ? REPLAY_FLAG_RESPAWN : 0) |
+                                                                          (craters ? REPLAY_FLAG_CRATERS : 0)),
+                                (unsigned char) std::min(std::max(maxBombs, 1), MAX_BOMBS) };
+
+        if(!recorder.open(recordPath, header))
+            return 1;
+    }
+
+    // Build the world (every random choice derives from the seed)
+    Terrain terrain;
+    NoiseGenerator noiseTerrain(deriveSeed(seed, RNG_STREAM_NOISE));
+
+    if(useNoise)
+        terrain.setGenerator(&noiseTerrain);
+
+    terrain.setSeed(seed);
+    terrain.setCompact(useCompact);
+    terrain.initTerrain(MESH_RESOLUTION, MESH_RESOLUTION);
+
+    Game game;
+
+    if(loadPath != NULL)
+    {
+        std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+
+        if(!game.loadState(&terrain, loadPath))
+            return 1;
+
+        double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+        printf("loaded:           %s at tick %u (%.1f ms)\n", loadPath, game.tick, loadSeconds * 1000.0);
+    }
+    else
+    {
+        game.setRules(maxBombs, respawn, craters);
+        game.initGame(&terrain, numTargets, seed);
+    }
+
+    JobSystem jobs;
+    jobs.start(numThreads);
+    game.setJobSystem(&jobs);
+
+    // Run the simulation
+    Rng inputRng(seed, RNG_STREAM_INPUT);
+    std::vector<InputEvent> events;
+    SimInput input;
+    size_t next = 0;
+    int bombsDropped = 0;
+    uint32_t expectedHash = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    long long allocationsAtStart = heapAllocations();
+    long long allocationsAfterWarmup = allocationsAtStart;
+    unsigned int t;
+
+    for(t = 0; t < ticks; ++t)
+    {
+        if(t == WARMUP_TICKS)
+            allocationsAfterWarmup = heapAllocations();
+
+        events.clear();
+
+        if(replay.isOpen())
+        {
+            if(!replay.readTick(events, &expectedHash))
+                break;
+        }
+
+        for(; next < script.size() && script[next].tick <= t; ++next)
+        {
+            InputEvent e;
+
+            if(actionEvent(script[next].action, &e))
+                events.push_back(e);
+            else
+                fprintf(stderr, "headless: tick %u: unknown action \"%s\"\n", script[next].tick, script[next].action);
+        }
+
+        if(randomMode)
+            randomEvents(inputRng, events);
+
+        clearInput(&input);
+
+        for(size_t k = 0; k < events.size(); ++k)
+            applyInputEvent(&input, events[k]);
+
+        if(input.dropBomb && game.canDropBomb())
+            bombsDropped++;
+
+        game.step(input);
+
+        if(recorder.isOpen())
+            recorder.recordTick(events, game.stateHash());
+
+        if(replay.isOpen() && game.stateHash() != expectedHash)
+        {
+            printf("replay diverged at tick %u\n", t);
+            return 2;
+        }
+    }
+
+    ticks = t;
+    long long allocationsAtEnd = heapAllocations();
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    // Report
+    double ticksPerSecond = (seconds > 0.0) ? ticks / seconds : 0.0;
+    double realTime = ticksPerSecond * SIM_TICK_MS / 1000.0;
+
+    printf("ticks:            %u (%.1f s of game time)\n", ticks, ticks * SIM_TICK_MS / 1000.0);
+    printf("threads:          %d\n", jobs.getNumThreads());
+    printf("wall time:        %.3f s\n", seconds);
+    printf("ticks/sec:        %.0f (%.0fx real time)\n", ticksPerSecond, realTime);
+    printf("bombs dropped:    %d\n", bombsDropped);
+    printf("targets hit:      %d (%d left)\n", game.getTargetsHit(), game.targetsLeft);
+    printf("targets active:   %d, parked: %d\n", game.targets.getActiveCount(), game.targets.getParkedCount());
+    printf("heap allocations: %lld (%lld after tick %d)\n", allocationsAtEnd - allocationsAtStart,
+           (ticks > WARMUP_TICKS) ? allocationsAtEnd - allocationsAfterWarmup : 0, WARMUP_TICKS);
+    printf("state hash:       %08x\n", (unsigned int) game.stateHash());
+    printf("\n");
+    printMemoryReport(stdout);
+
+    if(replay.isOpen())
+        printf("replay:           matched every tick\n");
+
+    if(savePath != NULL)
+    {
+        std::chrono::steady_clock::time_point saveStart = std::chrono::steady_clock::now();
+
+        if(!game.saveState(savePath))
+        {
+            fprintf(stderr, "headless: cannot write %s\n", savePath);
+            return 1;
+        }
+
+        double saveSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - saveStart).count();
+        printf("saved:            %s at tick %u (%.1f ms)\n", savePath, game.tick, saveSeconds * 1000.0);
+    }
+
+    if(profilePath != NULL)
+    {
+#if defined(ENABLE_PROFILER)
+        if(profilerExport(profilePath))
+            printf("profile:          %s\n", profilePath);
+        else
+            fprintf(stderr, "headless: cannot write %s\n", profilePath);
+#else
+        fprintf(stderr, "headless: --profile needs a build with -DENABLE_PROFILER\n");
+#endif
+    }
+
+    return 0;
+}
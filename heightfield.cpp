@@ -0,0 +1,184 @@
+#include "heightfield.h"
+
+#include <algorithm>
+
+using namespace std;
+
+#define HEIGHT_STEPS 65535.0f // largest quantized height
+#define NORMAL_STEPS 255.0f   // largest quantized octahedral coordinate
+
+
+/**************************************************************************************
+ **     Public Compact Heightfield Functions
+ **
+ **************************************************************************************/
+
+CompactHeightfield::CompactHeightfield() : resolution(0), stride(0), tilesPerRow(0),
+                                           cornerX(0), cornerZ(0), delta(0),
+                                           heights(NULL), normals(NULL), tiles(NULL)
+{
+}
+
+CompactHeightfield::~CompactHeightfield()
+{
+    release();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  allocate - Set up the grid; x and z match Terrain's vertex placement.
+
+void CompactHeightfield::allocate(int dim, float sideWidth)
+{
+    release();
+
+    resolution = dim;
+    stride = dim+1;
+    tilesPerRow = (stride + HEIGHTFIELD_TILE - 1) >> HEIGHTFIELD_TILE_BITS;
+
+    cornerX = -(sideWidth/2);
+    cornerZ = -(sideWidth/2);
+    delta = sideWidth/dim;
+
+    size_t count = (size_t) stride * stride;
+
+    heights = (uint16_t*) trackedCalloc(MEMORY_TERRAIN, count, sizeof(uint16_t));
+    normals = (uint16_t*) trackedAlloc(MEMORY_TERRAIN, count * sizeof(uint16_t));
+    tiles = (Tile*) trackedCalloc(MEMORY_TERRAIN, (size_t) tilesPerRow * tilesPerRow, sizeof(Tile));
+
+    uint16_t up = encodeNormal(VECTOR3D(0.0f, 1.0f, 0.0f));
+
+    for(size_t i = 0; i < count; ++i)
+        normals[i] = up;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  packRows - Quantize a band of tile rows: find each tile's height range,
+//             then store every height as a 16-bit step within it.
+
+void CompactHeightfield::packRows(int firstRow, int count, const float *h, const VECTOR3D *n)
+{
+    int tileRow = firstRow >> HEIGHTFIELD_TILE_BITS;
+
+    for(int tc = 0; tc < tilesPerRow; ++tc)
+    {
+        int colBegin = tc << HEIGHTFIELD_TILE_BITS;
+        int colEnd = min(colBegin + HEIGHTFIELD_TILE, stride);
+
+        float low = h[colBegin];
+        float high = low;
+
+        for(int r = 0; r < count; ++r)
+        {
+            for(int c = colBegin; c < colEnd; ++c)
+            {
+                low = min(low, h[(size_t) r * stride + c]);
+                high = max(high, h[(size_t) r * stride + c]);
+            }
+        }
+
+        Tile & t = tiles[tileRow * tilesPerRow + tc];
+        t.offset = low;
+        t.scale = (high - low) / HEIGHT_STEPS;
+
+        float toSteps = (high > low) ? HEIGHT_STEPS / (high - low) : 0.0f;
+
+        for(int r = 0; r < count; ++r)
+        {
+            for(int c = colBegin; c < colEnd; ++c)
+            {
+                float steps = (h[(size_t) r * stride + c] - low) * toSteps;
+                heights[(size_t)(firstRow + r) * stride + c] = (uint16_t) min(steps + 0.5f, HEIGHT_STEPS);
+            }
+        }
+    }
+
+    for(int r = 0; r < count; ++r)
+        for(int c = 0; c < stride; ++c)
+            normals[(size_t)(firstRow + r) * stride + c] = encodeNormal(n[(size_t) r * stride + c]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  expandRow - Decode a row back into vertices and normals.
+
+void CompactHeightfield::expandRow(int row, VECTOR3D *v, VECTOR3D *n) const
+{
+    float z = getZ(row);
+
+    for(int c = 0; c < stride; ++c)
+    {
+        v[c] = VECTOR3D(getX(c), getHeight(row, c), z);
+        n[c] = getNormal(row, c);
+    }
+}
+
+size_t CompactHeightfield::getBytes() const
+{
+    return (size_t) stride * stride * 2 * sizeof(uint16_t) + (size_t) tilesPerRow * tilesPerRow * sizeof(Tile);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  encodeNormal - Project the unit normal onto the octahedron |x|+|y|+|z| = 1
+//                 and unfold it into the square [-1,1]^2 seen from +y; the
+//                 lower half folds over the diagonals. u lands in the low
+//                 byte, v in the high byte.
+
+uint16_t CompactHeightfield::encodeNormal(const VECTOR3D & n)
+{
+    float sum = fabs(n.x) + fabs(n.y) + fabs(n.z);
+
+    if(sum == 0.0f)
+        return encodeNormal(VECTOR3D(0.0f, 1.0f, 0.0f));
+
+    float u = n.x / sum;
+    float v = n.z / sum;
+
+    if(n.y < 0.0f)
+    {
+        float foldU = (1.0f - fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float foldV = (1.0f - fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = foldU;
+        v = foldV;
+    }
+
+    int qu = (int)((u * 0.5f + 0.5f) * NORMAL_STEPS + 0.5f);
+    int qv = (int)((v * 0.5f + 0.5f) * NORMAL_STEPS + 0.5f);
+
+    return (uint16_t)(qu | (qv << 8));
+}
+
+VECTOR3D CompactHeightfield::decodeNormal(uint16_t packed)
+{
+    float u = (packed & 0xff) / NORMAL_STEPS * 2.0f - 1.0f;
+    float v = (packed >> 8) / NORMAL_STEPS * 2.0f - 1.0f;
+    float y = 1.0f - fabs(u) - fabs(v);
+
+    if(y < 0.0f)
+    {
+        float unfoldU = (1.0f - fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float unfoldV = (1.0f - fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = unfoldU;
+        v = unfoldV;
+    }
+
+    VECTOR3D n(u, y, v);
+    n.Normalize();
+
+    return n;
+}
+
+
+/**************************************************************************************
+ **     Private Compact Heightfield Functions
+ **
+ **************************************************************************************/
+
+void CompactHeightfield::release()
+{
+    trackedFree(heights);
+    trackedFree(normals);
+    trackedFree(tiles);
+
+    heights = NULL;
+    normals = NULL;
+    tiles = NULL;
+}
@@ -0,0 +1,87 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <stdint.h>
+#include <cmath>
+
+#include "VECTOR3D.h"
+#include "memtrack.h"
+
+#define HEIGHTFIELD_TILE_BITS 6                           // tiles are 64 x 64 vertices
+#define HEIGHTFIELD_TILE (1 << HEIGHTFIELD_TILE_BITS)
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  CompactHeightfield - A square grid of vertices in 4 bytes each.
+//
+//      x and z follow from the grid position, so only the height and the
+//      normal are stored. Heights are 16-bit fractions of the range of
+//      their 64 x 64 tile (a scale and an offset per tile); normals are
+//      octahedral-encoded into two 8-bit values. A VECTOR3D vertex plus its
+//      normal takes 24 bytes.
+//
+//      The grid is filled in bands of whole tile rows (packRows) and decoded
+//      one value at a time by the queries, or a row at a time for drawing.
+
+class CompactHeightfield
+{
+    public:
+
+        CompactHeightfield();
+        ~CompactHeightfield();
+
+        // Allocate a grid of (dim+1) x (dim+1) vertices covering sideWidth
+        // units around the origin (all heights zero)
+        void allocate(int dim, float sideWidth);
+
+        // Store rows [firstRow, firstRow+count) from row-major arrays of
+        // count*(dim+1) values. firstRow is a multiple of HEIGHTFIELD_TILE
+        // and count is HEIGHTFIELD_TILE, or what is left of the grid.
+        void packRows(int firstRow, int count, const float *heights, const VECTOR3D *normals);
+
+        float getHeight(int row, int col) const
+        {
+            const Tile & t = tiles[(row >> HEIGHTFIELD_TILE_BITS) * tilesPerRow + (col >> HEIGHTFIELD_TILE_BITS)];
+            return t.offset + heights[(size_t) row * stride + col] * t.scale;
+        }
+
+        float getX(int col) const { return cornerX + (col*delta); }
+        float getZ(int row) const { return cornerZ + (row*delta); }
+
+        VECTOR3D getVertex(int row, int col) const { return VECTOR3D(getX(col), getHeight(row, col), getZ(row)); }
+        VECTOR3D getNormal(int row, int col) const { return decodeNormal(normals[(size_t) row * stride + col]); }
+
+        void expandRow(int row, VECTOR3D *vertices, VECTOR3D *normals) const; // dim+1 entries each
+
+        int getResolution() const { return resolution; }
+        size_t getBytes() const; // memory held
+
+        static uint16_t encodeNormal(const VECTOR3D & n); // n need not be unit length
+        static VECTOR3D decodeNormal(uint16_t packed);
+
+    protected:
+
+        typedef struct Tile {
+            float offset; // lowest height in the tile
+            float scale;  // height of one quantization step
+        } Tile;
+
+        int resolution;
+        int stride;      // vertices per row (resolution+1)
+        int tilesPerRow;
+        float cornerX, cornerZ, delta;
+
+        uint16_t *heights;
+        uint16_t *normals;
+        Tile *tiles;
+
+        void release();
+
+    private:
+
+        CompactHeightfield(const CompactHeightfield &);            // not copyable
+        CompactHeightfield & operator=(const CompactHeightfield &);
+};
+
+
+#endif
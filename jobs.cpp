@@ -0,0 +1,287 @@
+#include "jobs.h"
+
+#include <algorithm>
+
+using namespace std;
+
+#define JOB_SPIN_ROUNDS 2000 // failed steal attempts before an idle worker sleeps
+#define JOB_QUEUE_SIZE 64    // initial ring size of each worker queue
+
+// Index of the calling thread in its job system (0 for any thread that is
+// not a worker, including the one that called start)
+static thread_local int workerIndex = 0;
+
+
+/**************************************************************************************
+ **     Public Job System Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  newQueue - An empty worker queue.
+
+JobSystem::WorkerQueue *JobSystem::newQueue()
+{
+    WorkerQueue *q = new WorkerQueue;
+    q->ring.resize(JOB_QUEUE_SIZE);
+    q->head = 0;
+    q->count = 0;
+    return q;
+}
+
+JobSystem::JobSystem() : numThreads(1), running(false), queued(0)
+{
+    queues.push_back(newQueue());
+}
+
+JobSystem::~JobSystem()
+{
+    stop();
+
+    for(size_t i = 0; i < queues.size(); ++i)
+        delete queues[i];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  start - Spawn numThreads-1 workers (0 means one per hardware thread).
+
+void JobSystem::start(int n)
+{
+    stop();
+
+    if(n <= 0)
+        n = max(1, (int) thread::hardware_concurrency());
+
+    for(size_t i = 0; i < queues.size(); ++i)
+        delete queues[i];
+
+    queues.clear();
+
+    for(int i = 0; i < n; ++i)
+        queues.push_back(newQueue());
+
+    numThreads = n;
+    running = true;
+
+    for(int i = 1; i < n; ++i)
+        threads.push_back(thread(&JobSystem::workerLoop, this, i));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  stop - Finish the queued jobs and join the workers.
+
+void JobSystem::stop()
+{
+    if(!running)
+        return;
+
+    while(runOne(0))
+        ;
+
+    {
+        lock_guard<mutex> guard(sleepLock);
+        running = false;
+    }
+
+    wakeUp.notify_all();
+
+    for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    threads.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  submit - Queue a job. It runs inline when there are no workers.
+
+void JobSystem::submit(const Job & job)
+{
+    if(job.counter != NULL)
+        job.counter->pending++;
+
+    if(numThreads == 1)
+    {
+        job.function(job.data, job.begin, job.end);
+
+        if(job.counter != NULL)
+            job.counter->pending--;
+
+        return;
+    }
+
+    WorkerQueue *q = queues[currentWorker()];
+
+    {
+        lock_guard<mutex> guard(q->lock);
+        int size = (int) q->ring.size();
+
+        // Full: double the ring, unwrapping the jobs to the front
+        if(q->count == size)
+        {
+            vector<Job> bigger(size * 2);
+
+            for(int i = 0; i < q->count; ++i)
+                bigger[i] = q->ring[(q->head + i) & (size-1)];
+
+            q->ring.swap(bigger);
+            q->head = 0;
+            size *= 2;
+        }
+
+        q->ring[(q->head + q->count) & (size-1)] = job;
+        q->count++;
+    }
+
+    queued++;
+
+    // Taking the lock orders this with a worker that is about to sleep
+    {
+        lock_guard<mutex> guard(sleepLock);
+    }
+
+    wakeUp.notify_one();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  wait - Help out until every job counted by counter has finished.
+
+void JobSystem::wait(JobCounter & counter)
+{
+    int worker = currentWorker();
+
+    while(counter.pending.load() > 0)
+    {
+        if(!runOne(worker))
+            this_thread::yield();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  parallelFor - One job per chunk; the caller runs the first chunk itself.
+
+void JobSystem::parallelFor(int count, int chunkSize, JobFunction f, void *data)
+{
+    if(count <= 0)
+        return;
+
+    if(numThreads == 1 || count <= chunkSize)
+    {
+        f(data, 0, count);
+        return;
+    }
+
+    JobCounter counter;
+
+    for(int begin = chunkSize; begin < count; begin += chunkSize)
+    {
+        Job job = { f, data, begin, min(begin + chunkSize, count), &counter };
+        submit(job);
+    }
+
+    f(data, 0, chunkSize);
+    wait(counter);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  chunkSizeFor - Aim for four chunks per thread, but no smaller than
+//                 minChunk; the result is rounded up to a multiple of align.
+
+int JobSystem::chunkSizeFor(int count, int minChunk, int align) const
+{
+    int chunk = (count + numThreads*4 - 1) / (numThreads*4);
+    chunk = max(chunk, minChunk);
+
+    return (chunk + align - 1) / align * align;
+}
+
+
+/**************************************************************************************
+ **     Private Job System Functions
+ **
+ **************************************************************************************/
+
+bool JobSystem::popLocal(int worker, Job & job)
+{
+    WorkerQueue *q = queues[worker];
+    lock_guard<mutex> guard(q->lock);
+
+    if(q->count == 0)
+        return false;
+
+    q->count--;
+    job = q->ring[(q->head + q->count) & (q->ring.size()-1)];
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  steal - Take the oldest job from another worker, starting with the next
+//          one along so that thieves spread out.
+
+bool JobSystem::steal(int worker, Job & job)
+{
+    for(int i = 1; i < numThreads; ++i)
+    {
+        WorkerQueue *q = queues[(worker + i) % numThreads];
+        lock_guard<mutex> guard(q->lock);
+
+        if(q->count > 0)
+        {
+            job = q->ring[q->head];
+            q->head = (q->head + 1) & (q->ring.size()-1);
+            q->count--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool JobSystem::runOne(int worker)
+{
+    Job job;
+
+    if(!popLocal(worker, job) && !steal(worker, job))
+        return false;
+
+    queued--;
+    job.function(job.data, job.begin, job.end);
+
+    if(job.counter != NULL)
+        job.counter->pending--;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  workerLoop - Run jobs; spin for a while when idle, then sleep until more
+//               work is submitted.
+
+void JobSystem::workerLoop(int worker)
+{
+    workerIndex = worker;
+    int idle = 0;
+
+    while(running)
+    {
+        if(runOne(worker))
+        {
+            idle = 0;
+            continue;
+        }
+
+        if(++idle < JOB_SPIN_ROUNDS)
+        {
+            this_thread::yield();
+            continue;
+        }
+
+        unique_lock<mutex> guard(sleepLock);
+        wakeUp.wait(guard, [this]() { return !running || queued.load() > 0; });
+        idle = 0;
+    }
+}
+
+int JobSystem::currentWorker() const
+{
+    return (workerIndex < numThreads) ? workerIndex : 0;
+}
@@ -0,0 +1,106 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work on [begin, end) of whatever data points to
+typedef void (*JobFunction)(void *data, int begin, int end);
+
+///////////////////////////////////////////////////////////////////////////////
+//  JobCounter - Number of unfinished jobs in a group. Every submitted job
+//               increments its counter and decrements it when done; wait()
+//               returns once it reaches zero.
+
+class JobCounter
+{
+    public:
+
+        std::atomic<int> pending;
+
+        JobCounter() : pending(0) { }
+};
+
+typedef struct Job {
+    JobFunction function;
+    void *data;
+    int begin;
+    int end;
+    JobCounter *counter;
+} Job;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  JobSystem - Small work-stealing scheduler.
+//
+//      Every thread owns a deque. A thread pushes and pops its own jobs at
+//      the back and, when it runs dry, steals from the front of the others'.
+//      The thread that calls start() is worker 0: it does not sleep, but
+//      runs jobs while it waits on a counter, so a job system started with
+//      one thread runs everything inline.
+
+class JobSystem
+{
+    public:
+
+        JobSystem();
+        ~JobSystem();
+
+        void start(int numThreads); // numThreads counts the calling thread
+        void stop();
+
+        int getNumThreads() const { return numThreads; }
+
+        void submit(const Job & job);   // queue a job on the calling thread's deque
+        void wait(JobCounter & counter); // run jobs until the counter reaches zero
+
+        // Run f over [0, count) in chunks of chunkSize and wait for all of
+        // them. Chunk k always covers [k*chunkSize, (k+1)*chunkSize), so the
+        // callback can index per-chunk results with begin/chunkSize.
+        void parallelFor(int count, int chunkSize, JobFunction f, void *data);
+
+        // A chunk size of at least minChunk (a multiple of align) that gives
+        // every thread a few chunks to balance the load
+        int chunkSizeFor(int count, int minChunk, int align) const;
+
+    protected:
+
+        // Ring buffer of jobs; it only grows (doubling), so a warmed-up
+        // queue never touches the heap
+        typedef struct WorkerQueue {
+            std::mutex lock;
+            std::vector<Job> ring; // size is a power of two
+            int head;              // oldest job
+            int count;
+        } WorkerQueue;
+
+        int numThreads;
+        std::vector<WorkerQueue*> queues;
+        std::vector<std::thread> threads;
+
+        std::atomic<bool> running;
+        std::atomic<int> queued; // jobs sitting in any deque
+
+        std::mutex sleepLock;
+        std::condition_variable wakeUp;
+
+        static WorkerQueue *newQueue();
+
+        bool popLocal(int worker, Job & job);
+        bool steal(int worker, Job & job);
+        bool runOne(int worker); // run one job from anywhere; false if none was found
+        void workerLoop(int worker);
+
+        int currentWorker() const;
+
+    private:
+
+        JobSystem(const JobSystem &);            // not copyable
+        JobSystem & operator=(const JobSystem &);
+};
+
+
+#endif
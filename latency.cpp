@@ -0,0 +1,131 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+/**************************************************************************************
+ **     Latency Histogram Functions
+ **
+ **************************************************************************************/
+
+void LatencyHistogram::clear()
+{
+    for(int i = 0; i <= LATENCY_BUCKETS; ++i)
+        counts[i] = 0;
+
+    count = 0;
+    maxUs = 0.0;
+}
+
+void LatencyHistogram::add(double us)
+{
+    int bucket = (int)(max(us, 0.0) / LATENCY_BUCKET_US);
+
+    counts[min(bucket, LATENCY_BUCKETS)]++;
+    count++;
+    maxUs = max(maxUs, us);
+}
+
+double LatencyHistogram::getPercentile(double p) const
+{
+    if(count == 0)
+        return 0.0;
+
+    long rank = max(1L, (long) ceil(p * count));
+    long seen = 0;
+
+    for(int i = 0; i < LATENCY_BUCKETS; ++i)
+    {
+        seen += counts[i];
+
+        if(seen >= rank)
+            return min((double)(i+1) * LATENCY_BUCKET_US, maxUs);
+    }
+
+    return maxUs;
+}
+
+
+/**************************************************************************************
+ **     Latency Tracker Functions
+ **
+ **************************************************************************************/
+
+LatencyTracker::LatencyTracker()
+{
+    records.reserve(LATENCY_PENDING);
+}
+
+void LatencyTracker::recordTick(unsigned int tick, const LatencyStamp *pressed, int n, LatencyStamp tickStart)
+{
+    if(n == 0)
+        return;
+
+    Record r;
+    r.tick = tick;
+    r.tickStart = tickStart;
+    r.published = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    for(int i = 0; i < n; ++i)
+    {
+        r.pressed = pressed[i];
+        records.push_back(r);
+    }
+}
+
+bool LatencyTracker::isWaiting(unsigned int tick)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    return !records.empty() && records[0].tick <= tick;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  frameShown - Complete every press of tick or earlier; records are kept
+//               in tick order.
+
+void LatencyTracker::frameShown(unsigned int tick, LatencyStamp frameStart)
+{
+    LatencyStamp swapped = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    size_t done = 0;
+
+    while(done < records.size() && records[done].tick <= tick)
+    {
+        const Record & r = records[done];
+
+        queue.add(std::chrono::duration<double, std::micro>(r.tickStart - r.pressed).count());
+        simulate.add(std::chrono::duration<double, std::micro>(r.published - r.tickStart).count());
+        handoff.add(std::chrono::duration<double, std::micro>(frameStart - r.published).count());
+        render.add(std::chrono::duration<double, std::micro>(swapped - frameStart).count());
+        total.add(std::chrono::duration<double, std::micro>(swapped - r.pressed).count());
+
+        done++;
+    }
+
+    records.erase(records.begin(), records.begin() + done);
+}
+
+void LatencyTracker::print(FILE *f)
+{
+    const char *names[] = {"queue", "simulate", "handoff", "render", "total"};
+    const LatencyHistogram *stages[] = {&queue, &simulate, &handoff, &render, &total};
+
+    fprintf(f, "Input latency, key press to swap (%ld presses):\n", total.getCount());
+    fprintf(f, "  %-10s %9s %9s %9s %9s\n", "ms", "p50", "p95", "p99", "max");
+
+    for(int i = 0; i < 5; ++i)
+    {
+        const LatencyHistogram & h = *stages[i];
+
+        fprintf(f, "  %-10s %9.1f %9.1f %9.1f %9.1f\n", names[i], h.getPercentile(0.50) / 1000.0,
+                h.getPercentile(0.95) / 1000.0, h.getPercentile(0.99) / 1000.0, h.getMax() / 1000.0);
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#define LATENCY_BUCKET_US 100 // histogram resolution
+#define LATENCY_BUCKETS 5000  // buckets up to 500 ms; longer samples go into an overflow bucket
+#define LATENCY_PENDING 256   // input ticks that can wait for a frame without allocating
+
+typedef std::chrono::steady_clock::time_point LatencyStamp;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  LatencyHistogram - Fixed-width histogram of durations in microseconds.
+
+class LatencyHistogram
+{
+    public:
+
+        LatencyHistogram() { clear(); }
+
+        void clear();
+        void add(double us);
+
+        long getCount() const { return count; }
+        double getMax() const { return maxUs; }
+
+        // Upper edge of the bucket holding the fraction p (0..1) of the
+        // samples, e.g. 0.95 for p95
+        double getPercentile(double p) const;
+
+    protected:
+
+        int counts[LATENCY_BUCKETS+1]; // the last one is the overflow bucket
+        long count;
+        double maxUs;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//  LatencyTracker - Input-to-photon latency of the game keys.
+//
+//      A key press is stamped when its handler queues it. The simulation
+//      thread reports the presses each tick applied, when the tick picked
+//      them up, and when it published its snapshot. The render thread
+//      reports each frame it swaps; the first frame that shows the tick (or
+//      a later one) completes the presses, split into four stages:
+//
+//          queue     - key press to the tick that applies it
+//          simulate  - that tick, up to publishing its snapshot
+//          handoff   - published to the start of the frame that draws it
+//          render    - drawing the frame, up to glutSwapBuffers returning
+
+class LatencyTracker
+{
+    public:
+
+        LatencyTracker();
+
+        // Simulation thread: the presses applied by tick (stamped when they
+        // were queued), which started at tickStart and is about to publish
+        void recordTick(unsigned int tick, const LatencyStamp *pressed, int n, LatencyStamp tickStart);
+
+        // Render thread: whether presses of tick or earlier are still waiting
+        // for a frame (such a snapshot is worth drawing)
+        bool isWaiting(unsigned int tick);
+
+        // Render thread: a frame showing tick, started at frameStart, has
+        // just been swapped
+        void frameShown(unsigned int tick, LatencyStamp frameStart);
+
+        void print(FILE *f); // p50/p95/p99/max of every stage and the total
+
+    protected:
+
+        typedef struct Record {
+            unsigned int tick;
+            LatencyStamp pressed;
+            LatencyStamp tickStart;
+            LatencyStamp published;
+        } Record;
+
+        std::mutex lock;
+        std::vector<Record> records; // waiting for a frame, in tick order (guarded by lock)
+
+        LatencyHistogram queue;
+        LatencyHistogram simulate;
+        LatencyHistogram handoff;
+        LatencyHistogram render;
+        LatencyHistogram total;
+};
+
+
+#endif
@@ -0,0 +1,121 @@
+#include "lighting.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+/**************************************************************************************
+ **     Public Terrain Lighting Functions
+ **
+ **************************************************************************************/
+
+TerrainLighting::TerrainLighting() : terrain(NULL), occlusion(false), resolution(0), stride(0), colors(NULL)
+{
+}
+
+TerrainLighting::~TerrainLighting()
+{
+    release();
+}
+
+void TerrainLighting::bake(const Terrain *t, const VECTOR3D & lightPosition, bool withOcclusion, JobSystem *jobs)
+{
+    PROFILE_ZONE("TerrainLighting::bake");
+
+    release();
+
+    terrain = t;
+    light = lightPosition;
+    occlusion = withOcclusion;
+    resolution = t->getResolution();
+    stride = resolution+1;
+    colors = (unsigned char*) trackedAlloc(MEMORY_TERRAIN, (size_t) stride * stride * 3);
+
+    if(jobs != NULL)
+        jobs->parallelFor(stride, LIGHTING_ROW_CHUNK, bakeJob, this);
+    else
+        bakeRows(0, stride);
+}
+
+
+/**************************************************************************************
+ **     Private Terrain Lighting Functions
+ **
+ **************************************************************************************/
+
+void TerrainLighting::bakeJob(void *data, int begin, int end)
+{
+    ((TerrainLighting*) data)->bakeRows(begin, end);
+}
+
+void TerrainLighting::bakeRows(int begin, int end)
+{
+    const float ambient[3] = { LIGHTING_AMBIENT_RGB };
+
+    for(int row = begin; row < end; ++row)
+    {
+        for(int col = 0; col < stride; ++col)
+        {
+            VECTOR3D v = terrain->getVertex(row, col);
+            VECTOR3D toLight = light - v;
+            toLight.Normalize();
+
+            float diffuse = max(terrain->getNormal(row, col).DotProduct(toLight), 0.0f);
+            float sky = occlusion ? openSky(row, col) : 1.0f;
+
+            unsigned char *c = &colors[3 * ((size_t) row * stride + col)];
+
+            for(int k = 0; k < 3; ++k)
+            {
+                float value = LIGHTING_ALBEDO * (ambient[k] * sky + diffuse);
+                c[k] = (unsigned char)(min(value, 1.0f) * 255.0f + 0.5f);
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  openSky - Walk out along the 8 grid directions, keeping the steepest
+//            rise seen; the horizon angle a blocks sin(a) of that direction.
+//            The steps grow with the distance, since far ridges only matter
+//            if they are high.
+
+float TerrainLighting::openSky(int row, int col) const
+{
+    static const int dirRow[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+    static const int dirCol[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+
+    float h0 = terrain->getVertexHeight(row, col);
+    float cell = terrain->getCellSize();
+    float blocked = 0.0f;
+
+    for(int d = 0; d < 8; ++d)
+    {
+        float length = (dirRow[d] != 0 && dirCol[d] != 0) ? cell * 1.41421356f : cell;
+        float slope = 0.0f; // tangent of the horizon angle
+
+        for(int k = 1; k <= LIGHTING_AO_RADIUS; k += max(1, k/4))
+        {
+            int r = row + k*dirRow[d];
+            int c = col + k*dirCol[d];
+
+            if(r < 0 || r > resolution || c < 0 || c > resolution)
+                break;
+
+            slope = max(slope, (terrain->getVertexHeight(r, c) - h0) / (k * length));
+        }
+
+        blocked += slope / sqrtf(1.0f + slope*slope);
+    }
+
+    return 1.0f - blocked / 8.0f;
+}
+
+void TerrainLighting::release()
+{
+    trackedFree(colors);
+    colors = NULL;
+}
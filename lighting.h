@@ -0,0 +1,67 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <cmath>
+
+#include "VECTOR3D.h"
+#include "terrain.h"
+#include "jobs.h"
+#include "memtrack.h"
+
+#define LIGHTING_ALBEDO 0.8f                     // the mesh colour, as with lighting on
+#define LIGHTING_AMBIENT_RGB 0.32f, 0.35f, 0.40f // sky light on an open vertex
+#define LIGHTING_AO_RADIUS 32                    // cells searched for the horizon in each direction
+#define LIGHTING_ROW_CHUNK 16                    // rows per baking job
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  TerrainLighting - Per-vertex lighting of a static terrain, computed once.
+//
+//      Every vertex gets an RGB colour: the albedo times the sky ambient
+//      plus the diffuse term of a point light, clamped. With occlusion on,
+//      the ambient is scaled by how open the sky is over the vertex: the
+//      horizon is found along the 8 grid directions (out to
+//      LIGHTING_AO_RADIUS cells) and each direction blocks the sine of its
+//      horizon angle. The rows are baked in parallel on a job system.
+//
+//      The colours replace fixed-function lighting when the mesh is drawn;
+//      the terrain must not change after bake().
+
+class TerrainLighting
+{
+    public:
+
+        TerrainLighting();
+        ~TerrainLighting();
+
+        // jobs may be NULL to bake on the calling thread
+        void bake(const Terrain *t, const VECTOR3D & lightPosition, bool occlusion, JobSystem *jobs);
+
+        bool isBaked() const { return colors != NULL; }
+
+        // Three bytes (red, green, blue) for vertex [row][col]
+        const unsigned char *getColor(int row, int col) const { return &colors[3 * ((size_t) row * stride + col)]; }
+
+    protected:
+
+        const Terrain *terrain;
+        VECTOR3D light;
+        bool occlusion;
+        int resolution;
+        int stride;            // vertices per row (resolution+1)
+        unsigned char *colors;
+
+        static void bakeJob(void *data, int begin, int end); // rows [begin, end)
+        void bakeRows(int begin, int end);
+        float openSky(int row, int col) const; // 1 for a flat plain, less in a valley
+
+        void release();
+
+    private:
+
+        TerrainLighting(const TerrainLighting &);            // not copyable
+        TerrainLighting & operator=(const TerrainLighting &);
+};
+
+
+#endif
@@ -0,0 +1,30 @@
+#include "lod.h"
+
+
+void LodChain::addLevel(GLuint list, float pixels)
+{
+    if(numLevels == LOD_MAX_LEVELS)
+        return;
+
+    lists[numLevels] = list;
+    minPixels[numLevels] = pixels;
+    numLevels++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  select - Level k covers sizes from minPixels[k] up to minPixels[k-1];
+//           move one level at a time while the size is clearly outside the
+//           current level's range.
+
+int LodChain::select(float pixels, int current) const
+{
+    int level = (current < 0 || current > numLevels) ? numLevels : current;
+
+    while(level > 0 && pixels > minPixels[level-1] * (1.0f + LOD_HYSTERESIS))
+        level--;
+
+    while(level < numLevels && pixels < minPixels[level] * (1.0f - LOD_HYSTERESIS))
+        level++;
+
+    return level;
+}
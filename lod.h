@@ -0,0 +1,52 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "a3.h"
+
+#define LOD_MAX_LEVELS 4
+#define LOD_HYSTERESIS 0.2f // a level changes only 20% past its threshold
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  LodChain - Display lists of one mesh at decreasing detail.
+//
+//      Each level has the smallest projected size (in pixels) it is used
+//      at; below the coarsest level's size select() returns getNumLevels(),
+//      for the caller to draw a point or nothing. An object near a
+//      threshold would flip between levels every frame as it moves, so
+//      select() only leaves the current level once the size is
+//      LOD_HYSTERESIS beyond the threshold.
+//
+//      The display lists live as long as the GL context.
+
+class LodChain
+{
+    public:
+
+        LodChain() : numLevels(0) { }
+
+        // Add the next coarser level
+        void addLevel(GLuint list, float minPixels);
+
+        int getNumLevels() const { return numLevels; }
+
+        // The level for an object of the given projected size that was
+        // drawn at level current last time
+        int select(float pixels, int current) const;
+
+        void draw(int level) const { glCallList(lists[level]); }
+
+    protected:
+
+        int numLevels;
+        GLuint lists[LOD_MAX_LEVELS];
+        float minPixels[LOD_MAX_LEVELS];
+
+    private:
+
+        LodChain(const LodChain &);            // not copyable
+        LodChain & operator=(const LodChain &);
+};
+
+
+#endif
@@ -0,0 +1,270 @@
+#include "memtrack.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+using namespace std;
+
+// Bytes in front of every block: the requested size and the tag. 16 keeps
+// the block as aligned as malloc's own (16 bytes on the supported platforms).
+#define TRACKED_HEADER 16
+
+typedef struct TrackedHeader {
+    size_t size;
+    int tag;
+} TrackedHeader;
+
+static const char *tagNames[MEMORY_TAG_COUNT] = { "terrain", "textures", "entities", "transient" };
+
+// Zero-initialized before any constructor runs, so allocations made while
+// other globals are being constructed are counted too
+static atomic<size_t> current[MEMORY_TAG_COUNT];
+static atomic<size_t> peak[MEMORY_TAG_COUNT];
+static atomic<long long> blocks[MEMORY_TAG_COUNT];
+static atomic<size_t> budget[MEMORY_TAG_COUNT];
+static atomic<bool> overBudget[MEMORY_TAG_COUNT];
+static atomic<AllocationHook> allocationHook;
+
+static int leakCheckUsers = 0;
+
+
+/**************************************************************************************
+ **     Private Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  formatBytes - Human readable size, e.g. "12.5 MB".
+
+static const char *formatBytes(size_t bytes, char *buffer, size_t length)
+{
+    if(bytes < 1024)
+        snprintf(buffer, length, "%u B", (unsigned int) bytes);
+    else if(bytes < 1024*1024)
+        snprintf(buffer, length, "%.1f KB", bytes / 1024.0);
+    else if(bytes < 1024*1024*1024)
+        snprintf(buffer, length, "%.1f MB", bytes / (1024.0*1024.0));
+    else
+        snprintf(buffer, length, "%.2f GB", bytes / (1024.0*1024.0*1024.0));
+
+    return buffer;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  charge - Count a new block. Warns once each time the tag goes over its
+//           budget (again after it has dropped back under).
+
+static void charge(int tag, size_t bytes)
+{
+    size_t now = current[tag].fetch_add(bytes) + bytes;
+    size_t top = peak[tag].load();
+
+    while(now > top && !peak[tag].compare_exchange_weak(top, now))
+        ;
+
+    blocks[tag]++;
+
+    size_t limit = budget[tag].load();
+
+    if(limit != 0 && now > limit && !overBudget[tag].exchange(true))
+    {
+        char used[32], allowed[32];
+        fprintf(stderr, "memory: %s is over budget (%s of %s)\n", tagNames[tag],
+                formatBytes(now, used, sizeof(used)), formatBytes(limit, allowed, sizeof(allowed)));
+    }
+}
+
+static void refund(int tag, size_t bytes)
+{
+    size_t now = current[tag].fetch_sub(bytes) - bytes;
+    blocks[tag]--;
+
+    if(now <= budget[tag].load())
+        overBudget[tag] = false;
+}
+
+
+/**************************************************************************************
+ **     Public Functions
+ **
+ **************************************************************************************/
+
+void *trackedAlloc(MemoryTag tag, size_t bytes)
+{
+    AllocationHook hook = allocationHook.load(memory_order_relaxed);
+
+    if(hook != NULL)
+        hook();
+
+    char *raw = (char*) malloc(TRACKED_HEADER + bytes);
+
+    if(raw == NULL)
+        return NULL;
+
+    TrackedHeader *h = (TrackedHeader*) raw;
+    h->size = bytes;
+    h->tag = tag;
+
+    charge(tag, bytes);
+
+    return raw + TRACKED_HEADER;
+}
+
+void *trackedCalloc(MemoryTag tag, size_t count, size_t size)
+{
+    void *p = trackedAlloc(tag, count * size);
+
+    if(p != NULL)
+        memset(p, 0, count * size);
+
+    return p;
+}
+
+void trackedFree(void *p)
+{
+    if(p == NULL)
+        return;
+
+    TrackedHeader *h = (TrackedHeader*)((char*) p - TRACKED_HEADER);
+    refund(h->tag, h->size);
+
+    free(h);
+}
+
+size_t trackedSize(const void *p)
+{
+    return ((const TrackedHeader*)((const char*) p - TRACKED_HEADER))->size;
+}
+
+const char *memoryTagName(MemoryTag tag)
+{
+    return tagNames[tag];
+}
+
+size_t memoryCurrent(MemoryTag tag)
+{
+    return current[tag].load();
+}
+
+size_t memoryPeak(MemoryTag tag)
+{
+    return peak[tag].load();
+}
+
+long long memoryBlocks(MemoryTag tag)
+{
+    return blocks[tag].load();
+}
+
+void setMemoryBudget(MemoryTag tag, size_t bytes)
+{
+    budget[tag] = bytes;
+    overBudget[tag] = false;
+}
+
+void setAllocationHook(AllocationHook hook)
+{
+    allocationHook.store(hook);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  parseMemoryBudget - Set a budget from "tag=size", e.g. "terrain=64M".
+//                      Returns false if the tag or size is not recognized.
+
+bool parseMemoryBudget(const char *spec)
+{
+    const char *equals = strchr(spec, '=');
+
+    if(equals == NULL)
+        return false;
+
+    for(int tag = 0; tag < MEMORY_TAG_COUNT; ++tag)
+    {
+        if(strlen(tagNames[tag]) != (size_t)(equals - spec) || strncmp(spec, tagNames[tag], equals - spec) != 0)
+            continue;
+
+        char *end;
+        double size = strtod(equals+1, &end);
+
+        if(end == equals+1 || size < 0)
+            return false;
+
+        switch(*end)
+        {
+            case 'k': case 'K': size *= 1024.0; end++; break;
+            case 'm': case 'M': size *= 1024.0*1024.0; end++; break;
+            case 'g': case 'G': size *= 1024.0*1024.0*1024.0; end++; break;
+        }
+
+        if(*end != '\0')
+            return false;
+
+        setMemoryBudget((MemoryTag) tag, (size_t) size);
+        return true;
+    }
+
+    return false;
+}
+
+void printMemoryReport(FILE *f)
+{
+    char now[32], top[32], limit[32];
+    size_t totalNow = 0, totalPeak = 0;
+
+    fprintf(f, "%-10s %12s %12s %12s %10s\n", "memory", "current", "peak", "budget", "blocks");
+
+    for(int tag = 0; tag < MEMORY_TAG_COUNT; ++tag)
+    {
+        size_t b = budget[tag].load();
+
+        fprintf(f, "%-10s %12s %12s %12s %10lld%s\n", tagNames[tag],
+                formatBytes(current[tag].load(), now, sizeof(now)),
+                formatBytes(peak[tag].load(), top, sizeof(top)),
+                b ? formatBytes(b, limit, sizeof(limit)) : "-",
+                blocks[tag].load(),
+                (b != 0 && peak[tag].load() > b) ? "  over budget" : "");
+
+        totalNow += current[tag].load();
+        totalPeak += peak[tag].load();
+    }
+
+    // The sum of the peaks: an upper bound, the tags need not peak together
+    fprintf(f, "%-10s %12s %12s\n", "total",
+            formatBytes(totalNow, now, sizeof(now)), formatBytes(totalPeak, top, sizeof(top)));
+}
+
+int printMemoryLeaks(FILE *f)
+{
+    int leaking = 0;
+    char now[32];
+
+    for(int tag = 0; tag < MEMORY_TAG_COUNT; ++tag)
+    {
+        if(blocks[tag].load() == 0)
+            continue;
+
+        fprintf(f, "memory: %s leaked %lld blocks (%s)\n", tagNames[tag], blocks[tag].load(),
+                formatBytes(current[tag].load(), now, sizeof(now)));
+        leaking++;
+    }
+
+    return leaking;
+}
+
+
+/**************************************************************************************
+ **     Memory Leak Check
+ **
+ **************************************************************************************/
+
+MemoryLeakCheck::MemoryLeakCheck()
+{
+    leakCheckUsers++;
+}
+
+MemoryLeakCheck::~MemoryLeakCheck()
+{
+    if(--leakCheckUsers == 0)
+        printMemoryLeaks(stderr);
+}
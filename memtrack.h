@@ -0,0 +1,133 @@
+#ifndef MEMTRACK_H
+#define MEMTRACK_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <new>
+
+///////////////////////////////////////////////////////////////////////////////
+//  Tagged memory accounting.
+//
+//      Long-lived data is allocated through trackedAlloc (or the helpers
+//      below) with the tag of the subsystem that owns it. Each tag keeps
+//      its current and peak bytes and the number of live blocks, and may
+//      have a budget: crossing it prints a warning to stderr. Any block
+//      still live when the program exits is reported as a leak.
+
+// Owners of tracked memory
+typedef enum MemoryTag {
+    MEMORY_TERRAIN,   // heightfield rows, generator data, mesh quads
+    MEMORY_TEXTURES,  // decoded pixmaps
+    MEMORY_ENTITIES,  // targets, timers and their snapshots
+    MEMORY_TRANSIENT, // per-tick and per-frame arenas
+    MEMORY_TAG_COUNT
+} MemoryTag;
+
+void *trackedAlloc(MemoryTag tag, size_t bytes);               // 16-byte aligned; NULL when out of memory
+void *trackedCalloc(MemoryTag tag, size_t count, size_t size); // zero-filled
+void trackedFree(void *p);                                     // NULL is ignored
+size_t trackedSize(const void *p);                             // bytes requested for the block
+
+const char *memoryTagName(MemoryTag tag);
+size_t memoryCurrent(MemoryTag tag); // bytes held now
+size_t memoryPeak(MemoryTag tag);    // most bytes ever held at once
+long long memoryBlocks(MemoryTag tag); // live blocks
+
+void setMemoryBudget(MemoryTag tag, size_t bytes); // 0 removes the budget
+
+// Called on every trackedAlloc. allocstats.cpp installs its heap counter
+// here, so tracked blocks are counted along with those from operator new.
+typedef void (*AllocationHook)();
+void setAllocationHook(AllocationHook hook); // NULL removes the hook
+bool parseMemoryBudget(const char *spec);          // "tag=size", size in bytes or with a K/M/G suffix
+
+void printMemoryReport(FILE *f); // one line per tag: current, peak, budget, blocks
+int printMemoryLeaks(FILE *f);   // list the tags still holding blocks; returns their number
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  trackedNewArray / trackedDeleteArray - new[] and delete[] for a tag. The
+//                                         elements are default-initialized,
+//                                         as with new T[n].
+
+template<typename T> T *trackedNewArray(MemoryTag tag, size_t n)
+{
+    T *p = (T*) trackedAlloc(tag, n * sizeof(T));
+
+    if(p == NULL)
+        throw std::bad_alloc();
+
+    for(size_t i = 0; i < n; ++i)
+        new (p + i) T;
+
+    return p;
+}
+
+template<typename T> void trackedDeleteArray(T *p)
+{
+    if(p == NULL)
+        return;
+
+    size_t n = trackedSize(p) / sizeof(T);
+
+    for(size_t i = 0; i < n; ++i)
+        p[i].~T();
+
+    trackedFree(p);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  TrackedAllocator - Standard allocator that charges a tag, for containers:
+//                     std::vector<float, TrackedAllocator<float, MEMORY_ENTITIES> >
+
+template<typename T, MemoryTag TAG> class TrackedAllocator
+{
+    public:
+
+        typedef T value_type;
+
+        template<typename U> struct rebind { typedef TrackedAllocator<U, TAG> other; };
+
+        TrackedAllocator() { }
+        template<typename U> TrackedAllocator(const TrackedAllocator<U, TAG> &) { }
+
+        T *allocate(size_t n)
+        {
+            T *p = (T*) trackedAlloc(TAG, n * sizeof(T));
+
+            if(p == NULL)
+                throw std::bad_alloc();
+
+            return p;
+        }
+
+        void deallocate(T *p, size_t) { trackedFree(p); }
+};
+
+template<typename T, typename U, MemoryTag TAG>
+bool operator==(const TrackedAllocator<T, TAG> &, const TrackedAllocator<U, TAG> &) { return true; }
+
+template<typename T, typename U, MemoryTag TAG>
+bool operator!=(const TrackedAllocator<T, TAG> &, const TrackedAllocator<U, TAG> &) { return false; }
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  MemoryLeakCheck - Prints the leak report once the last translation unit
+//                    that includes this header has destroyed its globals
+//                    (the std::ios_base::Init idiom). Every file defining a
+//                    global that holds tracked memory includes this header
+//                    first, so those globals are freed before the check.
+
+class MemoryLeakCheck
+{
+    public:
+
+        MemoryLeakCheck();
+        ~MemoryLeakCheck();
+};
+
+static MemoryLeakCheck memoryLeakCheck;
+
+
+#endif
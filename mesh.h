@@ -2,6 +2,8 @@
 #define MESH_H
 
 #include "a3.h"
+#include "terrain.h"
+#include "lighting.h"
 
 
 typedef struct Quad {
@@ -9,49 +11,48 @@ typedef struct Quad {
 } Quad;
 
 
-typedef struct Blob {
-    VECTOR3D position;
-
-    float width;
-    float height;
-} Blob;
-
+///////////////////////////////////////////////////////////////////////////////
+//  Mesh - Draws a terrain as textured quads. Everything it needs is held in
+//         the object, so several meshes (over several terrains) can coexist.
 
 class Mesh
 {
     public:
 
+        Mesh();
+        ~Mesh();
+
         // Mesh Functions
-        void initMesh();
+        void initMesh(Terrain *t); // build the quads over the terrain grid and load the texture
+        void setLighting(const TerrainLighting *l); // draw with baked colours instead of GL lighting (NULL to stop)
         void drawMesh();
 
-        // Print Functions
-        void printBlobs(void);
 
-        // Useful Functions
-        VECTOR3D getRandomVertex();
-        float getMaxHeight();
+    protected:
 
+        Terrain *terrain;
+        const TerrainLighting *lighting; // NULL unless baked colours are drawn
+        int resolution;
 
-    protected:
-        
-        // Private Blob Functions
-        void addBlob(Blob b); // adds a blob to the terrain mesh
-        Blob* getLastBlob(); // returns the last blob
+        // Data Structures: resolution*resolution quads pointing into the
+        // terrain's vertices
+        Quad *quads;
+        int numQuads;
+
+        GLuint texture;
 
         // Private Mesh Functions
-        void allocateMesh (int dim); // allocate vertex array and quad array memory
-        void initializeMesh(float originX, float originZ, float sideWidth); // construct vertex array and quad array
+        void allocateMesh(); // allocate quad array memory
+        void initializeMesh(); // construct quad array
         void texturizeMesh(); // set up texture mapping for the mesh
-
-        void resetMesh();     // for each mesh vertex, set height (Y value) to 0
-        void updateMesh();    // for each mesh vertex, evaluate height contribution from each blob
-        void updateNormals(); // for each mesh vertex, update the normal vector
         void displayMesh();   // displays the mesh on the screen
+        void displayBakedMesh(); // the same, coloured by the baked lighting
 
-        void computeVertexHeight(VECTOR3D *v); // compute height of the vertex as affected by the blobs
+    private:
 
+        Mesh(const Mesh &);            // not copyable
+        Mesh & operator=(const Mesh &);
 };
 
 
-#endif
\ No newline at end of file
+#endif
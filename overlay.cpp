@@ -0,0 +1,233 @@
+#include "overlay.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+
+/**************************************************************************************
+ **     Public Terrain Overlay Functions
+ **
+ **************************************************************************************/
+
+TerrainOverlay::TerrainOverlay() : base(NULL), stride(0), tilesPerSide(0)
+{
+}
+
+TerrainOverlay::~TerrainOverlay()
+{
+    clear();
+}
+
+void TerrainOverlay::attach(const Terrain *t)
+{
+    clear();
+
+    base = t;
+    stride = t->getResolution()+1;
+    tilesPerSide = (stride + OVERLAY_TILE-1) >> OVERLAY_TILE_BITS;
+}
+
+void TerrainOverlay::clear()
+{
+    for(TileMap::iterator it = tiles.begin(); it != tiles.end(); ++it)
+        trackedFree(it->second);
+
+    tiles.clear();
+}
+
+float TerrainOverlay::getVertexHeight(int row, int col) const
+{
+    if(!tiles.empty())
+    {
+        TileMap::const_iterator it = tiles.find((row >> OVERLAY_TILE_BITS) * tilesPerSide + (col >> OVERLAY_TILE_BITS));
+
+        if(it != tiles.end())
+            return it->second[(row & (OVERLAY_TILE-1)) * OVERLAY_TILE + (col & (OVERLAY_TILE-1))];
+    }
+
+    return base->getVertexHeight(row, col);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getHeightAt - the ground height under (x, z), interpolated as in
+//                Terrain::getHeightAt.
+
+float TerrainOverlay::getHeightAt(float x, float z) const
+{
+    if(tiles.empty())
+        return base->getHeightAt(x, z);
+
+    int r, c;
+    float fx, fz;
+
+    base->locate(x, z, &r, &c, &fx, &fz);
+
+    float h00 = getVertexHeight(r,   c), h01 = getVertexHeight(r,   c+1);
+    float h10 = getVertexHeight(r+1, c), h11 = getVertexHeight(r+1, c+1);
+
+    float nearRow = h00 + (h01 - h00) * fx;
+    float farRow  = h10 + (h11 - h10) * fx;
+
+    return nearRow + (farRow - nearRow) * fz;
+}
+
+void TerrainOverlay::getHeightsAt(const float *x, const float *z, int count, float *heights) const
+{
+    if(tiles.empty())
+    {
+        base->getHeightsAt(x, z, count, heights);
+        return;
+    }
+
+    for(int i = 0; i < count; ++i)
+        heights[i] = getHeightAt(x[i], z[i]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  deform - Lower every vertex within radius of (x, z) by depth times
+//           1 - (d/radius)^2, copying the tiles it touches.
+
+void TerrainOverlay::deform(float x, float z, float radius, float depth)
+{
+    PROFILE_ZONE("TerrainOverlay::deform");
+
+    float cell = base->getCellSize();
+    float gx = (x - base->getCornerX()) / cell;
+    float gz = (z - base->getCornerZ()) / cell;
+    float reach = radius / cell;
+
+    int col0 = max((int) ceilf(gx - reach), 0), col1 = min((int) floorf(gx + reach), stride-1);
+    int row0 = max((int) ceilf(gz - reach), 0), row1 = min((int) floorf(gz + reach), stride-1);
+
+    for(int row = row0; row <= row1; ++row)
+    {
+        for(int col = col0; col <= col1; ++col)
+        {
+            float dx = (col - gx) * cell;
+            float dz = (row - gz) * cell;
+            float d2 = (dx*dx + dz*dz) / (radius*radius);
+
+            if(d2 >= 1.0f)
+                continue;
+
+            float *tile = copyTile(row >> OVERLAY_TILE_BITS, col >> OVERLAY_TILE_BITS);
+            tile[(row & (OVERLAY_TILE-1)) * OVERLAY_TILE + (col & (OVERLAY_TILE-1))] -= depth * (1.0f - d2);
+        }
+    }
+}
+
+const float *TerrainOverlay::findTile(int key) const
+{
+    TileMap::const_iterator it = tiles.find(key);
+    return (it != tiles.end()) ? it->second : NULL;
+}
+
+size_t TerrainOverlay::getBytes() const
+{
+    // The tiles, and roughly a node and a bucket per tile in the map
+    return tiles.size() * (OVERLAY_TILE * OVERLAY_TILE * sizeof(float) + 2*sizeof(void*) + sizeof(TileMap::value_type))
+         + tiles.bucket_count() * sizeof(void*);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  saveState - The grid size and tile count, the tile keys, then every tile
+//              in the same order.
+
+void TerrainOverlay::saveState(StateWriter & w) const
+{
+    int counts[2] = { stride, (int) tiles.size() };
+
+    w.writeSection(STATE_GROUND, 0, counts, 2);
+    w.beginSection(STATE_GROUND, 1);
+
+    for(TileMap::const_iterator it = tiles.begin(); it != tiles.end(); ++it)
+        w.write(&it->first, sizeof(int));
+
+    w.beginSection(STATE_GROUND, 2);
+
+    for(TileMap::const_iterator it = tiles.begin(); it != tiles.end(); ++it)
+        w.write(it->second, OVERLAY_TILE * OVERLAY_TILE * sizeof(float));
+}
+
+bool TerrainOverlay::loadState(const StateReader & r)
+{
+    int counts[2];
+    size_t keyBytes, tileBytes;
+
+    const int *keys = (const int*) r.find(STATE_GROUND, 1, &keyBytes);
+    const float *heights = (const float*) r.find(STATE_GROUND, 2, &tileBytes);
+
+    if(!r.readSection(STATE_GROUND, 0, counts, 2) || counts[0] != stride || counts[1] < 0
+    || keyBytes != (size_t) counts[1] * sizeof(int)
+    || tileBytes != (size_t) counts[1] * OVERLAY_TILE * OVERLAY_TILE * sizeof(float))
+        return false;
+
+    // Every key inside the grid and used once, before anything is dropped
+    vector<char> seen(tilesPerSide * tilesPerSide, 0);
+
+    for(int t = 0; t < counts[1]; ++t)
+    {
+        if(keys[t] < 0 || keys[t] >= tilesPerSide * tilesPerSide || seen[keys[t]])
+            return false;
+
+        seen[keys[t]] = 1;
+    }
+
+    clear();
+
+    for(int t = 0; t < counts[1]; ++t)
+    {
+        float *tile = (float*) trackedAlloc(MEMORY_TERRAIN, OVERLAY_TILE * OVERLAY_TILE * sizeof(float));
+        memcpy(tile, heights + (size_t) t * OVERLAY_TILE * OVERLAY_TILE, OVERLAY_TILE * OVERLAY_TILE * sizeof(float));
+
+        tiles[keys[t]] = tile;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  swap - Exchange the bases and the copied tiles.
+
+void TerrainOverlay::swap(TerrainOverlay & other)
+{
+    std::swap(base, other.base);
+    std::swap(stride, other.stride);
+    std::swap(tilesPerSide, other.tilesPerSide);
+    tiles.swap(other.tiles);
+}
+
+
+/**************************************************************************************
+ **     Private Terrain Overlay Functions
+ **
+ **************************************************************************************/
+
+float *TerrainOverlay::copyTile(int tileRow, int tileCol)
+{
+    int key = tileRow * tilesPerSide + tileCol;
+    TileMap::iterator it = tiles.find(key);
+
+    if(it != tiles.end())
+        return it->second;
+
+    float *tile = (float*) trackedCalloc(MEMORY_TERRAIN, OVERLAY_TILE * OVERLAY_TILE, sizeof(float));
+
+    // Tiles on the far edges hang over the grid; their extra entries stay 0
+    int rows = min(OVERLAY_TILE, stride - (tileRow << OVERLAY_TILE_BITS));
+    int cols = min(OVERLAY_TILE, stride - (tileCol << OVERLAY_TILE_BITS));
+
+    for(int r = 0; r < rows; ++r)
+    {
+        for(int c = 0; c < cols; ++c)
+            tile[r * OVERLAY_TILE + c] = base->getVertexHeight((tileRow << OVERLAY_TILE_BITS) + r, (tileCol << OVERLAY_TILE_BITS) + c);
+    }
+
+    tiles[key] = tile;
+    return tile;
+}
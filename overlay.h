@@ -0,0 +1,85 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stddef.h>
+#include <functional>
+#include <unordered_map>
+
+#include "terrain.h"
+#include "memtrack.h"
+#include "savestate.h"
+
+#define OVERLAY_TILE_BITS 4
+#define OVERLAY_TILE (1 << OVERLAY_TILE_BITS) // vertices along each side of a tile
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  TerrainOverlay - One session's changes to a shared terrain.
+//
+//      The base terrain is only read, so any number of sessions (games in
+//      a BatchEnv, for example) can share one. The first change to a tile
+//      of OVERLAY_TILE x OVERLAY_TILE vertices copies its heights from the
+//      base into the overlay; later reads of that tile come from the copy,
+//      and every other tile is read from the base. An overlay without any
+//      changes costs nothing per query and a few bytes in all, and one
+//      with changes holds only the tiles they touch.
+//
+//      Only heights are overlaid; the base keeps its normals, and the
+//      queries give the same results as the base for untouched ground.
+
+class TerrainOverlay
+{
+    public:
+
+        TerrainOverlay();
+        ~TerrainOverlay();
+
+        void attach(const Terrain *t); // read from t (drops every change)
+        void clear();                  // drop every change
+
+        const Terrain *getBase() const { return base; }
+
+        // As in Terrain, with the changes applied
+        float getVertexHeight(int row, int col) const;
+        float getHeightAt(float x, float z) const;
+        void getHeightsAt(const float *x, const float *z, int count, float *heights) const;
+
+        // Lower the ground in a bowl around (x, z): depth at the centre,
+        // nothing from radius on
+        void deform(float x, float z, float radius, float depth);
+
+        // The copied tiles, for a save state; load after attaching the
+        // same base (false, and the tiles left as they were, when the file
+        // does not match)
+        void saveState(StateWriter & w) const;
+        bool loadState(const StateReader & r);
+        void swap(TerrainOverlay & other);
+
+        int getNumTiles() const { return (int) tiles.size(); } // tiles copied so far
+
+        // Tiles by key (tile row * tiles per side + tile column), for
+        // visiting them in a fixed order: NULL for a tile not copied
+        int getNumTileKeys() const { return tilesPerSide * tilesPerSide; }
+        const float *findTile(int key) const;
+        size_t getBytes() const; // memory held for the changes
+
+    protected:
+
+        typedef std::unordered_map<int, float*, std::hash<int>, std::equal_to<int>,
+                                   TrackedAllocator<std::pair<const int, float*>, MEMORY_TERRAIN> > TileMap;
+
+        const Terrain *base;
+        int stride;       // vertices along each side of the base
+        int tilesPerSide;
+        TileMap tiles;    // copied heights by tile row * tilesPerSide + tile column
+
+        float *copyTile(int tileRow, int tileCol); // the tile's heights, copied from the base on first use
+
+    private:
+
+        TerrainOverlay(const TerrainOverlay &);            // not copyable
+        TerrainOverlay & operator=(const TerrainOverlay &);
+};
+
+
+#endif
@@ -0,0 +1,148 @@
+#include "profiler.h"
+
+#if defined(ENABLE_PROFILER)
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+typedef struct ProfileEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+} ProfileEvent;
+
+///////////////////////////////////////////////////////////////////////////////
+//  ProfileRing - The zones of one thread. Only the owner writes; written
+//                counts every zone ever recorded, so the ring holds the
+//                last min(written, PROFILE_RING_SIZE) of them.
+
+typedef struct ProfileRing {
+    ProfileEvent events[PROFILE_RING_SIZE];
+    atomic<uint64_t> written;
+    const char *threadName;
+    int threadId;
+} ProfileRing;
+
+// Rings are registered on first use and live until the program exits, so
+// the export can still read the zones of threads that have finished
+static mutex ringLock;
+static vector<ProfileRing*> rings;
+static thread_local ProfileRing *threadRing = NULL;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  getThreadRing - The calling thread's ring, created on first use.
+
+static ProfileRing *getThreadRing()
+{
+    if(threadRing == NULL)
+    {
+        ProfileRing *ring = new ProfileRing;
+        ring->written = 0;
+        ring->threadName = NULL;
+
+        lock_guard<mutex> guard(ringLock);
+        ring->threadId = (int) rings.size() + 1;
+        rings.push_back(ring);
+
+        threadRing = ring;
+    }
+
+    return threadRing;
+}
+
+uint64_t profilerNow()
+{
+    return (uint64_t) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void profilerRecord(const char *name, uint64_t start, uint64_t end)
+{
+    ProfileRing *ring = getThreadRing();
+    uint64_t n = ring->written.load(memory_order_relaxed);
+
+    ProfileEvent & e = ring->events[n & (PROFILE_RING_SIZE-1)];
+    e.name = name;
+    e.start = start;
+    e.end = end;
+
+    ring->written.store(n+1, memory_order_release);
+}
+
+void profilerSetThreadName(const char *name)
+{
+    getThreadRing()->threadName = name;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  profilerExport - Write every ring as "complete" (ph X) trace events, with
+//                   times in microseconds from the earliest zone. Threads
+//                   keep recording meanwhile; a zone overwritten while it is
+//                   being copied may come out garbled.
+
+bool profilerExport(const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if(f == NULL)
+        return false;
+
+    lock_guard<mutex> guard(ringLock);
+
+    // Earliest zone still held, as the time origin
+    uint64_t origin = ~(uint64_t) 0;
+
+    for(size_t r = 0; r < rings.size(); ++r)
+    {
+        uint64_t written = rings[r]->written.load(memory_order_acquire);
+        uint64_t first = (written > PROFILE_RING_SIZE) ? written - PROFILE_RING_SIZE : 0;
+
+        for(uint64_t i = first; i < written; ++i)
+        {
+            uint64_t start = rings[r]->events[i & (PROFILE_RING_SIZE-1)].start;
+
+            if(start < origin)
+                origin = start;
+        }
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool firstEvent = true;
+
+    for(size_t r = 0; r < rings.size(); ++r)
+    {
+        ProfileRing *ring = rings[r];
+
+        if(ring->threadName != NULL)
+        {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    firstEvent ? "" : ",\n", ring->threadId, ring->threadName);
+            firstEvent = false;
+        }
+
+        uint64_t written = ring->written.load(memory_order_acquire);
+        uint64_t first = (written > PROFILE_RING_SIZE) ? written - PROFILE_RING_SIZE : 0;
+
+        for(uint64_t i = first; i < written; ++i)
+        {
+            const ProfileEvent & e = ring->events[i & (PROFILE_RING_SIZE-1)];
+
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    firstEvent ? "" : ",\n", e.name, ring->threadId,
+                    (e.start - origin) / 1000.0, (e.end - e.start) / 1000.0);
+            firstEvent = false;
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+///////////////////////////////////////////////////////////////////////////////
+//  Scoped-zone profiler.
+//
+//      PROFILE_ZONE("name") at the top of a block records the time spent
+//      until the end of the block. Zones go into a ring buffer owned by the
+//      recording thread, so recording takes no locks; profilerExport()
+//      writes the rings as Chrome trace-event JSON (load it in
+//      chrome://tracing or Perfetto).
+//
+//      Everything here is compiled only when ENABLE_PROFILER is defined
+//      (-DENABLE_PROFILER). Otherwise PROFILE_ZONE expands to nothing and
+//      the profiler costs nothing.
+
+#define PROFILE_RING_SIZE 16384 // zones kept per thread (a power of two)
+
+#if defined(ENABLE_PROFILER)
+
+#include <stdint.h>
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+
+uint64_t profilerNow();                                    // nanoseconds, steady clock
+void profilerRecord(const char *name, uint64_t start, uint64_t end); // name must be a string literal
+void profilerSetThreadName(const char *name);              // shown in the trace (string literal)
+bool profilerExport(const char *path);                     // false if the file cannot be written
+
+///////////////////////////////////////////////////////////////////////////////
+//  ProfileZone - Records the lifetime of the object as one zone.
+
+class ProfileZone
+{
+    public:
+
+        ProfileZone(const char *zoneName) : name(zoneName), start(profilerNow()) { }
+        ~ProfileZone() { profilerRecord(name, start, profilerNow()); }
+
+    protected:
+
+        const char *name;
+        uint64_t start;
+};
+
+#else
+
+#define PROFILE_ZONE(name) ((void) 0)
+
+#endif
+
+
+#endif
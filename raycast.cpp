@@ -0,0 +1,414 @@
+#include "raycast.h"
+
+#include <float.h>
+#include <algorithm>
+
+using namespace std;
+
+
+/**************************************************************************************
+ **     Public Height Pyramid Functions
+ **
+ **************************************************************************************/
+
+HeightPyramid::HeightPyramid() : terrain(NULL), resolution(0), numLevels(0)
+{
+    for(int k = 0; k < 32; ++k)
+    {
+        size[k] = 0;
+        levels[k] = NULL;
+    }
+}
+
+HeightPyramid::~HeightPyramid()
+{
+    release();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  build - Level 1 from the vertex heights, each level above from the one
+//          below, until a single block covers the grid.
+
+void HeightPyramid::build(const Terrain *t)
+{
+    release();
+
+    terrain = t;
+    resolution = t->getResolution();
+    size[0] = resolution;
+    numLevels = 0;
+
+    while(size[numLevels] > 1)
+    {
+        int level = numLevels+1;
+        int n = (size[numLevels] + 1) / 2;
+
+        size[level] = n;
+        levels[level] = (Range*) trackedAlloc(MEMORY_TERRAIN, (size_t) n * n * sizeof(Range));
+
+        for(int br = 0; br < n; ++br)
+        {
+            for(int bc = 0; bc < n; ++bc)
+            {
+                Range r;
+
+                if(level == 1)
+                {
+                    // Every vertex of the (up to) 2 x 2 cells
+                    int rowEnd = min(2*br + 2, resolution);
+                    int colEnd = min(2*bc + 2, resolution);
+
+                    r.low = r.high = t->getVertexHeight(2*br, 2*bc);
+
+                    for(int row = 2*br; row <= rowEnd; ++row)
+                    {
+                        for(int col = 2*bc; col <= colEnd; ++col)
+                        {
+                            float h = t->getVertexHeight(row, col);
+                            r.low = min(r.low, h);
+                            r.high = max(r.high, h);
+                        }
+                    }
+                }
+                else
+                {
+                    // The (up to) four blocks of the level below
+                    int below = size[level-1];
+                    r = levels[level-1][(2*br) * below + 2*bc];
+
+                    for(int i = 0; i < 2; ++i)
+                    {
+                        for(int k = 0; k < 2; ++k)
+                        {
+                            if(2*br + i < below && 2*bc + k < below)
+                            {
+                                const Range & child = levels[level-1][(2*br + i) * below + 2*bc + k];
+                                r.low = min(r.low, child.low);
+                                r.high = max(r.high, child.high);
+                            }
+                        }
+                    }
+                }
+
+                levels[level][br * n + bc] = r;
+            }
+        }
+
+        numLevels = level;
+    }
+}
+
+bool HeightPyramid::castRay(const VECTOR3D & origin, const VECTOR3D & direction, RayHit *hit) const
+{
+    return march(origin, direction, FLT_MAX, hit);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  isHidden - Whether the ground blocks the segment between two points.
+//             Ground right at the far end (within a thousandth of the
+//             segment) does not count, so a point lying on the surface is
+//             still seen.
+
+bool HeightPyramid::isHidden(const VECTOR3D & from, const VECTOR3D & to) const
+{
+    RayHit hit;
+    return march(from, to - from, 0.999f, &hit);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  castRayBruteForce - Intersect the ray with every cell; keep the nearest.
+
+bool HeightPyramid::castRayBruteForce(const VECTOR3D & origin, const VECTOR3D & direction, RayHit *hit) const
+{
+    if(terrain == NULL || resolution < 1)
+        return false;
+
+    float cell = terrain->getCellSize();
+    float o[3] = { (origin.x - terrain->getCornerX()) / cell, origin.y, (origin.z - terrain->getCornerZ()) / cell };
+    float d[3] = { direction.x / cell, direction.y, direction.z / cell };
+
+    bool found = false;
+    float best = FLT_MAX;
+
+    for(int row = 0; row < resolution; ++row)
+    {
+        for(int col = 0; col < resolution; ++col)
+        {
+            // The part of the ray over this cell
+            float t0 = 0.0f, t1 = FLT_MAX;
+            float lo[2] = { (float) col, (float) row };
+            float ox[2] = { o[0], o[2] };
+            float dx[2] = { d[0], d[2] };
+            bool inside = true;
+
+            for(int a = 0; a < 2 && inside; ++a)
+            {
+                if(dx[a] == 0.0f)
+                {
+                    inside = ox[a] >= lo[a] && ox[a] <= lo[a] + 1.0f;
+                    continue;
+                }
+
+                float ta = (lo[a] - ox[a]) / dx[a];
+                float tb = (lo[a] + 1.0f - ox[a]) / dx[a];
+
+                t0 = max(t0, min(ta, tb));
+                t1 = min(t1, max(ta, tb));
+            }
+
+            float t;
+
+            if(inside && t0 <= t1 && t0 < best && hitCell(row, col, o, d, t0, t1, &t) && t < best)
+            {
+                best = t;
+                found = true;
+                hit->row = row;
+                hit->col = col;
+            }
+        }
+    }
+
+    if(found)
+    {
+        hit->t = best;
+        hit->point = origin + direction * best;
+    }
+
+    return found;
+}
+
+
+/**************************************************************************************
+ **     Private Height Pyramid Functions
+ **
+ **************************************************************************************/
+
+HeightPyramid::Range HeightPyramid::getRange(int level, int row, int col) const
+{
+    if(level > 0)
+        return levels[level][row * size[level] + col];
+
+    float h00 = terrain->getVertexHeight(row,   col), h01 = terrain->getVertexHeight(row,   col+1);
+    float h10 = terrain->getVertexHeight(row+1, col), h11 = terrain->getVertexHeight(row+1, col+1);
+
+    Range r;
+    r.low = min(min(h00, h01), min(h10, h11));
+    r.high = max(max(h00, h01), max(h10, h11));
+
+    return r;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  march - Walk the blocks the ray crosses for t in [0, tLimit], from the
+//          largest down. The walk keeps the level-0 cell it is in as
+//          integers and steps to the neighbouring block through the face
+//          the ray leaves by, so rounding cannot stall it on a block
+//          boundary.
+
+bool HeightPyramid::march(const VECTOR3D & origin, const VECTOR3D & direction, float tLimit, RayHit *hit) const
+{
+    if(terrain == NULL || resolution < 1)
+        return false;
+
+    // The ray in grid units: x and z in cells from vertex [0][0]
+    float cell = terrain->getCellSize();
+    float o[3] = { (origin.x - terrain->getCornerX()) / cell, origin.y, (origin.z - terrain->getCornerZ()) / cell };
+    float d[3] = { direction.x / cell, direction.y, direction.z / cell };
+
+    // Clip to the columns over the grid, and to where the ray is no higher
+    // than the highest ground (below the ground counts as a hit, so there
+    // is no lower bound)
+    float tmin = 0.0f, tmax = tLimit;
+
+    for(int a = 0; a < 3; a += 2)
+    {
+        if(d[a] == 0.0f)
+        {
+            if(o[a] < 0.0f || o[a] > resolution)
+                return false;
+            continue;
+        }
+
+        float t0 = (0.0f - o[a]) / d[a];
+        float t1 = (resolution - o[a]) / d[a];
+
+        tmin = max(tmin, min(t0, t1));
+        tmax = min(tmax, max(t0, t1));
+    }
+
+    float top = getRange(numLevels, 0, 0).high;
+
+    if(d[1] > 0.0f)
+        tmax = min(tmax, (top - o[1]) / d[1]);
+    else if(d[1] < 0.0f)
+        tmin = max(tmin, (top - o[1]) / d[1]);
+    else if(o[1] > top)
+        return false;
+
+    if(tmin > tmax)
+        return false;
+
+    // Starting cell; on a cell boundary, the one the ray goes into
+    float px = o[0] + d[0]*tmin;
+    float pz = o[2] + d[2]*tmin;
+    int col = (int) floorf(px);
+    int row = (int) floorf(pz);
+
+    if(d[0] < 0.0f && col == px) col--;
+    if(d[2] < 0.0f && row == pz) row--;
+
+    col = min(max(col, 0), resolution-1);
+    row = min(max(row, 0), resolution-1);
+
+    float t = tmin;
+    int level = numLevels;
+
+    while(true)
+    {
+        int bc = col >> level, br = row >> level;
+        int x0 = bc << level, x1 = min((bc+1) << level, resolution);
+        int z0 = br << level, z1 = min((br+1) << level, resolution);
+
+        // Where the ray leaves the block
+        float tx = (d[0] > 0.0f) ? (x1 - o[0]) / d[0] : (d[0] < 0.0f) ? (x0 - o[0]) / d[0] : FLT_MAX;
+        float tz = (d[2] > 0.0f) ? (z1 - o[2]) / d[2] : (d[2] < 0.0f) ? (z0 - o[2]) / d[2] : FLT_MAX;
+        float tExit = min(min(tx, tz), tmax);
+
+        Range r = getRange(level, br, bc);
+        float y0 = o[1] + d[1]*t;
+        float y1 = o[1] + d[1]*tExit;
+
+        // Skip blocks the ray passes over; a ray that enters a block below
+        // its lowest point is under the ground already
+        if(min(y0, y1) <= r.high)
+        {
+            if(y0 < r.low)
+            {
+                hit->t = t;
+                hit->point = origin + direction * t;
+                hit->row = row;
+                hit->col = col;
+                return true;
+            }
+
+            if(level > 0)
+            {
+                level--;
+                continue;
+            }
+
+            float tHit;
+
+            if(hitCell(row, col, o, d, t, tExit, &tHit))
+            {
+                hit->t = tHit;
+                hit->point = origin + direction * tHit;
+                hit->row = row;
+                hit->col = col;
+                return true;
+            }
+        }
+
+        // Move on to the next block, through the face the ray leaves by
+        if(tExit >= tmax)
+            return false;
+
+        if(tx <= tz)
+        {
+            col = (d[0] > 0.0f) ? x1 : x0-1;
+            row = min(max((int) floorf(o[2] + d[2]*tExit), z0), z1-1);
+        }
+
+        if(tz <= tx)
+        {
+            row = (d[2] > 0.0f) ? z1 : z0-1;
+
+            if(tx > tz)
+                col = min(max((int) floorf(o[0] + d[0]*tExit), x0), x1-1);
+        }
+
+        if(col < 0 || col >= resolution || row < 0 || row >= resolution)
+            return false;
+
+        t = tExit;
+
+        if(level < numLevels)
+            level++;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  hitCell - Along the ray the cell's bilinear height is a quadratic in t,
+//            so the height of the ray above the ground is too:
+//            f(t) = A t^2 + B t + C. Return its first root in [t0, t1], or
+//            t0 if the ray is already below the ground there.
+
+bool HeightPyramid::hitCell(int row, int col, const float *o, const float *d, float t0, float t1, float *t) const
+{
+    double h00 = terrain->getVertexHeight(row,   col), h01 = terrain->getVertexHeight(row,   col+1);
+    double h10 = terrain->getVertexHeight(row+1, col), h11 = terrain->getVertexHeight(row+1, col+1);
+
+    // h = h00 + a fx + b fz + c fx fz, with fx = px + dx t and fz = pz + dz t
+    double a = h01 - h00, b = h10 - h00, c = h00 - h01 - h10 + h11;
+    double px = o[0] - col, pz = o[2] - row;
+    double dx = d[0], dz = d[2];
+
+    double A = -c * dx * dz;
+    double B = d[1] - a*dx - b*dz - c*(px*dz + pz*dx);
+    double C = o[1] - h00 - a*px - b*pz - c*px*pz;
+
+    if((A*t0 + B)*t0 + C <= 0.0)
+    {
+        *t = t0;
+        return true;
+    }
+
+    double roots[2];
+    int numRoots = 0;
+
+    if(fabs(A) < 1e-12)
+    {
+        if(B != 0.0)
+            roots[numRoots++] = -C / B;
+    }
+    else
+    {
+        double disc = B*B - 4.0*A*C;
+
+        if(disc < 0.0)
+            return false;
+
+        // Numerically stable form of the two roots
+        double q = -0.5 * (B + (B >= 0.0 ? sqrt(disc) : -sqrt(disc)));
+        roots[numRoots++] = q / A;
+
+        if(q != 0.0)
+            roots[numRoots++] = C / q;
+
+        if(numRoots == 2 && roots[1] < roots[0])
+            swap(roots[0], roots[1]);
+    }
+
+    for(int i = 0; i < numRoots; ++i)
+    {
+        if(roots[i] >= t0 && roots[i] <= t1)
+        {
+            *t = (float) roots[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void HeightPyramid::release()
+{
+    for(int k = 0; k < 32; ++k)
+    {
+        trackedFree(levels[k]);
+        levels[k] = NULL;
+        size[k] = 0;
+    }
+
+    numLevels = 0;
+}
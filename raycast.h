@@ -0,0 +1,85 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include <cmath>
+
+#include "VECTOR3D.h"
+#include "terrain.h"
+#include "memtrack.h"
+
+// Where a ray meets the ground
+typedef struct RayHit {
+    float t;        // distance along the ray, in units of its direction vector
+    VECTOR3D point;
+    int row, col;   // grid cell hit (the quad whose corner is vertex [row][col])
+} RayHit;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  HeightPyramid - Min/max mip pyramid over a terrain, for casting rays.
+//
+//      Level k holds the lowest and highest height of each 2^k x 2^k block
+//      of grid cells. A ray walks the pyramid from the top: a block it
+//      passes entirely above is skipped in one step, one it enters below
+//      the lowest point is hit where it enters, otherwise the ray descends
+//      into the block. Level 0 (single cells) is not stored;
+//      it is read from the four vertex heights. In a cell the ray is
+//      intersected with the same bilinear surface as Terrain::getHeightAt.
+//
+//      The terrain must outlive the pyramid and must not change after
+//      build().
+
+class HeightPyramid
+{
+    public:
+
+        HeightPyramid();
+        ~HeightPyramid();
+
+        void build(const Terrain *t);
+
+        // First point where origin + t*direction (t >= 0) meets the ground;
+        // false if it never does. A ray that starts under the ground hits
+        // at t = 0. direction need not be normalized.
+        bool castRay(const VECTOR3D & origin, const VECTOR3D & direction, RayHit *hit) const;
+
+        // Whether the ground blocks the line of sight between two points
+        // (occlusion culling)
+        bool isHidden(const VECTOR3D & from, const VECTOR3D & to) const;
+
+        // The same result as castRay found by testing every cell, for
+        // checking and benchmarking castRay
+        bool castRayBruteForce(const VECTOR3D & origin, const VECTOR3D & direction, RayHit *hit) const;
+
+    protected:
+
+        typedef struct Range {
+            float low;
+            float high;
+        } Range;
+
+        const Terrain *terrain;
+        int resolution;
+        int numLevels;       // stored levels are 1 .. numLevels
+        int size[32];        // blocks per side of each level
+        Range *levels[32];   // lowest and highest height per block, row-major
+
+        Range getRange(int level, int row, int col) const;
+
+        // castRay limited to t <= tLimit
+        bool march(const VECTOR3D & origin, const VECTOR3D & direction, float tLimit, RayHit *hit) const;
+
+        // Intersect the ray with cell (row, col) for t in [t0, t1]; the ray
+        // is given in grid units (x and z measured in cells from vertex [0][0])
+        bool hitCell(int row, int col, const float *o, const float *d, float t0, float t1, float *t) const;
+
+        void release();
+
+    private:
+
+        HeightPyramid(const HeightPyramid &);            // not copyable
+        HeightPyramid & operator=(const HeightPyramid &);
+};
+
+
+#endif
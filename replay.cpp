@@ -0,0 +1,208 @@
+#include "replay.h"
+
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+static const char replayMagic[4] = { 'B', 'B', 'R', 'P' };
+
+
+/**************************************************************************************
+ **     Byte Functions
+ **
+ **************************************************************************************/
+
+static void writeU32(FILE *f, uint32_t v)
+{
+    unsigned char b[4] = { (unsigned char) v, (unsigned char)(v >> 8),
+                           (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+    fwrite(b, 1, 4, f);
+}
+
+static bool readU32(FILE *f, uint32_t *v)
+{
+    unsigned char b[4];
+
+    if(fread(b, 1, 4, f) != 4)
+        return false;
+
+    *v = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) b[3] << 24);
+    return true;
+}
+
+static void writeVarint(FILE *f, uint32_t v)
+{
+    while(v >= 0x80)
+    {
+        fputc((int)(v & 0x7f) | 0x80, f);
+        v >>= 7;
+    }
+
+    fputc((int) v, f);
+}
+
+static bool readVarint(FILE *f, uint32_t *v)
+{
+    *v = 0;
+
+    for(int shift = 0; shift < 35; shift += 7)
+    {
+        int c = fgetc(f);
+
+        if(c == EOF)
+            return false;
+
+        *v |= (uint32_t)(c & 0x7f) << shift;
+
+        if((c & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+/**************************************************************************************
+ **     Input Recorder Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  open - Create the file and write the header.
+
+bool InputRecorder::open(const char *path, const ReplayHeader & header)
+{
+    close();
+
+    file = fopen(path, "wb");
+
+    if(file == NULL)
+    {
+        cerr << "Cannot create replay file " << path << "\n";
+        return false;
+    }
+
+    fwrite(replayMagic, 1, 4, file);
+    fputc(REPLAY_VERSION, file);
+    fputc(header.flags, file);
+    writeU32(file, header.seed);
+    writeU32(file, header.numTargets);
+    fputc(header.maxBombs, file);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  recordTick - Append the events applied in one tick and the state hash
+//               after it.
+
+void InputRecorder::recordTick(const vector<InputEvent> & events, uint32_t hash)
+{
+    if(file == NULL)
+        return;
+
+    writeVarint(file, (uint32_t) events.size());
+
+    for(size_t i = 0; i < events.size(); ++i)
+    {
+        fputc(events[i].kind, file);
+        fputc(events[i].code, file);
+    }
+
+    writeU32(file, hash);
+}
+
+void InputRecorder::close()
+{
+    if(file != NULL)
+    {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+
+/**************************************************************************************
+ **     Input Replay Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  open - Open a replay file and read its header.
+
+bool InputReplay::open(const char *path)
+{
+    close();
+
+    file = fopen(path, "rb");
+
+    if(file == NULL)
+    {
+        cerr << "Cannot open replay file " << path << "\n";
+        return false;
+    }
+
+    char magic[4];
+    uint32_t seed, numTargets;
+
+    bool valid = fread(magic, 1, 4, file) == 4 && memcmp(magic, replayMagic, 4) == 0
+              && fgetc(file) == REPLAY_VERSION;
+
+    int flags = valid ? fgetc(file) : EOF;
+    int maxBombs = EOF;
+
+    if(flags != EOF && readU32(file, &seed) && readU32(file, &numTargets))
+        maxBombs = fgetc(file);
+
+    if(maxBombs == EOF)
+    {
+        cerr << path << " is not a version " << REPLAY_VERSION << " replay file\n";
+        close();
+        return false;
+    }
+
+    header.flags = (unsigned char) flags;
+    header.seed = seed;
+    header.numTargets = numTargets;
+    header.maxBombs = (unsigned char) maxBombs;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  readTick - Read the events of the next tick and the state hash expected
+//             after it.
+
+bool InputReplay::readTick(vector<InputEvent> & events, uint32_t *hash)
+{
+    events.clear();
+
+    uint32_t n;
+
+    if(file == NULL || !readVarint(file, &n))
+        return false;
+
+    for(uint32_t i = 0; i < n; ++i)
+    {
+        int kind = fgetc(file);
+        int code = fgetc(file);
+
+        if(kind == EOF || code == EOF)
+            return false;
+
+        InputEvent e = { (unsigned char) kind, (unsigned char) code };
+        events.push_back(e);
+    }
+
+    return readU32(file, hash);
+}
+
+void InputReplay::close()
+{
+    if(file != NULL)
+    {
+        fclose(file);
+        file = NULL;
+    }
+}
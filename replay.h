@@ -0,0 +1,103 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#include "game.h"
+
+#define REPLAY_VERSION 4
+#define REPLAY_FLAG_NOISE   1 // terrain generated from noise instead of blobs
+#define REPLAY_FLAG_COMPACT 2 // compact (quantized) terrain
+#define REPLAY_FLAG_RESPAWN 4 // targets that are hit are replaced (see Game::setRules)
+#define REPLAY_FLAG_CRATERS 8 // bombs leave craters
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  ReplayHeader - Everything needed to rebuild the world a recording was
+//                 made in.
+
+typedef struct ReplayHeader {
+    unsigned int seed;
+    unsigned int numTargets;
+    unsigned char flags;
+    unsigned char maxBombs; // bombs allowed in the air at once
+} ReplayHeader;
+
+
+//  Replay file layout (integers are little-endian):
+//
+//      "BBRP"  magic
+//      u8      version
+//      u8      flags
+//      u32     seed
+//      u32     number of targets
+//      u8      bombs allowed in the air at once
+//
+//  then one record per simulation tick:
+//
+//      varint  number of events in the tick
+//      u8 u8   kind and code of each event
+//      u32     game state hash after the tick
+//
+//  A tick without input costs five bytes.
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  InputRecorder - Writes a replay file, one tick at a time.
+
+class InputRecorder
+{
+    public:
+
+        InputRecorder() : file(NULL) { }
+        ~InputRecorder() { close(); }
+
+        bool open(const char *path, const ReplayHeader & header); // false if the file cannot be created
+        void recordTick(const std::vector<InputEvent> & events, uint32_t hash);
+        void close();
+
+        bool isOpen() const { return file != NULL; }
+
+    protected:
+
+        FILE *file;
+
+    private:
+
+        InputRecorder(const InputRecorder &);            // not copyable
+        InputRecorder & operator=(const InputRecorder &);
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  InputReplay - Reads a replay file back, one tick at a time.
+
+class InputReplay
+{
+    public:
+
+        InputReplay() : file(NULL) { }
+        ~InputReplay() { close(); }
+
+        bool open(const char *path); // false if the file is missing or not a replay
+        bool readTick(std::vector<InputEvent> & events, uint32_t *hash); // false at the end of the file
+        void close();
+
+        bool isOpen() const { return file != NULL; }
+        const ReplayHeader & getHeader() const { return header; }
+
+    protected:
+
+        FILE *file;
+        ReplayHeader header;
+
+    private:
+
+        InputReplay(const InputReplay &);            // not copyable
+        InputReplay & operator=(const InputReplay &);
+};
+
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// Stream ids, one per subsystem, so that equal seeds give unrelated sequences
+#define RNG_STREAM_TERRAIN 1
+#define RNG_STREAM_TARGETS 2
+#define RNG_STREAM_GAME    3
+#define RNG_STREAM_NOISE   4
+#define RNG_STREAM_INPUT   5
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  Rng - Small seeded random number generator (PCG32). Unlike rand(), every
+//        subsystem owns its own generator, so the numbers one of them draws
+//        do not depend on how often the others are called, and the sequence
+//        is the same with every compiler and C library.
+
+class Rng
+{
+    public:
+
+        Rng(uint64_t seed = 0, uint64_t stream = 0) { setSeed(seed, stream); }
+
+        void setSeed(uint64_t seed, uint64_t stream = 0)
+        {
+            state = 0;
+            inc = (stream << 1) | 1;
+            next();
+            state += seed;
+            next();
+        }
+
+        uint32_t next()
+        {
+            uint64_t old = state;
+            state = old * 6364136223846793005ULL + inc;
+
+            uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+            uint32_t rot = (uint32_t)(old >> 59);
+
+            return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+        }
+
+        int nextInt(int n) { return (int)(next() % (uint32_t) n); } // in [0, n)
+        float nextFloat() { return (next() >> 8) * (1.0f / 16777216.0f); } // in [0, 1), exact in every build
+
+    protected:
+
+        uint64_t state;
+        uint64_t inc;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  deriveSeed - A seed for one subsystem, derived from the session seed.
+
+inline unsigned int deriveSeed(unsigned int seed, int stream)
+{
+    Rng r(seed, stream);
+    return r.next();
+}
+
+
+#endif
@@ -0,0 +1,268 @@
+#include "savestate.h"
+#include "memtrack.h"
+#include "profiler.h"
+
+#include <iostream>
+
+#if !defined(_WIN32)
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char stateMagic[4] = { 'B', 'B', 'S', 'S' };
+
+#define SAVESTATE_BYTE_ORDER 0x01020304u
+#define SAVESTATE_HEADER_SIZE 24 // magic, version, byte order, section count, directory offset
+
+
+/**************************************************************************************
+ **     State Writer Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  open - Create the file and write the header; the directory offset is
+//         filled in by close().
+
+bool StateWriter::open(const char *path)
+{
+    close();
+
+    file = fopen(path, "wb");
+
+    if(file == NULL)
+    {
+        cerr << "Cannot create save state " << path << "\n";
+        return false;
+    }
+
+    failed = false;
+    position = 0;
+    sections.clear();
+
+    unsigned char header[SAVESTATE_HEADER_SIZE];
+    uint32_t version = SAVESTATE_VERSION;
+    uint32_t byteOrder = SAVESTATE_BYTE_ORDER;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, stateMagic, 4);
+    memcpy(header + 4, &version, 4);
+    memcpy(header + 8, &byteOrder, 4);
+
+    write(header, sizeof(header));
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  beginSection - Start a section on the next aligned offset.
+
+void StateWriter::beginSection(uint32_t tag, uint32_t part)
+{
+    pad();
+
+    Section s = { tag, part, position, 0 };
+    sections.push_back(s);
+}
+
+void StateWriter::write(const void *data, size_t bytes)
+{
+    if(file == NULL || bytes == 0)
+        return;
+
+    if(fwrite(data, 1, bytes, file) != bytes)
+        failed = true;
+
+    position += bytes;
+
+    if(!sections.empty())
+        sections.back().bytes = position - sections.back().offset;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  close - Append the directory and point the header at it.
+
+bool StateWriter::close()
+{
+    if(file == NULL)
+        return false;
+
+    pad();
+
+    uint64_t directory = position;
+    uint32_t numSections = (uint32_t) sections.size();
+
+    if(!sections.empty() && fwrite(&sections[0], sizeof(Section), sections.size(), file) != sections.size())
+        failed = true;
+
+    if(fseek(file, 12, SEEK_SET) != 0
+    || fwrite(&numSections, 4, 1, file) != 1
+    || fwrite(&directory, 8, 1, file) != 1)
+        failed = true;
+
+    if(fclose(file) != 0)
+        failed = true;
+
+    file = NULL;
+    sections.clear();
+
+    return !failed;
+}
+
+void StateWriter::pad()
+{
+    static const unsigned char zeros[SAVESTATE_ALIGN] = { 0 };
+
+    size_t gap = (size_t)((SAVESTATE_ALIGN - position % SAVESTATE_ALIGN) % SAVESTATE_ALIGN);
+
+    if(gap > 0 && file != NULL)
+    {
+        if(fwrite(zeros, 1, gap, file) != gap)
+            failed = true;
+
+        position += gap;
+    }
+}
+
+
+/**************************************************************************************
+ **     State Reader Functions
+ **
+ **************************************************************************************/
+
+StateReader::StateReader() : data(NULL), size(0), mapped(false), sections(NULL), numSections(0)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  open - Map the file and check its header and directory. Nothing is
+//         parsed: find() hands out pointers into the mapping.
+
+bool StateReader::open(const char *path)
+{
+    PROFILE_ZONE("StateReader::open");
+
+    close();
+
+#if defined(_WIN32)
+    FILE *f = fopen(path, "rb");
+
+    if(f != NULL && fseek(f, 0, SEEK_END) == 0)
+    {
+        long length = ftell(f);
+        void *buffer = (length > 0) ? trackedAlloc(MEMORY_TRANSIENT, (size_t) length) : NULL;
+
+        if(buffer != NULL && fseek(f, 0, SEEK_SET) == 0 && fread(buffer, 1, (size_t) length, f) == (size_t) length)
+        {
+            data = (const unsigned char*) buffer;
+            size = (size_t) length;
+        }
+        else
+        {
+            trackedFree(buffer);
+        }
+    }
+
+    if(f != NULL)
+        fclose(f);
+#else
+    int fd = ::open(path, O_RDONLY);
+    struct stat st;
+
+    if(fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if(p != MAP_FAILED)
+        {
+            data = (const unsigned char*) p;
+            size = (size_t) st.st_size;
+            mapped = true;
+        }
+    }
+
+    // The mapping stays valid without the descriptor
+    if(fd >= 0)
+        ::close(fd);
+#endif
+
+    if(data == NULL)
+    {
+        cerr << "Cannot open save state " << path << "\n";
+        return false;
+    }
+
+    uint32_t version = 0, byteOrder = 0;
+    uint64_t directory = 0;
+
+    if(size >= SAVESTATE_HEADER_SIZE)
+    {
+        memcpy(&version, data + 4, 4);
+        memcpy(&byteOrder, data + 8, 4);
+        memcpy(&numSections, data + 12, 4);
+        memcpy(&directory, data + 16, 8);
+    }
+
+    bool valid = size >= SAVESTATE_HEADER_SIZE && memcmp(data, stateMagic, 4) == 0
+              && version == SAVESTATE_VERSION && byteOrder == SAVESTATE_BYTE_ORDER
+              && directory % SAVESTATE_ALIGN == 0 && directory <= size
+              && numSections <= (size - directory) / sizeof(Section);
+
+    if(valid)
+    {
+        sections = (const Section*)(data + directory);
+
+        for(uint32_t s = 0; s < numSections && valid; ++s)
+            valid = sections[s].offset <= directory && sections[s].bytes <= directory - sections[s].offset;
+    }
+
+    if(!valid)
+    {
+        cerr << path << " is not a version " << SAVESTATE_VERSION << " save state from this kind of machine\n";
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void StateReader::close()
+{
+    if(data != NULL)
+    {
+#if defined(_WIN32)
+        trackedFree((void*) data);
+#else
+        if(mapped)
+            munmap((void*) data, size);
+#endif
+    }
+
+    data = NULL;
+    size = 0;
+    mapped = false;
+    sections = NULL;
+    numSections = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  find - The section with this tag and part. Files hold a few dozen
+//         sections, so the directory is simply searched.
+
+const void *StateReader::find(uint32_t tag, uint32_t part, size_t *bytes) const
+{
+    for(uint32_t s = 0; s < numSections; ++s)
+    {
+        if(sections[s].tag == tag && sections[s].part == part)
+        {
+            *bytes = (size_t) sections[s].bytes;
+            return data + sections[s].offset;
+        }
+    }
+
+    *bytes = 0;
+    return NULL;
+}
@@ -0,0 +1,159 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#define SAVESTATE_VERSION 1
+#define SAVESTATE_ALIGN 64 // every section starts on a cache line of the file
+
+// Section tags, one per owner of saved state; each owner numbers its parts
+#define SAVESTATE_TAG(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define STATE_GAME         SAVESTATE_TAG('G', 'A', 'M', 'E') // balloon, score, rules, generator
+#define STATE_BOMBS        SAVESTATE_TAG('B', 'O', 'M', 'B') // bombs in the air
+#define STATE_BOMB_IDS     SAVESTATE_TAG('B', 'I', 'D', 'S') // their slot table
+#define STATE_GROUND       SAVESTATE_TAG('G', 'R', 'N', 'D') // craters (the overlay tiles)
+#define STATE_TARGETS      SAVESTATE_TAG('T', 'G', 'T', 'S') // target columns and active set
+#define STATE_TARGET_IDS   SAVESTATE_TAG('T', 'I', 'D', 'S') // their slot table
+#define STATE_TARGET_WHEEL SAVESTATE_TAG('T', 'W', 'H', 'L') // parked targets' timers
+
+
+//  Save state file layout:
+//
+//      "BBSS"  magic
+//      u32     version
+//      u32     0x01020304, in the byte order of the machine that wrote it
+//      u32     number of sections
+//      u64     offset of the section directory
+//
+//  then the sections, each starting on a SAVESTATE_ALIGN boundary, and the
+//  directory at the end, one entry per section:
+//
+//      u32     tag (the owner, STATE_*)
+//      u32     part (which of the owner's arrays)
+//      u64     offset of the first byte
+//      u64     length in bytes
+//
+//  A section is the bytes of one array exactly as they are in memory, so
+//  the file is read back by mapping it and copying every section into
+//  place. Integers, floats and structs are stored as the machine holds
+//  them: a file only loads on a machine with the same byte order (checked)
+//  and into the build that wrote it (the version is bumped whenever a
+//  saved struct changes).
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  StateWriter - Writes a save state file. Sections are streamed straight
+//                from the arrays that hold the state; nothing is copied.
+
+class StateWriter
+{
+    public:
+
+        StateWriter() : file(NULL), failed(false) { }
+        ~StateWriter() { close(); }
+
+        bool open(const char *path); // false if the file cannot be created
+
+        // Start a new section (ending the previous one) and append to it
+        void beginSection(uint32_t tag, uint32_t part);
+        void write(const void *data, size_t bytes);
+
+        // A whole section from one array
+        template<typename T> void writeSection(uint32_t tag, uint32_t part, const T *data, size_t count)
+        {
+            beginSection(tag, part);
+            write(data, count * sizeof(T));
+        }
+
+        bool close(); // write the directory; false if any write failed
+
+    protected:
+
+        typedef struct Section {
+            uint32_t tag;
+            uint32_t part;
+            uint64_t offset;
+            uint64_t bytes;
+        } Section;
+
+        FILE *file;
+        bool failed;
+        uint64_t position; // bytes written so far
+        std::vector<Section> sections;
+
+        void pad(); // zeros up to the next SAVESTATE_ALIGN boundary
+
+    private:
+
+        StateWriter(const StateWriter &);            // not copyable
+        StateWriter & operator=(const StateWriter &);
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  StateReader - Maps a save state file into memory (reads it whole where
+//                mapping is not available) and finds its sections.
+
+class StateReader
+{
+    public:
+
+        StateReader();
+        ~StateReader() { close(); }
+
+        bool open(const char *path); // false if the file is missing or not a save state
+        void close();
+
+        // The bytes of a section, NULL when the file has none
+        const void *find(uint32_t tag, uint32_t part, size_t *bytes) const;
+
+        // Copy a section of exactly count values; false when it is missing
+        // or has another length
+        template<typename T> bool readSection(uint32_t tag, uint32_t part, T *data, size_t count) const
+        {
+            size_t bytes;
+            const void *p = find(tag, part, &bytes);
+
+            if(p == NULL || bytes != count * sizeof(T))
+                return false;
+
+            memcpy(data, p, bytes);
+            return true;
+        }
+
+        // Length of a section in values of T, 0 when it is missing
+        template<typename T> size_t countOf(uint32_t tag, uint32_t part) const
+        {
+            size_t bytes = 0;
+            find(tag, part, &bytes);
+            return bytes / sizeof(T);
+        }
+
+    protected:
+
+        typedef struct Section {
+            uint32_t tag;
+            uint32_t part;
+            uint64_t offset;
+            uint64_t bytes;
+        } Section;
+
+        const unsigned char *data; // the whole file
+        size_t size;
+        bool mapped;               // data is a mapping, not a tracked buffer
+        const Section *sections;   // the directory, inside data
+        uint32_t numSections;
+
+    private:
+
+        StateReader(const StateReader &);            // not copyable
+        StateReader & operator=(const StateReader &);
+};
+
+
+#endif
@@ -0,0 +1,322 @@
+#ifndef SLOTMAP_H
+#define SLOTMAP_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "memtrack.h"
+#include "savestate.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  SlotHandle - Names one entry of a slot table. The index stays the same
+//               for the entry's whole life; the generation changes when the
+//               entry is removed, so a handle kept after that no longer
+//               matches, even once the index is reused. Live entries never
+//               have generation 0, so a zeroed handle names nothing.
+
+typedef struct SlotHandle {
+    int index;
+    uint32_t generation;
+} SlotHandle;
+
+inline bool isNullHandle(const SlotHandle & h) { return h.generation == 0; }
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  SlotTable - The bookkeeping of a slot map, for values stored elsewhere
+//              (in structure-of-arrays columns, for example).
+//
+//      Live entries are packed at positions [0, size()), so a loop over
+//      them never meets a removed one. insert() takes an index from the
+//      free list and appends at position size(); remove() moves the last
+//      entry into the hole. Both are O(1), and the owner of the values
+//      does the same move on its side. A fixed number of slots is made
+//      when the table is allocated, so it never allocates afterwards.
+//
+//      remove(h, false) keeps the index off the free list until recycle()
+//      is called: for an index something else may still refer to (a timer
+//      that has yet to fire, for example).
+
+template<MemoryTag TAG> class SlotTable
+{
+    public:
+
+        SlotTable() : freeHead(-1) { }
+
+        ///////////////////////////////////////////////////////////////////////
+        //  allocate - Make n empty slots (removes every entry).
+
+        void allocate(int n)
+        {
+            slots.assign(n, Slot());
+            owners.clear();
+            owners.reserve(n);
+
+            for(int i = 0; i < n; ++i)
+                slots[i].nextFree = (i+1 < n) ? i+1 : -1;
+
+            freeHead = (n > 0) ? 0 : -1;
+        }
+
+        ///////////////////////////////////////////////////////////////////////
+        //  insert - Add an entry at position size(). Returns a null handle
+        //           when every slot is taken.
+
+        SlotHandle insert()
+        {
+            SlotHandle h = { -1, 0 };
+
+            if(freeHead < 0)
+                return h;
+
+            h.index = freeHead;
+
+            Slot & s = slots[h.index];
+            freeHead = s.nextFree;
+            s.nextFree = -1;
+            s.position = (int) owners.size();
+            owners.push_back(h.index);
+
+            h.generation = s.generation;
+            return h;
+        }
+
+        ///////////////////////////////////////////////////////////////////////
+        //  remove - Remove the entry and return the position it had, or -1
+        //           for a stale handle. The entry that was last (if any
+        //           other) now has that position.
+
+        int remove(const SlotHandle & h, bool recycleIndex = true)
+        {
+            int position = find(h);
+
+            if(position < 0)
+                return -1;
+
+            int moved = owners.back();
+            owners[position] = moved;
+            slots[moved].position = position;
+            owners.pop_back();
+
+            Slot & s = slots[h.index];
+            s.position = -1;
+            s.generation = (s.generation == UINT32_MAX) ? 1 : s.generation+1;
+
+            if(recycleIndex)
+                recycle(h.index);
+
+            return position;
+        }
+
+        ///////////////////////////////////////////////////////////////////////
+        //  recycle - Return an index kept back by remove(h, false).
+
+        void recycle(int index)
+        {
+            slots[index].nextFree = freeHead;
+            freeHead = index;
+        }
+
+        // Position of the entry, -1 when the handle is stale
+        int find(const SlotHandle & h) const
+        {
+            if(h.index < 0 || h.index >= (int) slots.size() || slots[h.index].generation != h.generation)
+                return -1;
+
+            return slots[h.index].position;
+        }
+
+        // Position of the live entry with this index, -1 when there is none
+        int findIndex(int index) const { return slots[index].position; }
+
+        SlotHandle handleAt(int position) const
+        {
+            SlotHandle h = { owners[position], slots[owners[position]].generation };
+            return h;
+        }
+
+        int indexAt(int position) const { return owners[position]; }
+
+        int size() const { return (int) owners.size(); }
+        int getCapacity() const { return (int) slots.size(); }
+
+        ///////////////////////////////////////////////////////////////////////
+        //  saveState / loadState - The slots, positions and free list, as
+        //                          parts 0 to 2 of a save state section.
+        //                          The table must have been allocated with
+        //                          the same capacity before loading. The
+        //                          saved table is checked where it lies in
+        //                          the file (every index in range, the
+        //                          positions and owners naming each other,
+        //                          a free list of free slots without loops)
+        //                          and only copied in if it is sound; false
+        //                          leaves the table as it was.
+
+        void saveState(StateWriter & w, uint32_t tag) const
+        {
+            w.writeSection(tag, 0, &freeHead, 1);
+            w.writeSection(tag, 1, slots.data(), slots.size());
+            w.writeSection(tag, 2, owners.data(), owners.size());
+        }
+
+        bool loadState(const StateReader & r, uint32_t tag)
+        {
+            size_t headBytes, slotBytes, ownerBytes;
+
+            const int *head = (const int*) r.find(tag, 0, &headBytes);
+            const Slot *s = (const Slot*) r.find(tag, 1, &slotBytes);
+            const int *o = (const int*) r.find(tag, 2, &ownerBytes);
+
+            int capacity = (int) slots.size();
+            int n = (int)(ownerBytes / sizeof(int));
+
+            if(head == NULL || headBytes != sizeof(int) || slotBytes != slots.size() * sizeof(Slot)
+            || ownerBytes % sizeof(int) != 0 || n > capacity)
+                return false;
+
+            // Every owner names a slot that points back at it, and every
+            // slot that claims a position is that position's owner
+            for(int p = 0; p < n; ++p)
+            {
+                if(o[p] < 0 || o[p] >= capacity || s[o[p]].position != p)
+                    return false;
+            }
+
+            for(int i = 0; i < capacity; ++i)
+            {
+                if(s[i].generation == 0 || s[i].position < -1 || s[i].position >= n
+                || (s[i].position >= 0 && o[s[i].position] != i) || s[i].nextFree < -1 || s[i].nextFree >= capacity)
+                    return false;
+            }
+
+            // The free list holds free slots only, and ends
+            int steps = 0;
+
+            for(int i = *head; i != -1; i = s[i].nextFree)
+            {
+                if(i < 0 || i >= capacity || s[i].position != -1 || ++steps > capacity - n)
+                    return false;
+            }
+
+            freeHead = *head;
+            memcpy(slots.data(), s, slotBytes);
+            owners.assign(o, o + n); // keeps the reserved room
+
+            return true;
+        }
+
+        // Flags the indices on the free list (after loadState, to check
+        // what else refers to the free and kept-back indices)
+        void getFreeList(std::vector<char> & onFreeList) const
+        {
+            onFreeList.assign(slots.size(), 0);
+
+            for(int i = freeHead; i != -1; i = slots[i].nextFree)
+                onFreeList[i] = 1;
+        }
+
+        void swap(SlotTable & other)
+        {
+            slots.swap(other.slots);
+            owners.swap(other.owners);
+            std::swap(freeHead, other.freeHead);
+        }
+
+    protected:
+
+        typedef struct Slot {
+            uint32_t generation;
+            int position;  // place in owners[] while live, -1 otherwise
+            int nextFree;  // next index on the free list
+
+            Slot() : generation(1), position(-1), nextFree(-1) { }
+        } Slot;
+
+        std::vector<Slot, TrackedAllocator<Slot, TAG> > slots; // indexed by index
+        std::vector<int, TrackedAllocator<int, TAG> > owners;  // index of the entry at each position
+        int freeHead;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  SlotMap - Values of type T in a SlotTable: packed, reached by handle.
+//
+//      Every value is kept constructed for the life of the map and removal
+//      swaps the last one into the hole, so buffers a value owns (a vector,
+//      for example) are reused by whatever is inserted next instead of
+//      being freed.
+
+template<typename T, MemoryTag TAG> class SlotMap
+{
+    public:
+
+        SlotMap() { }
+
+        void allocate(int n) // room for n values (removes every value)
+        {
+            table.allocate(n);
+            values.resize(n);
+        }
+
+        // Copies value into position size(); a null handle when full
+        SlotHandle insert(const T & value)
+        {
+            SlotHandle h = table.insert();
+
+            if(!isNullHandle(h))
+                values[table.size()-1] = value;
+
+            return h;
+        }
+
+        bool remove(const SlotHandle & h) // false for a stale handle
+        {
+            int position = table.remove(h);
+
+            if(position < 0)
+                return false;
+
+            std::swap(values[position], values[table.size()]);
+            return true;
+        }
+
+        T *get(const SlotHandle & h) { int k = table.find(h); return (k < 0) ? NULL : &values[k]; }
+        const T *get(const SlotHandle & h) const { int k = table.find(h); return (k < 0) ? NULL : &values[k]; }
+
+        // Packed access: the values at positions [0, size()) are live, the
+        // rest up to getCapacity() are spares waiting to be reused
+        T & operator[](int position) { return values[position]; }
+        const T & operator[](int position) const { return values[position]; }
+        SlotHandle handleAt(int position) const { return table.handleAt(position); }
+        int indexAt(int position) const { return table.indexAt(position); }
+
+        int size() const { return table.size(); }
+        int getCapacity() const { return table.getCapacity(); }
+
+        // The handles and order of the values; after loadTable() the caller
+        // fills positions [0, size()) itself
+        void saveTable(StateWriter & w, uint32_t tag) const { table.saveState(w, tag); }
+        bool loadTable(const StateReader & r, uint32_t tag) { return table.loadState(r, tag); }
+
+        void swap(SlotMap & other) // the tables and the values
+        {
+            table.swap(other.table);
+            values.swap(other.values);
+        }
+
+    protected:
+
+        SlotTable<TAG> table;
+        std::vector<T, TrackedAllocator<T, TAG> > values;
+
+    private:
+
+        SlotMap(const SlotMap &);            // not copyable
+        SlotMap & operator=(const SlotMap &);
+};
+
+
+#endif
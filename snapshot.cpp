@@ -0,0 +1,69 @@
+#include "snapshot.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//  capture - Copy the state of the game that the renderer needs.
+
+void GameSnapshot::capture(const Game & game)
+{
+    const TargetPool & targets = game.targets;
+
+    tick = game.tick;
+    balloonPosition = game.balloonPosition;
+
+    numBombs = game.bombs.size();
+    bombPosition.resize(numBombs);
+    bombId.resize(numBombs);
+
+    for(int b = 0; b < numBombs; ++b)
+    {
+        bombPosition[b] = game.bombs[b].position;
+        bombId[b] = game.bombs.indexAt(b);
+    }
+
+    targetsLeft = game.targetsLeft;
+    activeTargets = targets.getActiveCount();
+    parkedTargets = targets.getParkedCount();
+
+    // Only the moving targets are visible, unless all of them are shown
+    int numCandidates = game.viewTargets ? targets.count : targets.getActiveCount();
+
+    targetX.resize(numCandidates);
+    targetY.resize(numCandidates);
+    targetZ.resize(numCandidates);
+    targetSize.resize(numCandidates);
+    targetId.resize(numCandidates);
+
+    numTargets = numCandidates;
+
+    for(int k = 0; k < numCandidates; ++k)
+    {
+        int i = game.viewTargets ? k : targets.findId(targets.activeId[k]);
+
+        targetX[k] = targets.x[i];
+        targetY[k] = targets.getY(i);
+        targetZ[k] = targets.z[i];
+        targetSize[k] = targets.size[i];
+        targetId[k] = targets.getId(i);
+    }
+
+    // FNV-1a over the drawn state (not the tick, which changes every time)
+    uint32_t h = HASH_SEED;
+
+    h = hashBytes(h, &balloonPosition, sizeof(VECTOR3D));
+    h = hashBytes(h, &numBombs, sizeof(numBombs));
+
+    if(numBombs > 0)
+        h = hashBytes(h, &bombPosition[0], numBombs * sizeof(VECTOR3D));
+
+    h = hashBytes(h, &numTargets, sizeof(numTargets));
+
+    if(numTargets > 0)
+    {
+        h = hashBytes(h, &targetX[0], numTargets * sizeof(float));
+        h = hashBytes(h, &targetY[0], numTargets * sizeof(float));
+        h = hashBytes(h, &targetZ[0], numTargets * sizeof(float));
+        h = hashBytes(h, &targetSize[0], numTargets * sizeof(float));
+    }
+
+    sceneHash = h;
+}
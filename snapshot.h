@@ -0,0 +1,98 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+#include "VECTOR3D.h"
+#include "game.h"
+#include "memtrack.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  GameSnapshot - A copy of everything the renderer draws for one tick:
+//                 the balloon, the bomb and the visible targets.
+
+class GameSnapshot
+{
+    public:
+
+        unsigned int tick;
+
+        VECTOR3D balloonPosition;
+
+        // Bombs in the air
+        int numBombs;
+        std::vector<VECTOR3D, TrackedAllocator<VECTOR3D, MEMORY_ENTITIES> > bombPosition;
+        std::vector<int, TrackedAllocator<int, MEMORY_ENTITIES> > bombId; // below MAX_BOMBS
+
+        // Visible targets (every target in view targets mode, otherwise the
+        // moving ones)
+        int numTargets;
+        std::vector<float, TrackedAllocator<float, MEMORY_ENTITIES> > targetX;
+        std::vector<float, TrackedAllocator<float, MEMORY_ENTITIES> > targetY;
+        std::vector<float, TrackedAllocator<float, MEMORY_ENTITIES> > targetZ;
+        std::vector<float, TrackedAllocator<float, MEMORY_ENTITIES> > targetSize;
+        std::vector<int, TrackedAllocator<int, MEMORY_ENTITIES> > targetId; // id in the pool
+
+        int targetsLeft;
+        int activeTargets;
+        int parkedTargets;
+
+        // Hash of everything above that is drawn; equal hashes draw the same
+        // picture, so the renderer can skip the frame
+        uint32_t sceneHash;
+
+        GameSnapshot() : tick(0), numBombs(0), numTargets(0), targetsLeft(0), activeTargets(0), parkedTargets(0), sceneHash(0) { }
+
+        void capture(const Game & game); // copy the game state (reuses the arrays)
+};
+
+
+#define SNAPSHOT_FRESH 4 // set on the shared index when it holds an unread snapshot
+#define SNAPSHOT_INDEX 3
+
+///////////////////////////////////////////////////////////////////////////////
+//  SnapshotBuffer - Lock-free hand-over of snapshots from one writer (the
+//                   simulation thread) to one reader (the render thread).
+//
+//      Three slots: the writer fills its back slot, the reader draws its
+//      front slot, and the third is swapped between them with a single
+//      atomic exchange. Neither side ever waits for the other; the reader
+//      always gets the newest finished snapshot.
+
+class SnapshotBuffer
+{
+    public:
+
+        SnapshotBuffer() : back(0), front(2), shared(1) { }
+
+        // Writer
+        GameSnapshot & getBack() { return slots[back]; }
+        void publish() { back = shared.exchange(back | SNAPSHOT_FRESH) & SNAPSHOT_INDEX; }
+
+        // Reader: the newest published snapshot; fresh tells whether it is
+        // different from the one returned last time
+        const GameSnapshot & acquire(bool *fresh)
+        {
+            *fresh = (shared.load() & SNAPSHOT_FRESH) != 0;
+
+            if(*fresh)
+                front = shared.exchange(front) & SNAPSHOT_INDEX;
+
+            return slots[front];
+        }
+
+    protected:
+
+        GameSnapshot slots[3];
+
+        int back;               // only touched by the writer
+        int front;              // only touched by the reader
+        std::atomic<int> shared;
+};
+
+
+#endif
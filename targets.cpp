@@ -0,0 +1,548 @@
+#include "targets.h"
+#include "profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(VECBATCH_SSE)
+  #include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Number of 4-byte columns in the pool block
+#define TARGET_COLUMNS 14
+
+// Columns kept in a save state: the per-target ones and the active set
+// (events is scratch, filled anew every tick)
+#define TARGET_SAVED_COLUMNS 8
+#define ACTIVE_SAVED_COLUMNS 5
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  TargetPoolState - The pool's counters and generator, part 0 of its save
+//                    state section; the columns follow as parts 1 and up.
+
+typedef struct TargetPoolState {
+    int capacity;
+    int count;
+    int numActive;
+    int numParked;
+    Rng rng;
+} TargetPoolState;
+
+
+/**************************************************************************************
+ **     Public Target Pool Functions
+ **
+ **************************************************************************************/
+
+TargetPool::TargetPool() : count(0), capacity(0), numActive(0), numParked(0), block(NULL), jobs(NULL), chunkSize(0)
+{
+    state = slot = activeId = events = NULL;
+    x = y = z = meshHeight = maxHeight = size = NULL;
+    activeY = activeDelta = activeTop = activeBottom = NULL;
+    rng.setSeed(0, RNG_STREAM_TARGETS);
+}
+
+TargetPool::~TargetPool()
+{
+    trackedFree(block);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  allocate - Reserve room for n targets. All columns share one block, each
+//             starting on a 64-byte cache line.
+
+void TargetPool::allocate(int n)
+{
+    int cap = (n + 15) & ~15; // 16 four-byte values per cache line
+
+    trackedFree(block);
+    block = trackedCalloc(MEMORY_ENTITIES, (size_t) cap * TARGET_COLUMNS + 16, 4);
+
+    // The block is only guaranteed 16-byte aligned; line the columns up
+    char *base = (char*)(((size_t) block + 63) & ~(size_t) 63);
+    size_t stride = (size_t) cap * 4;
+
+    state        = (int*)  (base + 0*stride);
+    x            = (float*)(base + 1*stride);
+    y            = (float*)(base + 2*stride);
+    z            = (float*)(base + 3*stride);
+    meshHeight   = (float*)(base + 4*stride);
+    maxHeight    = (float*)(base + 5*stride);
+    size         = (float*)(base + 6*stride);
+    slot         = (int*)  (base + 7*stride);
+    activeId     = (int*)  (base + 8*stride);
+    activeY      = (float*)(base + 9*stride);
+    activeDelta  = (float*)(base + 10*stride);
+    activeTop    = (float*)(base + 11*stride);
+    activeBottom = (float*)(base + 12*stride);
+    events       = (int*)  (base + 13*stride);
+
+    capacity = cap;
+    count = 0;
+    numActive = 0;
+    numParked = 0;
+    ids.allocate(cap);
+    wheel.clear();
+    wheel.reserve(cap);
+
+    // Room for every group and every target, so the per-tick lists never grow
+    pending.reserve(cap / 4);
+    expired.reserve(cap);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  setSeed - Seed the generator for wake-up heights and parking delays.
+
+void TargetPool::setSeed(unsigned int seed)
+{
+    rng.setSeed(seed, RNG_STREAM_TARGETS);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  setJobSystem - Split the per-tick pass over the active set into jobs.
+
+void TargetPool::setJobSystem(JobSystem *j)
+{
+    jobs = j;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  spawn - Add a waiting target standing on the terrain at position. The
+//          target hides its own height below the ground until it starts to
+//          move.
+
+SlotHandle TargetPool::spawn(const VECTOR3D & position, float targetSize, int ticksBeforeMoving)
+{
+    SlotHandle h = ids.insert();
+
+    if(isNullHandle(h))
+        return h;
+
+    int i = count++;
+
+    x[i] = position.x;
+    y[i] = position.y;
+    z[i] = position.z;
+
+    size[i] = targetSize;
+    meshHeight[i] = position.y - targetSize*2;
+    maxHeight[i] = 0.0f;
+
+    state[i] = TARGET_WAITING;
+    slot[i] = -1;
+
+    wheel.schedule(h.index, ticksBeforeMoving);
+    numParked++;
+
+    return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  despawn - Remove the target and move the last one into its columns. A
+//            parked target's timer is left in the wheel, and its id is
+//            only reused once the timer has fired.
+
+bool TargetPool::despawn(const SlotHandle & h)
+{
+    int i = ids.find(h);
+
+    if(i < 0)
+        return false;
+
+    bool parked = (state[i] == TARGET_WAITING);
+
+    if(parked)
+        numParked--;
+    else
+        removeActive(slot[i]);
+
+    ids.remove(h, !parked);
+
+    int last = --count;
+
+    if(i != last)
+    {
+        state[i]      = state[last];
+        x[i]          = x[last];
+        y[i]          = y[last];
+        z[i]          = z[last];
+        meshHeight[i] = meshHeight[last];
+        maxHeight[i]  = maxHeight[last];
+        size[i]       = size[last];
+        slot[i]       = slot[last];
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  update - Advance every target by one tick.
+//
+//      The pass over the active set is branch-free: each step is selected
+//      from masks (four targets per SSE2 register). Targets that finish
+//      moving are recorded in events[], and the groups that contain one are
+//      listed for a second, sparse pass. Finally the wheel wakes up the
+//      parked targets that are due; nothing else is touched.
+//
+//      With a job system the first pass runs in chunks, and the groups each
+//      chunk finds are joined in chunk order, giving the same list as a
+//      single pass.
+
+void TargetPool::update()
+{
+    PROFILE_ZONE("TargetPool::update");
+
+    int n = numActive;
+    pending.clear();
+
+    if(jobs != NULL && jobs->getNumThreads() > 1 && n > TARGET_CHUNK_MIN)
+    {
+        chunkSize = jobs->chunkSizeFor(n, TARGET_CHUNK_MIN, 4);
+        size_t chunks = (n + chunkSize - 1) / chunkSize;
+
+        if(chunkPending.size() < chunks)
+            chunkPending.resize(chunks);
+
+        for(size_t c = 0; c < chunks; ++c)
+            chunkPending[c].clear();
+
+        jobs->parallelFor(n, chunkSize, updateJob, this);
+
+        for(size_t c = 0; c < chunks; ++c)
+            pending.insert(pending.end(), chunkPending[c].begin(), chunkPending[c].end());
+    }
+    else
+    {
+        updateRange(0, n, pending);
+    }
+
+    applyEvents();
+
+    // Wake the parked targets that are due; the timer of a despawned
+    // target frees its id instead
+    expired.clear();
+    wheel.advance(expired);
+
+    for(size_t k = 0; k < expired.size(); ++k)
+    {
+        int i = ids.findIndex(expired[k]);
+
+        if(i < 0)
+            ids.recycle(expired[k]);
+        else
+            wake(i);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  saveState - The counters, the used part of every column (count entries
+//              of the per-target ones, numActive of the active set), the
+//              slot table and the wheel.
+
+void TargetPool::saveState(StateWriter & w) const
+{
+    PROFILE_ZONE("TargetPool::saveState");
+
+    TargetPoolState s;
+    s.capacity = capacity;
+    s.count = count;
+    s.numActive = numActive;
+    s.numParked = numParked;
+    s.rng = rng;
+
+    w.writeSection(STATE_TARGETS, 0, &s, 1);
+
+    const void *perTarget[TARGET_SAVED_COLUMNS] = { state, x, y, z, meshHeight, maxHeight, size, slot };
+    const void *active[ACTIVE_SAVED_COLUMNS] = { activeId, activeY, activeDelta, activeTop, activeBottom };
+
+    for(int c = 0; c < TARGET_SAVED_COLUMNS; ++c)
+        w.writeSection(STATE_TARGETS, 1+c, (const char*) perTarget[c], (size_t) count * 4);
+
+    for(int c = 0; c < ACTIVE_SAVED_COLUMNS; ++c)
+        w.writeSection(STATE_TARGETS, 1+TARGET_SAVED_COLUMNS+c, (const char*) active[c], (size_t) numActive * 4);
+
+    ids.saveState(w, STATE_TARGET_IDS);
+    wheel.saveState(w, STATE_TARGET_WHEEL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  loadState - Load into a pool of the saved capacity, check it, and only
+//              then swap it in. The column pointers are set up by
+//              allocate(), so loading is one copy per column; checking is
+//              one pass over the targets, the active set and the ids.
+
+bool TargetPool::loadState(const StateReader & r)
+{
+    PROFILE_ZONE("TargetPool::loadState");
+
+    TargetPoolState s;
+
+    if(!r.readSection(STATE_TARGETS, 0, &s, 1) || s.capacity < 0 || (s.capacity & 15) != 0
+    || s.count < 0 || s.count > s.capacity || s.numActive < 0 || s.numActive > s.count
+    || s.numParked != s.count - s.numActive)
+        return false;
+
+    TargetPool loaded;
+    loaded.allocate(s.capacity);
+
+    void *perTarget[TARGET_SAVED_COLUMNS] = { loaded.state, loaded.x, loaded.y, loaded.z, loaded.meshHeight,
+                                              loaded.maxHeight, loaded.size, loaded.slot };
+    void *active[ACTIVE_SAVED_COLUMNS] = { loaded.activeId, loaded.activeY, loaded.activeDelta,
+                                           loaded.activeTop, loaded.activeBottom };
+    bool valid = true;
+
+    for(int c = 0; c < TARGET_SAVED_COLUMNS && valid; ++c)
+        valid = r.readSection(STATE_TARGETS, 1+c, (char*) perTarget[c], (size_t) s.count * 4);
+
+    for(int c = 0; c < ACTIVE_SAVED_COLUMNS && valid; ++c)
+        valid = r.readSection(STATE_TARGETS, 1+TARGET_SAVED_COLUMNS+c, (char*) active[c], (size_t) s.numActive * 4);
+
+    valid = valid && loaded.ids.loadState(r, STATE_TARGET_IDS) && loaded.ids.size() == s.count
+                  && loaded.wheel.loadState(r, STATE_TARGET_WHEEL);
+
+    if(!valid)
+        return false;
+
+    loaded.count = s.count;
+    loaded.numActive = s.numActive;
+    loaded.numParked = s.numParked;
+    loaded.rng = s.rng;
+
+    if(!loaded.isConsistent())
+        return false;
+
+    swap(loaded);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  swap - Exchange everything but the job system.
+
+void TargetPool::swap(TargetPool & other)
+{
+    std::swap(count, other.count);
+    std::swap(state, other.state);
+    std::swap(x, other.x);
+    std::swap(y, other.y);
+    std::swap(z, other.z);
+    std::swap(meshHeight, other.meshHeight);
+    std::swap(maxHeight, other.maxHeight);
+    std::swap(size, other.size);
+    std::swap(slot, other.slot);
+    std::swap(activeId, other.activeId);
+    std::swap(activeY, other.activeY);
+    std::swap(activeDelta, other.activeDelta);
+    std::swap(activeTop, other.activeTop);
+    std::swap(activeBottom, other.activeBottom);
+    std::swap(events, other.events);
+
+    std::swap(capacity, other.capacity);
+    std::swap(numActive, other.numActive);
+    std::swap(numParked, other.numParked);
+    std::swap(block, other.block);
+    ids.swap(other.ids);
+
+    std::swap(rng, other.rng);
+    wheel.swap(other.wheel);
+    pending.swap(other.pending);
+    expired.swap(other.expired);
+    std::swap(chunkSize, other.chunkSize);
+    chunkPending.swap(other.chunkPending);
+}
+
+
+/**************************************************************************************
+ **     Private Target Pool Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  updateRange - The branch-free pass over active slots [begin, end). Appends
+//                the first slot of every group of four with an event.
+
+void TargetPool::updateRange(int begin, int end, vector<int> & groups)
+{
+    // Restrict-qualified copies tell the compiler the columns never overlap
+    int n = end;
+    int *__restrict ev = events;
+    float *__restrict ty = activeY;
+    float *__restrict td = activeDelta;
+    const float *__restrict tt = activeTop;
+    const float *__restrict tb = activeBottom;
+
+    int i = begin;
+
+#if defined(VECBATCH_SSE)
+    const __m128i stopEvent = _mm_set1_epi32(TARGET_EVENT_STOP);
+    const __m128  allSet    = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    const __m128  zero      = _mm_setzero_ps();
+    const __m128  signBit   = _mm_set1_ps(-0.0f);
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128 yi = _mm_load_ps(ty+i);
+        __m128 d  = _mm_load_ps(td+i);
+
+        // Rise until top, then fall until bottom
+        __m128 up = _mm_cmpgt_ps(d, zero);
+        __m128 advance = _mm_or_ps(_mm_and_ps(up, _mm_cmplt_ps(yi, _mm_load_ps(tt+i))),
+                                   _mm_andnot_ps(up, _mm_cmpgt_ps(yi, _mm_load_ps(tb+i))));
+        __m128 turn = _mm_andnot_ps(advance, up);
+        __m128 stop = _mm_andnot_ps(_mm_or_ps(up, advance), allSet);
+
+        _mm_store_ps(ty+i, _mm_add_ps(yi, _mm_and_ps(advance, d)));
+        _mm_store_ps(td+i, _mm_xor_ps(d, _mm_and_ps(turn, signBit)));
+        _mm_store_si128((__m128i*)(ev+i), _mm_and_si128(_mm_castps_si128(stop), stopEvent));
+
+        if(_mm_movemask_ps(stop) != 0)
+            groups.push_back(i);
+    }
+#endif
+
+    for(; i < n; ++i)
+    {
+        float yi = ty[i];
+        float d = td[i];
+
+        // Rise until top, then fall until bottom
+        int up = (d > 0.0f);
+        int advance = up ? (yi < tt[i]) : (yi > tb[i]);
+
+        ty[i] = advance ? yi + d : yi;
+        td[i] = (up && !advance) ? -d : d;
+        ev[i] = (!up && !advance) ? TARGET_EVENT_STOP : TARGET_EVENT_NONE;
+
+        // Groups are always four-aligned, as in the SSE2 loop
+        int group = i & ~3;
+
+        if(ev[i] != TARGET_EVENT_NONE && (groups.empty() || groups.back() != group))
+            groups.push_back(group);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  updateJob - Job entry point: one chunk of the active set.
+
+void TargetPool::updateJob(void *data, int begin, int end)
+{
+    TargetPool *pool = (TargetPool*) data;
+    pool->updateRange(begin, end, pool->chunkPending[begin / pool->chunkSize]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  applyEvents - Park the targets that finished moving. Groups are visited
+//                from the highest slot down, so the swap-remove never moves
+//                an entry that is still to be visited.
+
+void TargetPool::applyEvents()
+{
+    for(int p = (int) pending.size()-1; p >= 0; --p)
+    {
+        for(int k = min(pending[p]+4, numActive)-1; k >= pending[p]; --k)
+        {
+            if(events[k] != TARGET_EVENT_STOP)
+                continue;
+
+            int id = activeId[k];
+            int i = ids.findIndex(id);
+
+            y[i] = activeY[k];
+            state[i] = TARGET_WAITING;
+            removeActive(k);
+
+            wheel.schedule(id, rng.nextInt(400) +1);
+            numParked++;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  wake - Start moving a parked target.
+
+void TargetPool::wake(int i)
+{
+    int k = numActive++;
+
+    state[i] = TARGET_MOVING;
+    maxHeight[i] = rng.nextInt(10) +1.0;
+    slot[i] = k;
+    numParked--;
+
+    activeId[k] = ids.indexAt(i);
+    activeY[k] = meshHeight[i] - size[i];
+    activeDelta[k] = TARGET_SPEED;
+    activeTop[k] = meshHeight[i] + maxHeight[i];
+    activeBottom[k] = meshHeight[i] - size[i]*2;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  isConsistent - Whether the columns, the active set, the ids and the wheel
+//                 agree (after loadState, which has already range-checked
+//                 the slot table and the wheel on their own): a moving
+//                 target and its active entry name each other, a waiting
+//                 target has a timer and a moving one has none, and every
+//                 id that is not in use is either free or kept back for
+//                 the timer it still has.
+
+bool TargetPool::isConsistent() const
+{
+    vector<char> scheduled, onFreeList;
+
+    wheel.getScheduled(scheduled);
+    ids.getFreeList(onFreeList);
+
+    for(int i = 0; i < count; ++i)
+    {
+        int id = ids.indexAt(i);
+
+        if(state[i] == TARGET_MOVING)
+        {
+            if(slot[i] < 0 || slot[i] >= numActive || activeId[slot[i]] != id || scheduled[id])
+                return false;
+        }
+        else if(state[i] != TARGET_WAITING || slot[i] != -1 || !scheduled[id])
+            return false;
+    }
+
+    for(int k = 0; k < numActive; ++k)
+    {
+        int id = activeId[k];
+
+        if(id < 0 || id >= capacity || ids.findIndex(id) < 0 || slot[ids.findIndex(id)] != k)
+            return false;
+    }
+
+    for(int id = 0; id < capacity; ++id)
+    {
+        if(ids.findIndex(id) < 0 && scheduled[id] == onFreeList[id])
+            return false;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  removeActive - Remove slot k by moving the last active entry into it.
+
+void TargetPool::removeActive(int k)
+{
+    int last = --numActive;
+
+    slot[ids.findIndex(activeId[k])] = -1;
+
+    if(k != last)
+    {
+        activeId[k]     = activeId[last];
+        activeY[k]      = activeY[last];
+        activeDelta[k]  = activeDelta[last];
+        activeTop[k]    = activeTop[last];
+        activeBottom[k] = activeBottom[last];
+        events[k]       = events[last];
+
+        slot[ids.findIndex(activeId[k])] = k;
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef TARGETS_H
+#define TARGETS_H
+
+#include <cmath>
+#include <stddef.h>
+#include <vector>
+
+#include "vecbatch.h"
+#include "timerwheel.h"
+#include "rng.h"
+#include "jobs.h"
+#include "slotmap.h"
+#include "savestate.h"
+
+// Target states (a destroyed target is despawned)
+#define TARGET_WAITING 0 // hidden below ground, parked in the timer wheel
+#define TARGET_MOVING  1 // rising up and falling back down (in the active set)
+
+// Transitions recorded by the update pass and applied afterwards
+#define TARGET_EVENT_NONE 0
+#define TARGET_EVENT_STOP 1 // finished moving, start waiting
+
+#define TARGET_SPEED 0.05f // height change per tick while moving
+
+#define TARGET_CHUNK_MIN 16384 // smallest slice of the active set handed to a job
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  TargetPool - Structure-of-arrays storage for all targets.
+//
+//      Waiting targets are parked in a timer wheel until the tick they wake
+//      up on, so they cost nothing per tick. Moving targets are copied into
+//      a dense active set with its own hot columns (y, delta, top, bottom),
+//      and the per-tick update only walks that set. With a job system the
+//      walk is split into chunks; everything that draws random numbers
+//      stays serial, so the result does not depend on the thread count.
+//
+//      The targets are kept in a slot table: the per-target columns hold
+//      the live targets only, packed at [0, count), and are reached from
+//      outside by generational handle. Spawning appends, despawning moves
+//      the last target into the hole, and freed ids are reused, so a scan
+//      over the columns costs as much as the targets alive, however many
+//      have come and gone. The active set and the wheel refer to targets
+//      by id (the handle's index), which does not change when one moves.
+
+class TargetPool
+{
+    public:
+
+        int count;
+
+        // Per-target columns, indexed by target [0, count)
+        int   *state;
+        float *x;
+        float *y;      // height while not moving (see getY)
+        float *z;
+        float *meshHeight;
+        float *maxHeight;
+        float *size;
+        int   *slot;   // index in the active set, -1 when not moving
+
+        // Active set columns, indexed by slot (numActive entries)
+        int   *activeId;     // the target's id
+        float *activeY;
+        float *activeDelta;
+        float *activeTop;    // meshHeight + maxHeight: turn around when rising past it
+        float *activeBottom; // meshHeight - size*2: stop when falling below it
+        int   *events;       // scratch: transitions found in the current tick
+
+        TargetPool();
+        ~TargetPool();
+
+        void allocate(int n); // reserve room for n targets (clears the pool)
+        void setSeed(unsigned int seed); // seed the wake-up heights and parking delays
+        void setJobSystem(JobSystem *j);  // NULL (the default) updates on the calling thread
+
+        SlotHandle spawn(const VECTOR3D & position, float size, int ticksBeforeMoving); // null handle when full
+        bool despawn(const SlotHandle & h); // false if the target is already gone
+
+        void update(); // advance all targets by one tick
+
+        // Write the pool to a save state, or replace it with the one saved
+        // there (false, and the pool left as it was, when the file does not
+        // hold a sound one)
+        void saveState(StateWriter & w) const;
+        bool loadState(const StateReader & r);
+        void swap(TargetPool & other); // everything but the job system
+
+        float getY(int i) const { return (state[i] == TARGET_MOVING) ? activeY[slot[i]] : y[i]; }
+        VECTOR3D getPosition(int i) const { return VECTOR3D(x[i], getY(i), z[i]); }
+
+        int find(const SlotHandle & h) const { return ids.find(h); } // column index, -1 once despawned
+        int findId(int id) const { return ids.findIndex(id); }       // column index of a live id, else -1
+        SlotHandle getHandle(int i) const { return ids.handleAt(i); }
+        int getId(int i) const { return ids.indexAt(i); }            // below getCapacity()
+        int getCapacity() const { return capacity; }
+
+        int getActiveCount() const { return numActive; } // targets moving
+        int getParkedCount() const { return numParked; } // targets waiting in the wheel
+
+    protected:
+
+        int capacity;
+        int numActive;
+        int numParked;
+        void *block; // one allocation holding every column
+        SlotTable<MEMORY_ENTITIES> ids;
+
+        Rng rng;
+        TimerWheel wheel;
+        std::vector<int> pending; // first slot of each group with an event this tick
+        std::vector<int> expired; // ids whose timer fired this tick
+
+        JobSystem *jobs;
+        int chunkSize;
+        std::vector< std::vector<int> > chunkPending; // pending groups found by each chunk
+
+        void updateRange(int begin, int end, std::vector<int> & groups); // begin is a multiple of 4
+        static void updateJob(void *data, int begin, int end);
+        void applyEvents();       // stop the targets that finished moving
+        void wake(int i);         // move a parked target into the active set
+        void removeActive(int k); // swap-remove slot k from the active set
+        bool isConsistent() const; // the columns, ids and wheel agree
+
+    private:
+
+        TargetPool(const TargetPool &);            // not copyable
+        TargetPool & operator=(const TargetPool &);
+};
+
+
+#endif
@@ -0,0 +1,628 @@
+#include "terrain.h"
+#include "vecbatch.h"
+#include "profiler.h"
+#include "vecsimd.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+using namespace std;
+
+#define NUM_BLOBS 20       // Number of random blobs placed in the mesh
+
+
+/**************************************************************************************
+ **     Public Terrain Functions
+ **
+ **************************************************************************************/
+
+Terrain::Terrain()
+{
+    vertices = NULL;
+    normals = NULL;
+    resolution = 0;
+    maxHeight = 0;
+    cornerX = cornerZ = 0;
+    delta = invDelta = 1;
+    normalMode = NORMALS_ANALYTIC;
+    compact = false;
+    generator = NULL;
+    rng.setSeed(0, RNG_STREAM_TERRAIN);
+}
+
+Terrain::~Terrain()
+{
+    freeMesh();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  initTerrain - Allocate a dim x dim grid of quads covering sideWidth units
+//                around the origin and generate its heights and normals.
+
+void Terrain::initTerrain(int dim, float sideWidth)
+{
+    PROFILE_ZONE("Terrain::initTerrain");
+
+    maxHeight = 0;
+
+    cornerX = -(sideWidth/2);
+    cornerZ = -(sideWidth/2);
+    delta = sideWidth/dim;
+    invDelta = 1.0f/delta;
+
+    // initialize the vertex and normal arrays
+    if(compact)
+    {
+        freeMesh();
+        resolution = dim;
+        packed.allocate(dim, sideWidth);
+    }
+    else
+    {
+        allocateMesh(dim);
+        initializeMesh(0.0f, 0.0f, sideWidth);
+    }
+
+    // Randomize the terrain (add blobs) unless another generator was chosen
+    if(generator == NULL)
+    {
+        addRandomBlobs(&defaultGenerator, NUM_BLOBS);
+        generator = &defaultGenerator;
+    }
+
+    // update vertex heights and compute normals
+    if(compact)
+    {
+        generateCompact();
+    }
+    else if(normalMode == NORMALS_ANALYTIC)
+    {
+        updateMeshAnalytic();
+    }
+    else
+    {
+        updateMesh();
+        updateNormals();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  setNormalMode - Choose between finite-difference and analytic normals.
+
+void Terrain::setNormalMode(NormalMode mode)
+{
+    normalMode = mode;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  setGenerator - Choose the terrain generator the grid is filled from.
+
+void Terrain::setGenerator(TerrainGenerator *g)
+{
+    generator = g;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  setSeed - Seed the generator used to place the random blobs.
+
+void Terrain::setSeed(unsigned int seed)
+{
+    rng.setSeed(seed, RNG_STREAM_TERRAIN);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  setCompact - Keep only the compact heightfield. Finite-difference normals
+//               need the whole grid, so a compact terrain always uses the
+//               analytic ones.
+
+void Terrain::setCompact(bool on)
+{
+    compact = on;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  expand - Decode the compact heightfield into the vertex and normal arrays
+//           (for Mesh, which draws from them). Does nothing for a full
+//           terrain, or if it is already expanded.
+
+void Terrain::expand()
+{
+    if(!compact || vertices != NULL)
+        return;
+
+    int dim = resolution;
+    allocateMesh(dim);
+
+    for(int row = 0; row <= dim; ++row)
+        packed.expandRow(row, vertices[row], normals[row]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  printBlobs - Prints properties of the terrain (all blobs, or the noise
+//               parameters) to the command prompt.
+
+void Terrain::printBlobs(void)
+{
+    if(generator != NULL)
+        generator->print();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getRandomVertex - returns a random vertex position in the mesh.
+
+VECTOR3D Terrain::getRandomVertex(Rng & random)
+{
+    int r = random.nextInt(resolution-1) +1;
+    int c = random.nextInt(resolution-1) +1;
+
+    return getVertex(r, c);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getVertex / getNormal - one grid vertex; a compact terrain decodes it.
+
+VECTOR3D Terrain::getVertex(int row, int col) const
+{
+    return compact ? packed.getVertex(row, col) : vertices[row][col];
+}
+
+VECTOR3D Terrain::getNormal(int row, int col) const
+{
+    return compact ? packed.getNormal(row, col) : normals[row][col];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getHeightAt - the ground height under (x, z).
+
+float Terrain::getHeightAt(float x, float z) const
+{
+    int r, c;
+    float fx, fz;
+
+    locate(x, z, &r, &c, &fx, &fz);
+
+    float h00 = getVertexHeight(r,   c), h01 = getVertexHeight(r,   c+1);
+    float h10 = getVertexHeight(r+1, c), h11 = getVertexHeight(r+1, c+1);
+
+    float nearRow = h00 + (h01 - h00) * fx;
+    float farRow  = h10 + (h11 - h10) * fx;
+
+    return nearRow + (farRow - nearRow) * fz;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getNormalAt - the surface normal under (x, z): the four vertex normals
+//                blended bilinearly and renormalized.
+
+VECTOR3D Terrain::getNormalAt(float x, float z) const
+{
+    int r, c;
+    float fx, fz;
+
+    locate(x, z, &r, &c, &fx, &fz);
+
+    VECTOR3D nearRow = getNormal(r,   c) * (1.0f - fx) + getNormal(r,   c+1) * fx;
+    VECTOR3D farRow  = getNormal(r+1, c) * (1.0f - fx) + getNormal(r+1, c+1) * fx;
+
+    VECTOR3D n = nearRow * (1.0f - fz) + farRow * fz;
+    n.Normalize();
+
+    return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getHeightsAt - getHeightAt for count points. The cell lookup and the
+//                 interpolation run VECSIMD_WIDTH points at a time; only the
+//                 four corner heights are fetched one by one. Every step
+//                 matches the scalar version, so the results are identical.
+
+void Terrain::getHeightsAt(const float *x, const float *z, int count, float *heights) const
+{
+    int i = 0;
+
+#if VECSIMD_WIDTH > 1
+    const vfloat zero = vset1(0.0f);
+    const vfloat edge = vset1((float) resolution);
+    const vfloat lastCell = vset1((float)(resolution-1));
+
+    float rows[VECSIMD_WIDTH], cols[VECSIMD_WIDTH];
+    float h00[VECSIMD_WIDTH], h01[VECSIMD_WIDTH], h10[VECSIMD_WIDTH], h11[VECSIMD_WIDTH];
+
+    for(; i + VECSIMD_WIDTH <= count; i += VECSIMD_WIDTH)
+    {
+        vfloat gx = vmin(vmax(vmul(vsub(vload(x+i), vset1(cornerX)), vset1(invDelta)), zero), edge);
+        vfloat gz = vmin(vmax(vmul(vsub(vload(z+i), vset1(cornerZ)), vset1(invDelta)), zero), edge);
+
+        vfloat col = vmin(vfloor(gx), lastCell);
+        vfloat row = vmin(vfloor(gz), lastCell);
+        vfloat fx = vsub(gx, col);
+        vfloat fz = vsub(gz, row);
+
+        vstore(cols, col);
+        vstore(rows, row);
+
+        for(int k = 0; k < VECSIMD_WIDTH; ++k)
+        {
+            int r = (int) rows[k], c = (int) cols[k];
+
+            h00[k] = getVertexHeight(r,   c);
+            h01[k] = getVertexHeight(r,   c+1);
+            h10[k] = getVertexHeight(r+1, c);
+            h11[k] = getVertexHeight(r+1, c+1);
+        }
+
+        vfloat a = vload(h00), b = vload(h10);
+        vfloat nearRow = vadd(a, vmul(vsub(vload(h01), a), fx));
+        vfloat farRow  = vadd(b, vmul(vsub(vload(h11), b), fx));
+
+        vstore(heights+i, vadd(nearRow, vmul(vsub(farRow, nearRow), fz)));
+    }
+#endif
+
+    for(; i < count; ++i)
+        heights[i] = getHeightAt(x[i], z[i]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getRandomPoint - a uniformly random point between the vertices
+//                   getRandomVertex picks from (rows and columns 1 to
+//                   resolution-1). Draws x first, then z.
+
+void Terrain::getRandomPoint(Rng & random, float *x, float *z) const
+{
+    float span = (resolution-2) * delta;
+
+    *x = cornerX + delta + random.nextFloat() * span;
+    *z = cornerZ + delta + random.nextFloat() * span;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getMaxHeight - returns the highest elevation of the mesh
+
+float Terrain::getMaxHeight() const
+{
+    return maxHeight;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getResolution - returns the number of quads accross the terrain width
+
+int Terrain::getResolution() const
+{
+    return resolution;
+}
+
+
+/**************************************************************************************
+ **     Private Terrain Functions
+ **
+ **************************************************************************************/
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  allocateMesh - Allocate vertex array and normals array memory.
+
+void Terrain::allocateMesh (int dim)
+{
+    freeMesh();
+
+    resolution = dim;
+
+    vertices = trackedNewArray<VECTOR3D*>(MEMORY_TERRAIN, dim+1);
+    normals  = trackedNewArray<VECTOR3D*>(MEMORY_TERRAIN, dim+1);
+
+    for(int i = 0; i <= dim; ++i)
+    {
+        vertices[i] = trackedNewArray<VECTOR3D>(MEMORY_TERRAIN, dim+1);
+        normals [i] = trackedNewArray<VECTOR3D>(MEMORY_TERRAIN, dim+1);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  freeMesh - Release the vertex and normal arrays, if any.
+
+void Terrain::freeMesh()
+{
+    if(vertices == NULL)
+        return;
+
+    for(int i = 0; i <= resolution; ++i)
+    {
+        trackedDeleteArray(vertices[i]);
+        trackedDeleteArray(normals[i]);
+    }
+
+    trackedDeleteArray(vertices);
+    trackedDeleteArray(normals);
+
+    vertices = NULL;
+    normals = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  initializeMesh - Fill the vertex array.
+
+void Terrain::initializeMesh(float originX, float originZ, float sideWidth)
+{
+    float cornerX = originX - (sideWidth/2);
+    float cornerZ = originZ - (sideWidth/2);
+    float delta = sideWidth/(resolution);
+
+    // fill the vertex array
+    for(int row = 0; row <= resolution; ++row)
+    {
+        float zCoord = (cornerZ + (row*delta));
+
+        for(int col = 0; col <= resolution; ++col)
+        {
+            vertices[row][col] = VECTOR3D((cornerX + (col*delta)), 0.0f, zCoord);
+        }
+    }
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  resetMesh - Reset all vertex height values (set Y values to 0).
+
+void Terrain::resetMesh()
+{
+    for(int i = 0; i <= resolution; ++i)
+        for(int k = 0; k <= resolution; ++k)
+            (vertices[i][k]).SetY(0.0f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  updateMesh - Add the generator's height to every vertex, one row at a time.
+
+void Terrain::updateMesh()
+{
+    std::vector<float> xs(resolution+1), heights(resolution+1);
+
+    for(int k = 0; k <= resolution; ++k)
+        xs[k] = vertices[0][k].x;
+
+    for(int i = 0; i <= resolution; ++i)
+    {
+        generator->generateRow(&xs[0], vertices[i][0].z, resolution+1, &heights[0], NULL, NULL);
+
+        for(int k = 0; k <= resolution; ++k)
+        {
+            vertices[i][k].y += heights[k];
+            maxHeight = max(maxHeight, vertices[i][k].y);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  updateMeshAnalytic - Evaluate the height and the normal of each vertex in
+//      one pass, from the generator's gradient: the normal of y = h(x,z) is
+//      (-dh/dx, 1, -dh/dz). Edge and corner vertices need no special case.
+
+void Terrain::updateMeshAnalytic()
+{
+    std::vector<float> xs(resolution+1), heights(resolution+1), dhdx(resolution+1), dhdz(resolution+1);
+
+    for(int k = 0; k <= resolution; ++k)
+        xs[k] = vertices[0][k].x;
+
+    for(int i = 0; i <= resolution; ++i)
+    {
+        generator->generateRow(&xs[0], vertices[i][0].z, resolution+1, &heights[0], &dhdx[0], &dhdz[0]);
+
+        for(int k = 0; k <= resolution; ++k)
+        {
+            vertices[i][k].y += heights[k];
+            maxHeight = max(maxHeight, vertices[i][k].y);
+
+            normals[i][k].Set(-dhdx[k], 1.0f, -dhdz[k]);
+            normals[i][k].Normalize();
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  locate - Find the grid cell under (x, z), clamped to the grid.
+
+void Terrain::locate(float x, float z, int *row, int *col, float *fx, float *fz) const
+{
+    float gx = min(max((x - cornerX) * invDelta, 0.0f), (float) resolution);
+    float gz = min(max((z - cornerZ) * invDelta, 0.0f), (float) resolution);
+
+    float c = min(floorf(gx), (float)(resolution-1));
+    float r = min(floorf(gz), (float)(resolution-1));
+
+    *col = (int) c;
+    *row = (int) r;
+    *fx = gx - c;
+    *fz = gz - r;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  generateCompact - updateMeshAnalytic for a compact terrain: evaluate one
+//      band of tile rows at a time and quantize it, so the full-precision
+//      grid never exists.
+
+void Terrain::generateCompact()
+{
+    int stride = resolution+1;
+    std::vector<float> xs(stride), dhdx(stride), dhdz(stride);
+    std::vector<float> heights((size_t) HEIGHTFIELD_TILE * stride);
+    std::vector<VECTOR3D> bandNormals((size_t) HEIGHTFIELD_TILE * stride);
+
+    for(int k = 0; k <= resolution; ++k)
+        xs[k] = packed.getX(k);
+
+    for(int first = 0; first <= resolution; first += HEIGHTFIELD_TILE)
+    {
+        int count = min(HEIGHTFIELD_TILE, stride - first);
+
+        for(int r = 0; r < count; ++r)
+        {
+            float *h = &heights[(size_t) r * stride];
+            VECTOR3D *n = &bandNormals[(size_t) r * stride];
+
+            generator->generateRow(&xs[0], packed.getZ(first + r), stride, h, &dhdx[0], &dhdz[0]);
+
+            for(int k = 0; k <= resolution; ++k)
+            {
+                maxHeight = max(maxHeight, h[k]);
+                n[k].Set(-dhdx[k], 1.0f, -dhdz[k]);
+            }
+        }
+
+        packed.packRows(first, count, &heights[0], &bandNormals[0]);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  updateNormals - Evaluate the normals at each vertex for lighting.
+ 
+void Terrain::updateNormals()
+{
+    // Compute normals for all non-edge vertices, one row at a time with the batch kernels
+    int n = resolution-1;
+    Vec3Array center(n), eUpRight(n), eUp(n), eDown(n), eLeft(n);
+    Vec3Array face1(n), face2(n), face3(n), face4(n);
+
+    for(int r = 1; r < resolution; ++r)
+    {
+        // Neighbour rows are contiguous, so each array loads straight from the grid
+        center.load  (&vertices[r  ][1], n);
+        eUpRight.load(&vertices[r+1][2], n);
+        eUp.load     (&vertices[r+1][1], n);
+        eDown.load   (&vertices[r-1][1], n);
+        eLeft.load   (&vertices[r  ][0], n);
+
+        // Edge vectors from the centre vertex
+        batchSubtract(eUpRight, center, eUpRight);
+        batchSubtract(eUp,      center, eUp);
+        batchSubtract(eDown,    center, eDown);
+        batchSubtract(eLeft,    center, eLeft);
+
+        // Cross Products
+        batchCross(eUpRight, eDown,    face1);
+        batchCross(eUp,      eUpRight, face2);
+        batchCross(eLeft,    eUp,      face3);
+        batchCross(eDown,    eLeft,    face4);
+
+        // Normalize
+        batchNormalize(face1); batchNormalize(face2); batchNormalize(face3); batchNormalize(face4);
+
+        // Calculate Vertex Normals
+        batchAdd(face1, face2, face1);
+        batchAdd(face1, face3, face1);
+        batchAdd(face1, face4, face1);
+        batchNormalize(face1);
+        face1.store(&normals[r][1]);
+    }
+
+    // Compute normals for all edge (top, bottom, left, right) vertices
+    for(int i = 1; i < resolution; ++i)
+    {
+        VECTOR3D vTop    = vertices[0][i];
+        VECTOR3D vBottom = vertices[resolution][i];
+        VECTOR3D vLeft   = vertices[i][0];
+        VECTOR3D vRight  = vertices[i][resolution];
+
+        // Top Cross Products
+        VECTOR3D nTop1    = (vertices[1][i  ] - vTop).CrossProduct(vertices[0][i+1] - vTop);
+        VECTOR3D nTop2    = (vertices[0][i-1] - vTop).CrossProduct(vertices[1][i  ] - vTop);
+
+        // Bottom Cross Products
+        VECTOR3D nBottom1 = (vertices[resolution-1][i  ] - vBottom).CrossProduct(vertices[resolution  ][i-1] - vBottom);
+        VECTOR3D nBottom2 = (vertices[resolution  ][i+1] - vBottom).CrossProduct(vertices[resolution-1][i  ] - vBottom);
+
+        // Left Cross Products
+        VECTOR3D nLeft1   = (vertices[i  ][1] - vLeft).CrossProduct(vertices[i-1][0] - vLeft);
+        VECTOR3D nLeft2   = (vertices[i+1][0] - vLeft).CrossProduct(vertices[i  ][1] - vLeft);
+
+        // Right Cross Products
+        VECTOR3D nRight1  = (vertices[i-1][resolution  ] - vRight).CrossProduct(vertices[i  ][resolution-1] - vRight);
+        VECTOR3D nRight2  = (vertices[i  ][resolution-1] - vRight).CrossProduct(vertices[i+1][resolution  ] - vRight);
+
+        // Normalize
+        nTop1.Normalize();    nTop2.Normalize();
+        nBottom1.Normalize(); nBottom2.Normalize();
+        nLeft1.Normalize();   nLeft2.Normalize();
+        nRight1.Normalize();  nRight2.Normalize();
+
+        // Calculate Vertex Normals
+        VECTOR3D vnTop    = nTop1    + nTop2;      vnTop.Normalize();
+        VECTOR3D vnBottom = nBottom1 + nBottom2;   vnBottom.Normalize();
+        VECTOR3D vnLeft   = nLeft1   + nLeft2;     vnLeft.Normalize();
+        VECTOR3D vnRight  = nRight1  + nRight2;    vnRight.Normalize();
+
+        normals[0][i]          = vnTop;
+        normals[resolution][i] = vnBottom;
+        normals[i][0]          = vnLeft;
+        normals[i][resolution] = vnRight;
+    }
+
+    // Compute normals for the 4 corner vertices of the mesh
+    VECTOR3D vCorner1 = vertices[0][0];
+    VECTOR3D vCorner2 = vertices[0][resolution];
+    VECTOR3D vCorner3 = vertices[resolution][0];
+    VECTOR3D vCorner4 = vertices[resolution][resolution];
+
+    // Cross Products
+    VECTOR3D n1 = (vertices[1][0] - vCorner1).CrossProduct(vertices[0][1] - vCorner1);
+    VECTOR3D n2 = (vertices[0][resolution-1] - vCorner2).CrossProduct(vertices[1][resolution] - vCorner2);
+    VECTOR3D n3 = (vertices[resolution][1] - vCorner3).CrossProduct(vertices[resolution-1][0] - vCorner3);
+    VECTOR3D n4 = (vertices[resolution-1][resolution] - vCorner4).CrossProduct(vertices[resolution][resolution-1] - vCorner4);
+
+    // Normalize
+    n1.Normalize(); n2.Normalize(); n3.Normalize(); n4.Normalize();
+
+    // Calculate Vertex Normals
+    normals[0][0]                   = n1;
+    normals[0][resolution]          = n2;
+    normals[resolution][0]          = n3;
+    normals[resolution][resolution] = n4;
+
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  addRandomBlobs - Adds count random blobs, each centred on a random vertex
+
+void Terrain::addRandomBlobs(BlobGenerator *g, int count)
+{
+    Blob b;
+
+    for(int i = 0; i < count; ++i)
+    {
+        b.position = VECTOR3D(getRandomVertex(rng));
+        b.height = rng.nextInt(8) + 2.0; 
+        b.width = (rng.nextInt(20)/100.0f + 0.001f) / (b.height/3.0f);
+        g->addBlob(b);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  computeVertexHeight - compute height of the vertex from the generator.
+
+void Terrain::computeVertexHeight(VECTOR3D *v)
+{
+    float sigmaHeight;
+
+    generator->generateRow(&v->x, v->z, 1, &sigmaHeight, NULL, NULL);
+    
+    // Adjust the height of the vertex
+    v->SetY(v->GetY() + sigmaHeight);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  computeVertexHeightAndNormal - compute the height of the vertex and its
+//      normal from the generator's gradient.
+
+void Terrain::computeVertexHeightAndNormal(VECTOR3D *v, VECTOR3D *n)
+{
+    float sigmaHeight, dhdx, dhdz;
+
+    generator->generateRow(&v->x, v->z, 1, &sigmaHeight, &dhdx, &dhdz);
+
+    // Adjust the height of the vertex and write its normal
+    v->SetY(v->GetY() + sigmaHeight);
+
+    n->Set(-dhdx, 1.0f, -dhdz);
+    n->Normalize();
+}
@@ -0,0 +1,133 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <cmath>
+
+#include "VECTOR3D.h"
+#include "generator.h"
+#include "rng.h"
+#include "memtrack.h"
+#include "heightfield.h"
+
+#define MESH_RESOLUTION 64 // The number of vertices accross the mesh width
+
+
+// How vertex normals are produced when the terrain is generated
+typedef enum NormalMode {
+    NORMALS_FINITE_DIFFERENCE, // second pass over the finished grid (updateNormals)
+    NORMALS_ANALYTIC           // closed-form gradient from the generator, computed with the heights
+} NormalMode;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  Terrain - The heightfield: a square grid of vertices and their normals,
+//            filled from a TerrainGenerator. It makes no OpenGL calls, so
+//            the simulation can use it without a window; Mesh draws it.
+//
+//      A compact terrain (setCompact) keeps only a CompactHeightfield, in 4
+//      bytes per vertex instead of 24, and generates it a band of rows at
+//      a time with analytic normals. vertices and normals stay NULL until
+//      expand() decodes them for drawing; the queries work either way.
+
+class Terrain
+{
+    public:
+
+        Terrain();
+        ~Terrain();
+
+        // Terrain Functions
+        void initTerrain(int dim, float sideWidth); // allocate the grid and generate the heights
+
+        // Select the normal generation mode (call before initTerrain)
+        void setNormalMode(NormalMode mode);
+
+        // Select the terrain generator (call before initTerrain). The terrain
+        // does not take ownership; without one, random blobs are generated.
+        void setGenerator(TerrainGenerator *g);
+
+        // Seed the random blob placement (call before initTerrain)
+        void setSeed(unsigned int seed);
+
+        // Store quantized heights and packed normals only (call before
+        // initTerrain). The heights differ from a full terrain's by the
+        // quantization, so games on either kind do not replay on the other.
+        void setCompact(bool on);
+        bool isCompact() const { return compact; }
+        void expand(); // decode a compact terrain into vertices and normals
+
+        // Print Functions
+        void printBlobs(void);
+
+        // Useful Functions
+        VECTOR3D getRandomVertex(Rng & random); // an interior vertex picked with the caller's generator
+        VECTOR3D getVertex(int row, int col) const;
+        VECTOR3D getNormal(int row, int col) const;
+
+        // Ground under any (x, z), interpolated bilinearly between the four
+        // surrounding vertices; points outside the grid are clamped to its
+        // edge. The batch version gives the same results, several at a time.
+        float getHeightAt(float x, float z) const;
+        VECTOR3D getNormalAt(float x, float z) const;
+        void getHeightsAt(const float *x, const float *z, int count, float *heights) const;
+
+        // A random point over the interior of the grid (the area
+        // getRandomVertex picks from), without its height
+        void getRandomPoint(Rng & random, float *x, float *z) const;
+        float getMaxHeight() const;
+        int getResolution() const;
+        float getCellSize() const { return delta; } // distance between neighbouring vertices
+        float getCornerX() const { return cornerX; } // x of column 0
+        float getCornerZ() const { return cornerZ; } // z of row 0
+        float getVertexHeight(int row, int col) const { return compact ? packed.getHeight(row, col) : vertices[row][col].y; }
+
+        // Grid cell under (x, z) and the position within it, each in [0, 1]
+        void locate(float x, float z, int *row, int *col, float *fx, float *fz) const;
+
+        // Data Structures: (resolution+1) rows of (resolution+1) entries
+        VECTOR3D **vertices;
+        VECTOR3D **normals;
+
+
+    protected:
+
+        int resolution;
+        float maxHeight;
+        float cornerX, cornerZ; // position of vertex [0][0]
+        float delta;            // distance between neighbouring vertices
+        float invDelta;
+        NormalMode normalMode;
+
+        bool compact;
+        CompactHeightfield packed;
+
+        Rng rng;
+
+        BlobGenerator defaultGenerator;
+        TerrainGenerator *generator;
+
+        // Private Generator Functions
+        void addRandomBlobs(BlobGenerator *g, int count); // place blobs at random vertices
+
+        // Private Terrain Functions
+        void allocateMesh (int dim); // allocate vertex array and normals array memory
+        void freeMesh();             // release them again
+        void initializeMesh(float originX, float originZ, float sideWidth); // construct vertex array
+
+        void resetMesh();     // for each mesh vertex, set height (Y value) to 0
+        void updateMesh();    // for each mesh vertex, add the height from the generator
+        void updateNormals(); // for each mesh vertex, update the normal vector
+        void updateMeshAnalytic(); // heights and analytic normals in a single pass
+        void generateCompact();    // fill the compact heightfield band by band
+
+        void computeVertexHeight(VECTOR3D *v); // compute height of a single vertex from the generator
+        void computeVertexHeightAndNormal(VECTOR3D *v, VECTOR3D *n); // height plus the normal from the generator gradient
+
+    private:
+
+        Terrain(const Terrain &);            // not copyable
+        Terrain & operator=(const Terrain &);
+};
+
+
+#endif
@@ -0,0 +1,266 @@
+#include "timerwheel.h"
+
+#include <string.h>
+#include <algorithm>
+
+
+/**************************************************************************************
+ **     Public Timer Wheel Functions
+ **
+ **************************************************************************************/
+
+TimerWheel::TimerWheel()
+{
+    clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  reserve - Allocate the nodes for ids [0, numIds) up front.
+
+void TimerWheel::reserve(int numIds)
+{
+    if((int) timers.size() < numIds)
+        timers.resize(numIds);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  schedule - Fire id after delay ticks. Delays are clamped to [1, maximum].
+
+void TimerWheel::schedule(int id, unsigned int delay)
+{
+    const unsigned int maxDelay = (1u << (WHEEL_BITS*WHEEL_LEVELS)) - 1;
+
+    if(delay < 1)
+        delay = 1;
+    if(delay > maxDelay)
+        delay = maxDelay;
+
+    if(id >= (int) timers.size())
+        timers.resize(id+1);
+
+    timers[id].due = currentTick + delay;
+
+    insert(id);
+    pending++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  advance - Move one tick forward and append every id due on that tick.
+//            Higher levels are cascaded first, whenever the level below them
+//            wraps around.
+
+void TimerWheel::advance(std::vector<int> & expired)
+{
+    currentTick++;
+
+    for(int level = WHEEL_LEVELS-1; level > 0; --level)
+    {
+        unsigned int lowerMask = (1u << (WHEEL_BITS*level)) - 1;
+
+        if((currentTick & lowerMask) == 0)
+            cascade(level);
+    }
+
+    unsigned int slot = currentTick & (WHEEL_SLOTS-1);
+
+    for(int id = heads[0][slot]; id != -1; id = timers[id].next)
+    {
+        expired.push_back(id);
+        pending--;
+    }
+
+    heads[0][slot] = -1;
+    tails[0][slot] = -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  clear - Remove all timers and restart at tick 0.
+
+void TimerWheel::clear()
+{
+    for(int level = 0; level < WHEEL_LEVELS; ++level)
+    {
+        for(int s = 0; s < WHEEL_SLOTS; ++s)
+        {
+            heads[level][s] = -1;
+            tails[level][s] = -1;
+        }
+    }
+
+    currentTick = 0;
+    pending = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  saveState - The tick and count, the slot lists and the timer nodes.
+
+void TimerWheel::saveState(StateWriter & w, uint32_t tag) const
+{
+    unsigned int counters[2] = { currentTick, (unsigned int) pending };
+
+    w.writeSection(tag, 0, counters, 2);
+    w.writeSection(tag, 1, &heads[0][0], WHEEL_LEVELS*WHEEL_SLOTS);
+    w.writeSection(tag, 2, &tails[0][0], WHEEL_LEVELS*WHEEL_SLOTS);
+    w.writeSection(tag, 3, timers.data(), timers.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  loadState - Walk every saved slot list in the file before copying
+//              anything: the links must stay inside the reserved ids, visit
+//              each id at most once and end at the slot's tail, and every
+//              timer must sit in the slot insert() would have put it in.
+//              False leaves the wheel as it was.
+
+bool TimerWheel::loadState(const StateReader & r, uint32_t tag)
+{
+    const unsigned int maxDelay = (1u << (WHEEL_BITS*WHEEL_LEVELS)) - 1;
+
+    size_t counterBytes, headBytes, tailBytes, timerBytes;
+
+    const unsigned int *counters = (const unsigned int*) r.find(tag, 0, &counterBytes);
+    const int *h = (const int*) r.find(tag, 1, &headBytes);
+    const int *t = (const int*) r.find(tag, 2, &tailBytes);
+    const Timer *nodes = (const Timer*) r.find(tag, 3, &timerBytes);
+
+    int numIds = (int) timers.size();
+
+    if(counters == NULL || counterBytes != 2*sizeof(unsigned int)
+    || h == NULL || headBytes != sizeof(heads) || t == NULL || tailBytes != sizeof(tails)
+    || timerBytes != timers.size() * sizeof(Timer))
+        return false;
+
+    unsigned int tick = counters[0];
+    std::vector<char> visited(numIds, 0);
+    int found = 0;
+
+    for(int level = 0; level < WHEEL_LEVELS; ++level)
+    {
+        for(int slot = 0; slot < WHEEL_SLOTS; ++slot)
+        {
+            int head = h[level*WHEEL_SLOTS + slot];
+            int tail = t[level*WHEEL_SLOTS + slot];
+            int last = -1;
+
+            if(head < -1 || head >= numIds || tail < -1 || tail >= numIds || (head == -1) != (tail == -1))
+                return false;
+
+            for(int id = head; id != -1; id = nodes[id].next)
+            {
+                if(id < 0 || id >= numIds || visited[id])
+                    return false;
+
+                unsigned int delay = nodes[id].due - tick;
+
+                if(delay < 1 || delay > maxDelay
+                || (int)((nodes[id].due >> (WHEEL_BITS*level)) & (WHEEL_SLOTS-1)) != slot)
+                    return false;
+
+                visited[id] = 1;
+                last = id;
+                found++;
+            }
+
+            if(last != tail)
+                return false;
+        }
+    }
+
+    if(found != (int) counters[1])
+        return false;
+
+    memcpy(&heads[0][0], h, sizeof(heads));
+    memcpy(&tails[0][0], t, sizeof(tails));
+
+    if(timerBytes > 0)
+        memcpy(timers.data(), nodes, timerBytes);
+
+    currentTick = tick;
+    pending = found;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  getScheduled - Flag every id that has a timer.
+
+void TimerWheel::getScheduled(std::vector<char> & scheduled) const
+{
+    scheduled.assign(timers.size(), 0);
+
+    for(int level = 0; level < WHEEL_LEVELS; ++level)
+    {
+        for(int slot = 0; slot < WHEEL_SLOTS; ++slot)
+        {
+            for(int id = heads[level][slot]; id != -1; id = timers[id].next)
+                scheduled[id] = 1;
+        }
+    }
+}
+
+void TimerWheel::swap(TimerWheel & other)
+{
+    timers.swap(other.timers);
+
+    for(int level = 0; level < WHEEL_LEVELS; ++level)
+    {
+        for(int slot = 0; slot < WHEEL_SLOTS; ++slot)
+        {
+            std::swap(heads[level][slot], other.heads[level][slot]);
+            std::swap(tails[level][slot], other.tails[level][slot]);
+        }
+    }
+
+    std::swap(currentTick, other.currentTick);
+    std::swap(pending, other.pending);
+}
+
+
+/**************************************************************************************
+ **     Private Timer Wheel Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  insert - Append a timer to the lowest level whose span covers its delay.
+
+void TimerWheel::insert(int id)
+{
+    Timer & t = timers[id];
+    unsigned int delay = t.due - currentTick;
+    int level = 0;
+
+    while(level < WHEEL_LEVELS-1 && delay >= (1u << (WHEEL_BITS*(level+1))))
+        level++;
+
+    unsigned int slot = (t.due >> (WHEEL_BITS*level)) & (WHEEL_SLOTS-1);
+
+    t.next = -1;
+
+    if(tails[level][slot] == -1)
+        heads[level][slot] = id;
+    else
+        timers[tails[level][slot]].next = id;
+
+    tails[level][slot] = id;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  cascade - Re-insert the current slot of a level relative to now. A timer
+//            that is still too far away simply lands back on this level.
+
+void TimerWheel::cascade(int level)
+{
+    unsigned int slot = (currentTick >> (WHEEL_BITS*level)) & (WHEEL_SLOTS-1);
+
+    int id = heads[level][slot];
+
+    heads[level][slot] = -1;
+    tails[level][slot] = -1;
+
+    // insert() overwrites next, so step along first
+    while(id != -1)
+    {
+        int next = timers[id].next;
+        insert(id);
+        id = next;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "memtrack.h"
+#include "savestate.h"
+
+#define WHEEL_BITS   8                  // slots per level = 2^WHEEL_BITS
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 3                  // longest delay = 2^(WHEEL_BITS*WHEEL_LEVELS) - 1 ticks
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  TimerWheel - Hierarchical timer wheel. Level 0 has one slot per tick;
+//               each higher level has one slot per full turn of the level
+//               below, and its slots are re-sorted ("cascaded") downwards
+//               when they come due. Scheduling and firing are O(1) per
+//               timer, and a tick with nothing due costs O(1).
+//
+//               Each slot is a linked list threaded through one node per
+//               id, so an id can only have one timer at a time, and once
+//               the nodes are reserved the wheel never allocates.
+
+class TimerWheel
+{
+    public:
+
+        TimerWheel();
+
+        void reserve(int numIds); // make room for ids [0, numIds)
+        void schedule(int id, unsigned int delay); // fire id on the delay-th call to advance (delay >= 1)
+        void advance(std::vector<int> & expired);  // move one tick forward, append the ids that fire
+        void clear();
+
+        int size() const { return pending; } // number of scheduled timers
+        unsigned int now() const { return currentTick; }
+
+        // Every timer and slot, as parts of one save state section; load
+        // after reserving the same number of ids
+        void saveState(StateWriter & w, uint32_t tag) const;
+        bool loadState(const StateReader & r, uint32_t tag);
+
+        void getScheduled(std::vector<char> & scheduled) const; // flags the ids that have a timer
+        void swap(TimerWheel & other);
+
+    protected:
+
+        typedef struct Timer {
+            int next;         // next id in the same slot, -1 at the end
+            unsigned int due;
+        } Timer;
+
+        std::vector<Timer, TrackedAllocator<Timer, MEMORY_ENTITIES> > timers; // indexed by id
+
+        // First and last id in each slot (-1 when empty); timers fire in
+        // the order they were inserted
+        int heads[WHEEL_LEVELS][WHEEL_SLOTS];
+        int tails[WHEEL_LEVELS][WHEEL_SLOTS];
+
+        unsigned int currentTick;
+        int pending;
+
+        void insert(int id);
+        void cascade(int level);
+};
+
+
+#endif
@@ -0,0 +1,413 @@
+#include "vecbatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(VECBATCH_AVX)
+  #include <immintrin.h>
+#elif defined(VECBATCH_SSE)
+  #include <emmintrin.h>
+#endif
+
+
+/**************************************************************************************
+ **     Aligned Memory
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  alignedAlloc - allocates memory aligned to VECBATCH_ALIGN bytes. The
+//                 original pointer is stored just in front of the block.
+
+static void *alignedAlloc(size_t bytes)
+{
+    char *raw = (char*) malloc(bytes + VECBATCH_ALIGN + sizeof(void*));
+    if(raw == NULL)
+        return NULL;
+
+    size_t addr = (size_t)(raw + sizeof(void*));
+    char *aligned = (char*)((addr + VECBATCH_ALIGN - 1) & ~(size_t)(VECBATCH_ALIGN - 1));
+    ((void**) aligned)[-1] = raw;
+
+    return aligned;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  alignedFree - releases memory returned by alignedAlloc.
+
+static void alignedFree(void *p)
+{
+    if(p != NULL)
+        free(((void**) p)[-1]);
+}
+
+
+/**************************************************************************************
+ **     Vec3Array Functions
+ **
+ **************************************************************************************/
+
+Vec3Array::Vec3Array() : x(NULL), y(NULL), z(NULL), count(0), capacity(0), block(NULL)
+{
+}
+
+Vec3Array::Vec3Array(int n) : x(NULL), y(NULL), z(NULL), count(0), capacity(0), block(NULL)
+{
+    resize(n);
+}
+
+Vec3Array::~Vec3Array()
+{
+    alignedFree(block);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  resize - Set the vector count. Capacity is rounded up to a whole AVX
+//           register so that every component array starts aligned.
+
+void Vec3Array::resize(int n)
+{
+    if(n > capacity)
+    {
+        int lanes = VECBATCH_ALIGN / sizeof(float);
+        int cap = ((n + lanes - 1) / lanes) * lanes;
+
+        alignedFree(block);
+        block = (float*) alignedAlloc(3 * cap * sizeof(float));
+        memset(block, 0, 3 * cap * sizeof(float));
+
+        capacity = cap;
+        x = block;
+        y = block + cap;
+        z = block + 2*cap;
+    }
+
+    count = n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  load - Fill the array from n VECTOR3D values.
+
+void Vec3Array::load(const VECTOR3D *src, int n)
+{
+    resize(n);
+
+    for(int i = 0; i < n; ++i)
+    {
+        x[i] = src[i].x;
+        y[i] = src[i].y;
+        z[i] = src[i].z;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  store - Write the array back out as VECTOR3D values.
+
+void Vec3Array::store(VECTOR3D *dst) const
+{
+    for(int i = 0; i < count; ++i)
+        dst[i].Set(x[i], y[i], z[i]);
+}
+
+
+/**************************************************************************************
+ **     Batch Kernels
+ **
+ **     Each kernel runs the widest compiled path over as many vectors as it
+ **     can, then finishes the remainder with the scalar loop.
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  batchAdd - out = a + b
+
+void batchAdd(const Vec3Array & a, const Vec3Array & b, Vec3Array & out)
+{
+    int n = a.count;
+    int i = 0;
+
+#if defined(VECBATCH_AVX)
+    for(; i + 8 <= n; i += 8)
+    {
+        _mm256_store_ps(out.x+i, _mm256_add_ps(_mm256_load_ps(a.x+i), _mm256_load_ps(b.x+i)));
+        _mm256_store_ps(out.y+i, _mm256_add_ps(_mm256_load_ps(a.y+i), _mm256_load_ps(b.y+i)));
+        _mm256_store_ps(out.z+i, _mm256_add_ps(_mm256_load_ps(a.z+i), _mm256_load_ps(b.z+i)));
+    }
+#elif defined(VECBATCH_SSE)
+    for(; i + 4 <= n; i += 4)
+    {
+        _mm_store_ps(out.x+i, _mm_add_ps(_mm_load_ps(a.x+i), _mm_load_ps(b.x+i)));
+        _mm_store_ps(out.y+i, _mm_add_ps(_mm_load_ps(a.y+i), _mm_load_ps(b.y+i)));
+        _mm_store_ps(out.z+i, _mm_add_ps(_mm_load_ps(a.z+i), _mm_load_ps(b.z+i)));
+    }
+#endif
+
+    for(; i < n; ++i)
+    {
+        out.x[i] = a.x[i] + b.x[i];
+        out.y[i] = a.y[i] + b.y[i];
+        out.z[i] = a.z[i] + b.z[i];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  batchSubtract - out = a - b
+
+void batchSubtract(const Vec3Array & a, const Vec3Array & b, Vec3Array & out)
+{
+    int n = a.count;
+    int i = 0;
+
+#if defined(VECBATCH_AVX)
+    for(; i + 8 <= n; i += 8)
+    {
+        _mm256_store_ps(out.x+i, _mm256_sub_ps(_mm256_load_ps(a.x+i), _mm256_load_ps(b.x+i)));
+        _mm256_store_ps(out.y+i, _mm256_sub_ps(_mm256_load_ps(a.y+i), _mm256_load_ps(b.y+i)));
+        _mm256_store_ps(out.z+i, _mm256_sub_ps(_mm256_load_ps(a.z+i), _mm256_load_ps(b.z+i)));
+    }
+#elif defined(VECBATCH_SSE)
+    for(; i + 4 <= n; i += 4)
+    {
+        _mm_store_ps(out.x+i, _mm_sub_ps(_mm_load_ps(a.x+i), _mm_load_ps(b.x+i)));
+        _mm_store_ps(out.y+i, _mm_sub_ps(_mm_load_ps(a.y+i), _mm_load_ps(b.y+i)));
+        _mm_store_ps(out.z+i, _mm_sub_ps(_mm_load_ps(a.z+i), _mm_load_ps(b.z+i)));
+    }
+#endif
+
+    for(; i < n; ++i)
+    {
+        out.x[i] = a.x[i] - b.x[i];
+        out.y[i] = a.y[i] - b.y[i];
+        out.z[i] = a.z[i] - b.z[i];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  batchCross - out = a x b (out may alias neither a nor b)
+
+void batchCross(const Vec3Array & a, const Vec3Array & b, Vec3Array & out)
+{
+    int n = a.count;
+    int i = 0;
+
+#if defined(VECBATCH_AVX)
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256 ax = _mm256_load_ps(a.x+i), ay = _mm256_load_ps(a.y+i), az = _mm256_load_ps(a.z+i);
+        __m256 bx = _mm256_load_ps(b.x+i), by = _mm256_load_ps(b.y+i), bz = _mm256_load_ps(b.z+i);
+
+        _mm256_store_ps(out.x+i, _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by)));
+        _mm256_store_ps(out.y+i, _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz)));
+        _mm256_store_ps(out.z+i, _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx)));
+    }
+#elif defined(VECBATCH_SSE)
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128 ax = _mm_load_ps(a.x+i), ay = _mm_load_ps(a.y+i), az = _mm_load_ps(a.z+i);
+        __m128 bx = _mm_load_ps(b.x+i), by = _mm_load_ps(b.y+i), bz = _mm_load_ps(b.z+i);
+
+        _mm_store_ps(out.x+i, _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+        _mm_store_ps(out.y+i, _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)));
+        _mm_store_ps(out.z+i, _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)));
+    }
+#endif
+
+    for(; i < n; ++i)
+    {
+        out.x[i] = a.y[i]*b.z[i] - a.z[i]*b.y[i];
+        out.y[i] = a.z[i]*b.x[i] - a.x[i]*b.z[i];
+        out.z[i] = a.x[i]*b.y[i] - a.y[i]*b.x[i];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  batchDot - out[i] = a[i] . b[i]
+
+void batchDot(const Vec3Array & a, const Vec3Array & b, float *out)
+{
+    int n = a.count;
+    int i = 0;
+
+#if defined(VECBATCH_AVX)
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256 d = _mm256_mul_ps(_mm256_load_ps(a.x+i), _mm256_load_ps(b.x+i));
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_load_ps(a.y+i), _mm256_load_ps(b.y+i)));
+        d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_load_ps(a.z+i), _mm256_load_ps(b.z+i)));
+        _mm256_storeu_ps(out+i, d);
+    }
+#elif defined(VECBATCH_SSE)
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128 d = _mm_mul_ps(_mm_load_ps(a.x+i), _mm_load_ps(b.x+i));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_load_ps(a.y+i), _mm_load_ps(b.y+i)));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_load_ps(a.z+i), _mm_load_ps(b.z+i)));
+        _mm_storeu_ps(out+i, d);
+    }
+#endif
+
+    for(; i < n; ++i)
+        out[i] = a.x[i]*b.x[i] + a.y[i]*b.y[i] + a.z[i]*b.z[i];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  batchNormalize - normalize every vector in place. Like
+//                   VECTOR3D::Normalize, zero-length vectors are unchanged.
+
+void batchNormalize(Vec3Array & v)
+{
+    int n = v.count;
+    int i = 0;
+
+#if defined(VECBATCH_AVX)
+    const __m256 zero8 = _mm256_setzero_ps();
+    const __m256 one8  = _mm256_set1_ps(1.0f);
+
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256 x = _mm256_load_ps(v.x+i), y = _mm256_load_ps(v.y+i), z = _mm256_load_ps(v.z+i);
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+
+        // scale by 1/len where len > 0, by 1 elsewhere
+        __m256 nonZero = _mm256_cmp_ps(len, zero8, _CMP_GT_OQ);
+        __m256 scale = _mm256_blendv_ps(one8, _mm256_div_ps(one8, len), nonZero);
+
+        _mm256_store_ps(v.x+i, _mm256_mul_ps(x, scale));
+        _mm256_store_ps(v.y+i, _mm256_mul_ps(y, scale));
+        _mm256_store_ps(v.z+i, _mm256_mul_ps(z, scale));
+    }
+#elif defined(VECBATCH_SSE)
+    const __m128 zero4 = _mm_setzero_ps();
+    const __m128 one4  = _mm_set1_ps(1.0f);
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m128 x = _mm_load_ps(v.x+i), y = _mm_load_ps(v.y+i), z = _mm_load_ps(v.z+i);
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+
+        // scale by 1/len where len > 0, by 1 elsewhere (SSE2 has no blend)
+        __m128 nonZero = _mm_cmpgt_ps(len, zero4);
+        __m128 scale = _mm_or_ps(_mm_and_ps(nonZero, _mm_div_ps(one4, len)), _mm_andnot_ps(nonZero, one4));
+
+        _mm_store_ps(v.x+i, _mm_mul_ps(x, scale));
+        _mm_store_ps(v.y+i, _mm_mul_ps(y, scale));
+        _mm_store_ps(v.z+i, _mm_mul_ps(z, scale));
+    }
+#endif
+
+    for(; i < n; ++i)
+    {
+        float len = sqrtf(v.x[i]*v.x[i] + v.y[i]*v.y[i] + v.z[i]*v.z[i]);
+
+        if(len > 0.0f)
+        {
+            float scale = 1.0f / len;
+            v.x[i] *= scale;
+            v.y[i] *= scale;
+            v.z[i] *= scale;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  batchAxpy - out += s*a
+
+void batchAxpy(float s, const Vec3Array & a, Vec3Array & out)
+{
+    int n = a.count;
+    int i = 0;
+
+#if defined(VECBATCH_AVX)
+    const __m256 s8 = _mm256_set1_ps(s);
+
+    for(; i + 8 <= n; i += 8)
+    {
+        _mm256_store_ps(out.x+i, _mm256_add_ps(_mm256_load_ps(out.x+i), _mm256_mul_ps(s8, _mm256_load_ps(a.x+i))));
+        _mm256_store_ps(out.y+i, _mm256_add_ps(_mm256_load_ps(out.y+i), _mm256_mul_ps(s8, _mm256_load_ps(a.y+i))));
+        _mm256_store_ps(out.z+i, _mm256_add_ps(_mm256_load_ps(out.z+i), _mm256_mul_ps(s8, _mm256_load_ps(a.z+i))));
+    }
+#elif defined(VECBATCH_SSE)
+    const __m128 s4 = _mm_set1_ps(s);
+
+    for(; i + 4 <= n; i += 4)
+    {
+        _mm_store_ps(out.x+i, _mm_add_ps(_mm_load_ps(out.x+i), _mm_mul_ps(s4, _mm_load_ps(a.x+i))));
+        _mm_store_ps(out.y+i, _mm_add_ps(_mm_load_ps(out.y+i), _mm_mul_ps(s4, _mm_load_ps(a.y+i))));
+        _mm_store_ps(out.z+i, _mm_add_ps(_mm_load_ps(out.z+i), _mm_mul_ps(s4, _mm_load_ps(a.z+i))));
+    }
+#endif
+
+    for(; i < n; ++i)
+    {
+        out.x[i] += s * a.x[i];
+        out.y[i] += s * a.y[i];
+        out.z[i] += s * a.z[i];
+    }
+}
+
+
+/**************************************************************************************
+ **     VEC4 Functions
+ **
+ **************************************************************************************/
+
+///////////////////////////////////////////////////////////////////////////////
+//  vec4Cross - cross product of the xyz parts (w is set to 0)
+
+VEC4 vec4Cross(const VEC4 & a, const VEC4 & b)
+{
+#if defined(VECBATCH_SSE)
+    __m128 va = _mm_load_ps(&a.x);
+    __m128 vb = _mm_load_ps(&b.x);
+
+    // (a.yzx * b.zxy) - (a.zxy * b.yzx)
+    __m128 aYZX = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 bYZX = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(va, bYZX), _mm_mul_ps(aYZX, vb));
+
+    VEC4 result;
+    _mm_store_ps(&result.x, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+    result.w = 0.0f;
+    return result;
+#else
+    return VEC4(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  vec4Dot - dot product of the xyz parts
+
+float vec4Dot(const VEC4 & a, const VEC4 & b)
+{
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  vec4Normalize - returns the normalized xyz part (zero vectors unchanged)
+
+VEC4 vec4Normalize(const VEC4 & v)
+{
+    float len = sqrtf(vec4Dot(v, v));
+
+    if(len > 0.0f)
+    {
+        float scale = 1.0f / len;
+        return VEC4(v.x*scale, v.y*scale, v.z*scale, v.w);
+    }
+
+    return v;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  batchMathPath - returns the name of the compiled kernel path
+
+const char *batchMathPath()
+{
+#if defined(VECBATCH_AVX)
+    return "avx";
+#elif defined(VECBATCH_SSE)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
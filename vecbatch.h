@@ -0,0 +1,92 @@
+#ifndef VECBATCH_H
+#define VECBATCH_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "VECTOR3D.h"
+
+// Select the widest instruction set the compiler was told it may use.
+// MSVC does not define __SSE2__, so the x64/x86 flags are checked as well.
+#if defined(__AVX__)
+  #define VECBATCH_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define VECBATCH_SSE
+#endif
+
+#define VECBATCH_ALIGN 32 // Byte alignment of every batch array (one AVX register)
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  VEC4 - A 16-byte aligned xyzw vector that fits a single SSE register.
+
+struct alignas(16) VEC4
+{
+    float x, y, z, w;
+
+    VEC4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+    VEC4(float newX, float newY, float newZ, float newW = 0.0f) : x(newX), y(newY), z(newZ), w(newW) {}
+    VEC4(const VECTOR3D & v) : x(v.x), y(v.y), z(v.z), w(0.0f) {}
+
+    VECTOR3D toVECTOR3D() const { return VECTOR3D(x, y, z); }
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  Vec3Array - Structure-of-arrays storage for a batch of 3d vectors.
+//              Each component lives in its own aligned float array, so the
+//              kernels below can process 4 (SSE) or 8 (AVX) vectors at once.
+
+class Vec3Array
+{
+    public:
+
+        float *x;
+        float *y;
+        float *z;
+        int count;
+
+        Vec3Array();
+        explicit Vec3Array(int n);
+        ~Vec3Array();
+
+        void resize(int n); // reallocates only when growing past capacity
+
+        // Conversion to and from VECTOR3D
+        void load(const VECTOR3D *src, int n);
+        void store(VECTOR3D *dst) const;
+
+        VECTOR3D get(int i) const { return VECTOR3D(x[i], y[i], z[i]); }
+        void set(int i, const VECTOR3D & v) { x[i] = v.x; y[i] = v.y; z[i] = v.z; }
+
+    protected:
+
+        int capacity;
+        float *block; // one allocation holding x, y and z
+
+    private:
+
+        Vec3Array(const Vec3Array &);            // not copyable
+        Vec3Array & operator=(const Vec3Array &);
+};
+
+
+// Batch Kernels (all arrays must hold at least a.count vectors)
+void batchAdd(const Vec3Array & a, const Vec3Array & b, Vec3Array & out);      // out = a + b
+void batchSubtract(const Vec3Array & a, const Vec3Array & b, Vec3Array & out); // out = a - b
+void batchCross(const Vec3Array & a, const Vec3Array & b, Vec3Array & out);    // out = a x b
+void batchDot(const Vec3Array & a, const Vec3Array & b, float *out);           // out = a . b
+void batchNormalize(Vec3Array & v);                                            // zero vectors are left unchanged
+void batchAxpy(float s, const Vec3Array & a, Vec3Array & out);                 // out += s*a
+
+// VEC4 helpers
+VEC4 vec4Cross(const VEC4 & a, const VEC4 & b);
+float vec4Dot(const VEC4 & a, const VEC4 & b);
+VEC4 vec4Normalize(const VEC4 & v);
+
+// Name of the compiled kernel path ("avx", "sse" or "scalar")
+const char *batchMathPath();
+
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef VECSIMD_H
+#define VECSIMD_H
+
+// Thin wrappers over the widest float vector register selected in vecbatch.h,
+// so a kernel can be written once for AVX (8 lanes) and SSE (4 lanes).
+// VECSIMD_WIDTH is 1 when neither is available and kernels should use their
+// scalar loop only.
+
+#include "vecbatch.h"
+
+#if defined(VECBATCH_AVX)
+  #include <immintrin.h>
+
+  #define VECSIMD_WIDTH 8
+  typedef __m256 vfloat;
+
+  static inline vfloat vload(const float *p)         { return _mm256_loadu_ps(p); }
+  static inline void   vstore(float *p, vfloat a)    { _mm256_storeu_ps(p, a); }
+  static inline vfloat vset1(float a)                { return _mm256_set1_ps(a); }
+  static inline vfloat vadd(vfloat a, vfloat b)      { return _mm256_add_ps(a, b); }
+  static inline vfloat vsub(vfloat a, vfloat b)      { return _mm256_sub_ps(a, b); }
+  static inline vfloat vmul(vfloat a, vfloat b)      { return _mm256_mul_ps(a, b); }
+  static inline vfloat vdiv(vfloat a, vfloat b)      { return _mm256_div_ps(a, b); }
+  static inline vfloat vmin(vfloat a, vfloat b)      { return _mm256_min_ps(a, b); }
+  static inline vfloat vmax(vfloat a, vfloat b)      { return _mm256_max_ps(a, b); }
+  static inline vfloat vsqrt(vfloat a)               { return _mm256_sqrt_ps(a); }
+  static inline vfloat vfloor(vfloat a)              { return _mm256_floor_ps(a); }
+  static inline vfloat vcmplt(vfloat a, vfloat b)    { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static inline vfloat vcmple(vfloat a, vfloat b)    { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+  static inline vfloat vand(vfloat a, vfloat b)      { return _mm256_and_ps(a, b); }
+  static inline vfloat vor(vfloat a, vfloat b)       { return _mm256_or_ps(a, b); }
+  static inline vfloat vsel(vfloat m, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, m); } // m ? a : b
+  static inline int    vmask(vfloat m)               { return _mm256_movemask_ps(m); }
+
+#elif defined(VECBATCH_SSE)
+  #include <emmintrin.h>
+
+  #define VECSIMD_WIDTH 4
+  typedef __m128 vfloat;
+
+  static inline vfloat vload(const float *p)         { return _mm_loadu_ps(p); }
+  static inline void   vstore(float *p, vfloat a)    { _mm_storeu_ps(p, a); }
+  static inline vfloat vset1(float a)                { return _mm_set1_ps(a); }
+  static inline vfloat vadd(vfloat a, vfloat b)      { return _mm_add_ps(a, b); }
+  static inline vfloat vsub(vfloat a, vfloat b)      { return _mm_sub_ps(a, b); }
+  static inline vfloat vmul(vfloat a, vfloat b)      { return _mm_mul_ps(a, b); }
+  static inline vfloat vdiv(vfloat a, vfloat b)      { return _mm_div_ps(a, b); }
+  static inline vfloat vmin(vfloat a, vfloat b)      { return _mm_min_ps(a, b); }
+  static inline vfloat vmax(vfloat a, vfloat b)      { return _mm_max_ps(a, b); }
+  static inline vfloat vsqrt(vfloat a)               { return _mm_sqrt_ps(a); }
+  static inline vfloat vcmplt(vfloat a, vfloat b)    { return _mm_cmplt_ps(a, b); }
+  static inline vfloat vcmple(vfloat a, vfloat b)    { return _mm_cmple_ps(a, b); }
+  static inline vfloat vand(vfloat a, vfloat b)      { return _mm_and_ps(a, b); }
+  static inline vfloat vor(vfloat a, vfloat b)       { return _mm_or_ps(a, b); }
+  static inline vfloat vsel(vfloat m, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); } // m ? a : b
+  static inline int    vmask(vfloat m)               { return _mm_movemask_ps(m); }
+
+  // SSE2 has no floor instruction: truncate, then step down where that rounded up
+  static inline vfloat vfloor(vfloat a)
+  {
+      vfloat t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+      return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+  }
+
+#else
+  #define VECSIMD_WIDTH 1
+#endif
+
+#endif